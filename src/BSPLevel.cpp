@@ -6,6 +6,7 @@
 #define NO_SDL_GLEXT
 #include <SDL/SDL_opengl.h>
 #include <memory>
+#include <algorithm> // min, max
 #include "Renderer.h"
 
 #define BSP_EPSILON         (0.1f)
@@ -855,3 +856,77 @@ bool CBSPLevel::IsSphereStuck(const vec3_t& position, const float radius, const
     return IsSphereStuck(position, radius, m_node[node].children[1]);
 }
 
+bool CBSPLevel::IsLineBlocked(const vec3_t& start, const vec3_t& end) const
+{
+    if(m_node == NULL)
+        return false;
+
+    return IsLineBlocked(start, end, 0); // 0 = root node
+}
+
+bool CBSPLevel::IsLineBlocked(const vec3_t& start, const vec3_t& end, const int node) const
+{
+    if(node < 0) // have we reached a leaf?
+    {
+        const int leafindex = -node-1;
+        const unsigned int trianglecount = m_leaf[leafindex].triangles.size();
+        const vec3_t dir = end - start;
+
+        for(unsigned int i=0;i<trianglecount;i++)
+        {
+            if(LineTriangleIntersect(m_leaf[leafindex].triangles[i], start, dir))
+                return true;
+        }
+        return false;
+    }
+
+    const plane_t& plane = m_plane[m_node[node].plane];
+    const float dstart = plane.GetDistFromPlane(start);
+    const float dend = plane.GetDistFromPlane(end);
+    if(dstart > BSP_EPSILON && dend > BSP_EPSILON)
+        return IsLineBlocked(start, end, m_node[node].children[0]);
+    if(dstart < -BSP_EPSILON && dend < -BSP_EPSILON)
+        return IsLineBlocked(start, end, m_node[node].children[1]);
+    if(fabsf(dstart - dend) < BSP_EPSILON) // along the plane
+    {
+        if(IsLineBlocked(start, end, m_node[node].children[0]))
+            return true;
+        return IsLineBlocked(start, end, m_node[node].children[1]);
+    }
+
+    // Split the line at the plane, the parts overlap by BSP_EPSILON.
+    // The side of start first, a hit there is the nearer one.
+    const float f = dstart / (dstart - dend);
+    const float overlap = BSP_EPSILON / fabsf(dstart - dend);
+    const vec3_t dir = end - start;
+    const vec3_t splitstart = start + dir*std::max(0.0f, f - overlap);
+    const vec3_t splitend = start + dir*std::min(1.0f, f + overlap);
+    const int nearchild = dstart > dend ? 0 : 1;
+    if(IsLineBlocked(start, splitend, m_node[node].children[nearchild]))
+        return true;
+    return IsLineBlocked(splitstart, end, m_node[node].children[1-nearchild]);
+}
+
+bool CBSPLevel::LineTriangleIntersect(const int triangleindex, const vec3_t& start, const vec3_t& dir) const
+{
+    // Moeller-Trumbore, both sides of the triangle
+    const vec3_t& P0 = m_vertex[m_triangle[triangleindex].v[0]].v;
+    const vec3_t Q1 = m_vertex[m_triangle[triangleindex].v[1]].v - P0;
+    const vec3_t Q2 = m_vertex[m_triangle[triangleindex].v[2]].v - P0;
+    const vec3_t p = dir ^ Q2;
+    const float det = Q1 * p;
+    if(fabsf(det) < lynxmath::EPSILON) // parallel
+        return false;
+    const float invdet = 1.0f/det;
+    const vec3_t s = start - P0;
+    const float u = (s * p) * invdet;
+    if(u < 0.0f || u > 1.0f)
+        return false;
+    const vec3_t q = s ^ Q1;
+    const float v = (dir * q) * invdet;
+    if(v < 0.0f || u + v > 1.0f)
+        return false;
+    const float t = (Q2 * q) * invdet;
+    return t >= 0.0f && t <= 1.0f;
+}
+
@@ -41,6 +41,9 @@ public:
 
     void        TraceSphere(bsp_sphere_trace_t* trace) const;
     bool        IsSphereStuck(const vec3_t& position, const float radius) const;
+    // true if the line from start to end hits a triangle. Stops at the
+    // first hit, so this is cheaper than a TraceSphere (line of sight).
+    bool        IsLineBlocked(const vec3_t& start, const vec3_t& end) const;
 
     void        RenderGL(const vec3_t& origin, const CFrustum& frustum) const;
     void        RenderNormals() const;
@@ -49,6 +52,8 @@ protected:
 
     void        TraceSphere(bsp_sphere_trace_t* trace, const int node) const;
     bool        IsSphereStuck(const vec3_t& position, const float radius, const int node) const;
+    bool        IsLineBlocked(const vec3_t& start, const vec3_t& end, const int node) const;
+    bool        LineTriangleIntersect(const int triangleindex, const vec3_t& start, const vec3_t& dir) const;
 
     // Static check
     bool        SphereTriangleIntersectStatic(const int triangleindex,
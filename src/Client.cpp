@@ -3,6 +3,7 @@
 #include "ServerClient.h"
 #include "math/mathconst.h"
 #include <math.h>
+#include <algorithm> // min
 #include <SDL/SDL.h>
 #include "lynxsys.h"
 
@@ -19,11 +20,17 @@ CClient::CClient(CWorldClient* world, CGameLogic* gamelogic)
     m_server = NULL;
     m_isconnecting = false;
     m_challenge_ok = false;
+    m_packetack = 0;
+    m_packetackmask = 0;
 
     m_gamelogic = gamelogic;
 
     m_lat = 0;
     m_lon = 0;
+    m_buttons = 0;
+    m_svcmdack = 0;
+    m_hassvmove = false;
+    m_predvalid = false;
 
     m_lastupdate = CLynxSys::GetTicks();
 }
@@ -53,7 +60,8 @@ bool CClient::Connect(const char* server, const int port)
     enet_address_set_host(&address, server);
     address.port = port;
 
-    m_server = enet_host_connect(m_client, & address, 1, 0);
+    // channel 0: world, channel 1: events (see CEventChannel)
+    m_server = enet_host_connect(m_client, & address, 2, 0);
     if(m_server == NULL)
     {
         Shutdown();
@@ -88,6 +96,14 @@ void CClient::Shutdown()
     }
     m_isconnecting = false;
     m_challenge_ok = false;
+    m_packetack = 0;
+    m_packetackmask = 0;
+    m_buttons = 0;
+    m_usercmds.Clear();
+    m_events.Clear();
+    m_svcmdack = 0;
+    m_hassvmove = false;
+    m_predvalid = false;
 }
 
 void CClient::Update(const float dt, const uint32_t ticks)
@@ -115,7 +131,7 @@ void CClient::Update(const float dt, const uint32_t ticks)
             stream.SetBuffer(event.packet->data,
                              event.packet->dataLength,
                              event.packet->dataLength);
-            if(event.channelID == 0)
+            if(event.channelID == 0 || event.channelID == 1) // 1: events (see CEventChannel)
             {
                 OnReceive(&stream);
             }
@@ -152,19 +168,19 @@ void CClient::Update(const float dt, const uint32_t ticks)
         return;
 
     // Input and control
-    std::vector<std::string> clcmdlist;
     bool forcesend = false;
-    InputGetCmdList(&clcmdlist, &forcesend);
+    const uint32_t buttons = InputGetButtons(&forcesend);
     InputMouseMove(); // update m_lat and m_lon
-    m_gamelogic->ClientMove(GetLocalController(), clcmdlist);
+    m_buttons |= buttons; // a short key press between two client states is not lost
 
     // Send input to server
-    SendClientState(clcmdlist, forcesend, ticks);
+    SendClientState(forcesend, ticks);
+
+    Predict(ticks);
 }
 
-void CClient::SendClientState(const std::vector<std::string>& clcmdlist, bool forcesend, uint32_t ticks)
+void CClient::SendClientState(bool forcesend, uint32_t ticks)
 {
-    size_t i;
     if(!IsConnected() || m_world->GetBSP()->GetFilename() == "")
         return;
 
@@ -175,21 +191,26 @@ void CClient::SendClientState(const std::vector<std::string>& clcmdlist, bool fo
         return;
 
     ENetPacket* packet;
-    CObj* localctrl = GetLocalController();
     CStream stream;
     stream.SetSize(MAX_CL_PACKETLEN);
 
     CNetMsg::WriteHeader(&stream, NET_MSG_CLIENT_CTRL);
     stream.WriteDWORD(m_world->GetWorldID());
-    stream.WriteVec3(localctrl->GetOrigin());
-    stream.WriteVec3(localctrl->GetVel());
-    stream.WriteFloat(m_lat);
-    stream.WriteFloat(m_lon);
-
-    assert(clcmdlist.size() < USHRT_MAX);
-    stream.WriteWORD((uint16_t)clcmdlist.size());
-    for(i=0;i<clcmdlist.size();i++)
-        stream.WriteString(clcmdlist[i]);
+    stream.WriteDWORD(m_packetack);
+    stream.WriteDWORD(m_packetackmask);
+    stream.WriteDWORD(m_events.GetAck());
+
+    // The command moves the player for the time since the last one
+    usercmd_t cmd;
+    cmd.buttons = m_buttons;
+    cmd.lat = m_lat;
+    cmd.lon = m_lon;
+    cmd.msec = ticks - m_lastupdate;
+    cmd.viewtime = m_world->GetRenderLeveltime(); // for the lag compensation
+    m_usercmds.Add(cmd);
+    m_buttons = 0;
+    m_predvalid = false;
+    m_usercmds.Serialize(true, &stream);
 
     if(stream.GetWriteOverflow())
     {
@@ -260,6 +281,10 @@ void CClient::OnReceive(CStream* stream)
 {
     uint8_t type;
     uint32_t localobj;
+    uint32_t packetseq;
+    uint32_t cmdack;
+    uint8_t onground;
+    client_move_t svmove;
 
     // fprintf(stderr, "%i Client Incoming data: %i bytes\n", CLynx::GetTicks()&255, stream->GetBytesToRead());
 
@@ -269,9 +294,36 @@ void CClient::OnReceive(CStream* stream)
     case NET_MSG_SERIALIZE_WORLD:
         stream->ReadDWORD(&localobj);
         m_world->m_hud.Serialize(false, stream, m_world->GetResourceManager());
+        stream->ReadDWORD(&cmdack);
+        stream->ReadVec3(&svmove.origin);
+        stream->ReadVec3(&svmove.vel);
+        stream->ReadBYTE(&onground);
+        svmove.onground = onground != 0;
+        if(localobj && !stream->GetReadOverflow())
+        {
+            // every packet of a snapshot has the same player movement
+            m_svmove = svmove;
+            m_svcmdack = cmdack;
+            m_hassvmove = true;
+            m_predvalid = false;
+        }
+        stream->ReadDWORD(&packetseq); // 0: the whole snapshot in one packet
+        if(packetseq)
+            AckPacket(packetseq);
         m_world->Serialize(false, stream);
         m_world->SetLocalObj(localobj);
         break;
+    case NET_MSG_EVENTS:
+        // The positions need the precision of the world (see world_quant_t),
+        // the server sends the events again after the first snapshot.
+        if(m_world->GetWorldID() > 0)
+        {
+            std::vector<world_event_t> events;
+            m_events.Read(stream, m_world->GetQuant(), &events);
+            for(size_t i=0;i<events.size();i++)
+                m_world->AddEffect(events[i]);
+        }
+        break;
     case NET_MSG_CLIENT_CHALLENGE_OK:
         m_challenge_ok = true;
         fprintf(stderr, "CL: Server accepted us. Challenge OK.\n");
@@ -282,6 +334,76 @@ void CClient::OnReceive(CStream* stream)
     }
 }
 
+void CClient::GetMove(const CObj* obj, client_move_t* move)
+{
+    move->origin = obj->GetOrigin();
+    move->vel = obj->GetVel();
+    move->onground = obj->locGetIsOnGround();
+}
+
+void CClient::SetMove(CObj* obj, const client_move_t& move)
+{
+    obj->SetOrigin(move.origin);
+    obj->SetVel(move.vel);
+    obj->locSetIsOnGround(move.onground);
+}
+
+void CClient::Predict(uint32_t ticks)
+{
+    if(!m_hassvmove)
+        return;
+
+    CObj* localctrl = GetLocalController();
+    const quaternion_t rot = localctrl->GetRot(); // the movement only uses lon
+
+    // New server state or new command: replay the commands, that
+    // the server has not processed yet
+    if(!m_predvalid)
+    {
+        SetMove(localctrl, m_svmove);
+        for(uint32_t seq=m_svcmdack+1;seq<=m_usercmds.GetSeq();seq++)
+        {
+            const usercmd_t* cmd = m_usercmds.GetCmd(seq);
+            if(cmd) // NULL: older than the history, huge lag
+                m_gamelogic->ClientCmdMove(localctrl, *cmd);
+        }
+        GetMove(localctrl, &m_predmove);
+        m_predvalid = true;
+    }
+
+    // The input since the last command is in the next command
+    usercmd_t cmd;
+    cmd.seq = 0;
+    cmd.buttons = m_buttons;
+    cmd.lat = m_lat;
+    cmd.lon = m_lon;
+    cmd.msec = std::min<uint32_t>(ticks - m_lastupdate, USERCMD_MAX_MSEC);
+    cmd.viewtime = 0;
+    SetMove(localctrl, m_predmove);
+    if(cmd.msec > 0)
+        m_gamelogic->ClientCmdMove(localctrl, cmd);
+    localctrl->SetRot(rot);
+}
+
+void CClient::AckPacket(uint32_t seq)
+{
+    if(seq > m_packetack)
+    {
+        const uint32_t shift = seq - m_packetack;
+        if(m_packetack == 0 || shift > 32)
+            m_packetackmask = 0;
+        else if(shift == 32)
+            m_packetackmask = 1u << 31;
+        else
+            m_packetackmask = (m_packetackmask << shift) | (1u << (shift-1));
+        m_packetack = seq;
+    }
+    else if(seq < m_packetack && m_packetack - seq <= 32)
+    {
+        m_packetackmask |= 1u << (m_packetack - seq - 1);
+    }
+}
+
 void CClient::InputMouseMove()
 {
     CObj* obj = GetLocalController();
@@ -304,9 +426,10 @@ void CClient::InputMouseMove()
     obj->SetRot(qlon*qlat);
 }
 
-void CClient::InputGetCmdList(std::vector<std::string>* clcmdlist, bool* forcesend)
+uint32_t CClient::InputGetButtons(bool* forcesend)
 {
     uint8_t* keystate = CLynxSys::GetKeyState();
+    uint32_t buttons = 0;
     *forcesend = false;
     bool firedown = false;
 
@@ -317,27 +440,27 @@ void CClient::InputGetCmdList(std::vector<std::string>* clcmdlist, bool* forcese
      */
 
     if(keystate[SDLK_w])
-        clcmdlist->push_back("+mf");
+        buttons |= USERCMD_FORWARD;
     if(keystate[SDLK_s])
-        clcmdlist->push_back("+mb");
+        buttons |= USERCMD_BACKWARD;
     if(keystate[SDLK_a])
-        clcmdlist->push_back("+ml");
+        buttons |= USERCMD_LEFT;
     if(keystate[SDLK_d])
-        clcmdlist->push_back("+mr");
+        buttons |= USERCMD_RIGHT;
     if(keystate[SDLK_SPACE] == 1)
-        clcmdlist->push_back("+jmp");
+        buttons |= USERCMD_JUMP;
     if(keystate[SDLK_f] || CLynxSys::MouseLeftDown())
     {
         firedown = true;
-        clcmdlist->push_back("+fire");
+        buttons |= USERCMD_FIRE;
     }
     if(keystate[SDLK_1])
     {
-        clcmdlist->push_back("w_rocket");
+        buttons |= USERCMD_ROCKET;
     }
     if(keystate[SDLK_2])
     {
-        clcmdlist->push_back("w_gun");
+        buttons |= USERCMD_GUN;
     }
     if(keystate[SDLK_e] == 1) // key down event
     {
@@ -353,11 +476,7 @@ void CClient::InputGetCmdList(std::vector<std::string>* clcmdlist, bool* forcese
         fprintf(stderr, "Incoming packets total: %i\n", m_client->totalReceivedPackets);
         fprintf(stderr, "Outgoing data total: %i\n", m_client->totalSentPackets);
     }
-    if(keystate[SDLK_r] == 1) // debug method: respawn local player
-    {
-        bspbin_spawn_t spawn = m_world->GetBSP()->GetRandomSpawnPoint();
-        GetLocalController()->SetOrigin(spawn.point);
-    }
+    return buttons;
 }
 
 CObj* CClient::GetLocalController()
@@ -3,6 +3,8 @@
 #include "../enet/enet.h"
 #include "WorldClient.h"
 #include "GameLogic.h"
+#include "UserCmd.h"
+#include "EventChannel.h"
 
 /*
     CClient kmmert sich um die Netzwerk-Verwaltung auf Client-Seite.
@@ -12,6 +14,13 @@
     allerdings noch in eine eigene Klasse ausgelagert werden.
  */
 
+// Movement state of the local player for the prediction
+struct client_move_t
+{
+    vec3_t      origin;
+    vec3_t      vel;
+    bool        onground;
+};
 
 class CClient
 {
@@ -33,8 +42,12 @@ protected:
     void OnReceive(CStream* stream);
 
     void InputMouseMove(); // update m_lat and m_lon
-    void InputGetCmdList(std::vector<std::string>* clcmdlist, bool* forcesend); // forcesend: are there commands to be send immediately
-    void SendClientState(const std::vector<std::string>& clcmdlist, bool forcesend, uint32_t ticks);
+    uint32_t InputGetButtons(bool* forcesend); // USERCMD_* bits, forcesend: are there commands to be send immediately
+    void SendClientState(bool forcesend, uint32_t ticks);
+    // Client-side prediction: the local controller starts at the player
+    // movement from the server and moves with every command the server
+    // has not processed yet, then with the input since the last command.
+    void Predict(uint32_t ticks);
     void SendChallenge(); // after connecting, we send a challenge message to the server
     CObj* GetLocalController(); // object that does only exist on the client side. a virtual camera.
     CObj* GetLocalObj(); // real game object connected to the player
@@ -53,12 +66,31 @@ private:
     int m_jump;
     float m_lat; // mouse dx
     float m_lon; // mouse dy
+    uint32_t m_buttons; // buttons pressed since the last client state
+    CUserCmdList m_usercmds; // the last commands sent to the server
+
+    // Prediction
+    static void GetMove(const CObj* obj, client_move_t* move);
+    static void SetMove(CObj* obj, const client_move_t& move);
+    client_move_t m_svmove; // player from the server, after command m_svcmdack
+    uint32_t m_svcmdack; // last command the server has processed
+    bool m_hassvmove; // m_svmove is valid
+    client_move_t m_predmove; // after the last sent command
+    bool m_predvalid; // false: m_predmove has to be replayed from m_svmove
 
     CWorldClient* m_world;
     CGameLogic* m_gamelogic;
 
     uint32_t m_lastupdate; // last time we have sent the client state to the server
 
+    // Received world packets for the ACK (see CPacketScheduler)
+    void AckPacket(uint32_t seq);
+    uint32_t m_packetack; // newest packet number
+    uint32_t m_packetackmask; // bit i: packet m_packetack-1-i received
+
+    // Sounds and effects from the server, the newest one is acknowledged
+    CEventChannel m_events;
+
     // Client input config settings
     cvar_t* m_cfg_mouse_sensitivity;
     cvar_t* m_cfg_mouse_invert;
@@ -3,6 +3,10 @@
 #include <vector>
 #include <string>
 #include "ClientHUD.h"
+#include "Interest.h"
+#include "PacketScheduler.h"
+#include "UserCmd.h"
+#include "EventChannel.h"
 
 #define MAX_CLIENT_NAME_LEN   32
 
@@ -19,6 +23,8 @@ public:
         m_obj         = 0;
         worldidACK    = 0;
         lat = lon     = 0.0f;
+        usercmdack    = 0;
+        movetime      = USERCMD_MAX_MOVETIME;
         name          = "unnamed";
         got_challenge = false;
         disconnected  = false;
@@ -35,14 +41,18 @@ public:
     int         m_obj;
     uint32_t    worldidACK;    // Last ACK'd world from client (for delta-compr.)
     CClientHUD  hud;
+    CInterestSet interest;     // objects in the snapshots for this client (if sv_interest is on)
+    CPacketScheduler packets;  // world packets for this client (if sv_packets is on)
+    CEventChannel events;      // sounds and effects, that the client has not acknowledged yet
     std::string name;          // human readable name
     float       lat, lon;      // mouse lat and lon
     bool        got_challenge; // do we have the challenge msg from this client
     bool        disconnected;  // is this client waiting for a disconnect?
 
     // Client Input
-    std::vector<std::string> clcmdlist; // all user commands are stored here as
-                                        // string. e.g. "+attack"
+    CUserCmdList usercmds;     // received commands, the game logic takes the pending ones
+    uint32_t    usercmdack;    // last command the player has moved with
+    float       movetime;      // seconds the player can move with the next commands
 private:
     int m_id;
     ENetPeer* m_peer;
@@ -0,0 +1,144 @@
+#include <assert.h>
+#include "EventChannel.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+CEventChannel::CEventChannel()
+{
+    Clear();
+}
+
+CEventChannel::~CEventChannel()
+{
+}
+
+void CEventChannel::Clear()
+{
+    m_pending.clear();
+    m_seq = 0;
+    m_nameids.clear();
+    m_nameacked.clear();
+    m_names.clear();
+}
+
+void CEventChannel::Add(const world_event_t& event, uint32_t leveltime)
+{
+    event_pending_t pending;
+    std::map<std::string, int>::const_iterator iter = m_nameids.find(event.name);
+    if(iter == m_nameids.end())
+    {
+        pending.nameid = (int)m_nameacked.size();
+        m_nameids[event.name] = pending.nameid;
+        m_nameacked.push_back(false);
+    }
+    else
+        pending.nameid = iter->second;
+    pending.seq = ++m_seq;
+    pending.leveltime = leveltime;
+    pending.event = event;
+    m_pending.push_back(pending);
+    if(m_pending.size() > EVENT_MAX_PENDING)
+        m_pending.pop_front();
+}
+
+void CEventChannel::Ack(uint32_t seq)
+{
+    while(!m_pending.empty() && m_pending.front().seq <= seq)
+    {
+        m_nameacked[m_pending.front().nameid] = true;
+        m_pending.pop_front();
+    }
+}
+
+bool CEventChannel::HasPending(uint32_t leveltime)
+{
+    while(!m_pending.empty() && leveltime - m_pending.front().leveltime > EVENT_MAX_AGE)
+        m_pending.pop_front();
+    return !m_pending.empty();
+}
+
+// Message: the sequence number of the first event, the number of events
+// and the events. An event has the type, the name number (and the
+// string, if the client might not have it), the origin (like an object
+// origin, see world_quant_t), the lifetime and the particle parameters.
+void CEventChannel::Write(CStream* stream, const world_quant_t& quant) const
+{
+    const int originbits = quant.GetOriginBits();
+    std::deque<event_pending_t>::const_iterator iter;
+
+    stream->WriteBits(m_pending.empty() ? m_seq + 1 : m_pending.front().seq, 32);
+    stream->WriteVarBits((uint32_t)m_pending.size(), EVENT_COUNTBITS);
+    for(iter=m_pending.begin();iter!=m_pending.end();++iter)
+    {
+        const world_event_t& event = iter->event;
+        stream->WriteBits(event.type, EVENT_TYPEBITS);
+        stream->WriteVarBits(iter->nameid, EVENT_NAMEBITS);
+        stream->WriteBits(m_nameacked[iter->nameid] ? 0 : 1, 1);
+        if(!m_nameacked[iter->nameid])
+            stream->WriteString(event.name); // starts at the next full byte
+        stream->WriteFixed(event.origin.x, originbits, quant.originfrac);
+        stream->WriteFixed(event.origin.y, originbits, quant.originfrac);
+        stream->WriteFixed(event.origin.z, originbits, quant.originfrac);
+        stream->WriteVarBits((event.lifetime + EVENT_LIFETIMESTEP - 1) / EVENT_LIFETIMESTEP, EVENT_LIFETIMEBITS);
+        if(event.type == WORLD_EVENT_PARTICLES)
+        {
+            stream->WriteFixed(event.dir.x, EVENT_DIRBITS, EVENT_DIRFRAC);
+            stream->WriteFixed(event.dir.y, EVENT_DIRBITS, EVENT_DIRFRAC);
+            stream->WriteFixed(event.dir.z, EVENT_DIRBITS, EVENT_DIRFRAC);
+            stream->WriteFixed(event.size, EVENT_SIZEBITS, EVENT_SIZEFRAC);
+        }
+    }
+}
+
+void CEventChannel::Read(CStream* stream, const world_quant_t& quant, std::vector<world_event_t>* events)
+{
+    const int originbits = quant.GetOriginBits();
+    world_event_t event;
+    uint32_t seq, count, i, nameid;
+
+    seq = stream->ReadBits(32);
+    count = stream->ReadVarBits(EVENT_COUNTBITS);
+    if(count > EVENT_MAX_PENDING)
+    {
+        assert(0);
+        return;
+    }
+    for(i=0;i<count;i++,seq++)
+    {
+        event.type = (int)stream->ReadBits(EVENT_TYPEBITS);
+        nameid = stream->ReadVarBits(EVENT_NAMEBITS);
+        if(stream->ReadBits(1))
+        {
+            if(nameid >= m_names.size())
+                m_names.resize(nameid+1);
+            stream->ReadString(&m_names[nameid]);
+        }
+        event.name = nameid < m_names.size() ? m_names[nameid] : "";
+        event.origin.x = stream->ReadFixed(originbits, quant.originfrac);
+        event.origin.y = stream->ReadFixed(originbits, quant.originfrac);
+        event.origin.z = stream->ReadFixed(originbits, quant.originfrac);
+        event.lifetime = stream->ReadVarBits(EVENT_LIFETIMEBITS) * EVENT_LIFETIMESTEP;
+        if(event.type == WORLD_EVENT_PARTICLES)
+        {
+            event.dir.x = stream->ReadFixed(EVENT_DIRBITS, EVENT_DIRFRAC);
+            event.dir.y = stream->ReadFixed(EVENT_DIRBITS, EVENT_DIRFRAC);
+            event.dir.z = stream->ReadFixed(EVENT_DIRBITS, EVENT_DIRFRAC);
+            event.size = stream->ReadFixed(EVENT_SIZEBITS, EVENT_SIZEFRAC);
+        }
+        else
+        {
+            event.dir = vec3_t::origin;
+            event.size = 0.0f;
+        }
+        if(stream->GetReadOverflow())
+            return;
+        if(seq <= m_seq) // we have this one already
+            continue;
+        m_seq = seq;
+        if(!event.name.empty())
+            events->push_back(event);
+    }
+}
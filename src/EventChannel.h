@@ -0,0 +1,79 @@
+#pragma once
+
+#include "lynx.h"
+#include "Stream.h"
+#include "World.h"
+#include <deque>
+#include <map>
+#include <vector>
+#include <string>
+
+/*
+    CEventChannel: the one-shot events of the server (sounds, blood, dust,
+    explosions, see world_event_t) for one client.
+
+    The events are not objects in the snapshots. The server keeps every
+    event, until the client has acknowledged it, and sends the open
+    events after every snapshot (NET_MSG_EVENTS). So a lost message only
+    delays an event. The client gets an event at least once and skips
+    the events it already has (every event has a sequence number).
+    Events older than EVENT_MAX_AGE are dropped, a late sound is worse
+    than no sound.
+
+    The names (sound file or particle system) are numbers. A name is
+    sent as string with the events, until the client has acknowledged
+    one of them.
+
+    Server: Add() the events, Write() the open ones, Ack() from the client.
+    Client: Read() the message, GetAck() for the server.
+ */
+
+#define EVENT_MAX_AGE           1000 // ms
+#define EVENT_MAX_PENDING       128 // the server drops older events
+#define EVENT_TYPEBITS          2
+#define EVENT_COUNTBITS         4 // number of events in a message, groups of 4 bits
+#define EVENT_NAMEBITS          3 // name number, groups of 3 bits
+#define EVENT_DIRBITS           16 // direction: fixed point, +-128
+#define EVENT_DIRFRAC           8
+#define EVENT_SIZEBITS          12 // size: fixed point, +-128
+#define EVENT_SIZEFRAC          4
+#define EVENT_LIFETIMESTEP      10 // ms
+#define EVENT_LIFETIMEBITS      4 // lifetime in EVENT_LIFETIMESTEP, groups of 4 bits
+
+class CEventChannel
+{
+public:
+    CEventChannel();
+    ~CEventChannel();
+
+    void        Clear();
+
+    // Server: new event at leveltime
+    void        Add(const world_event_t& event, uint32_t leveltime);
+    // Server: the client has every event up to seq
+    void        Ack(uint32_t seq);
+    // Server: are there events the client has not acknowledged yet
+    // (and that are not older than EVENT_MAX_AGE at leveltime)?
+    bool        HasPending(uint32_t leveltime);
+    // Server: write the open events
+    void        Write(CStream* stream, const world_quant_t& quant) const;
+
+    // Client: append the new events of the message to events
+    void        Read(CStream* stream, const world_quant_t& quant, std::vector<world_event_t>* events);
+    uint32_t    GetAck() const { return m_seq; } // client: newest event
+
+private:
+    struct event_pending_t
+    {
+        uint32_t        seq;
+        uint32_t        leveltime;
+        int             nameid;
+        world_event_t   event;
+    };
+    std::deque<event_pending_t> m_pending; // server: oldest first
+    uint32_t    m_seq; // server: last event, client: newest received event
+
+    std::map<std::string, int> m_nameids; // server
+    std::vector<bool> m_nameacked; // server: index nameid, the client has the name
+    std::vector<std::string> m_names; // client: index nameid
+};
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include "FrameArena.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+#define FRAMEARENA_ALIGN            16
+
+CFrameArena::CFrameArena(const size_t size)
+{
+    m_offset = 0;
+    m_used = 0;
+    m_peak = 0;
+    m_heapallocs = 0;
+    AddBlock(size);
+}
+
+CFrameArena::~CFrameArena()
+{
+    for(size_t i=0;i<m_blocks.size();i++)
+        free(m_blocks[i].mem);
+    m_blocks.clear();
+}
+
+void CFrameArena::AddBlock(const size_t size)
+{
+    framearena_block_t block;
+
+    block.mem = (uint8_t*)malloc(size);
+    if(!block.mem)
+        throw std::bad_alloc();
+    block.size = size;
+    m_blocks.push_back(block);
+    m_offset = 0;
+    m_heapallocs++;
+}
+
+void* CFrameArena::Alloc(const size_t size)
+{
+    const size_t alignedsize = (size + FRAMEARENA_ALIGN - 1) & ~(size_t)(FRAMEARENA_ALIGN - 1);
+    void* p;
+
+    if(m_offset + alignedsize > m_blocks.back().size)
+    {
+        // at least twice as large as the last block
+        size_t blocksize = 2*m_blocks.back().size;
+        if(blocksize < alignedsize)
+            blocksize = alignedsize;
+        AddBlock(blocksize);
+    }
+
+    p = m_blocks.back().mem + m_offset;
+    m_offset += alignedsize;
+    m_used += alignedsize;
+    if(m_used > m_peak)
+        m_peak = m_used;
+    return p;
+}
+
+void CFrameArena::Reset()
+{
+    size_t i, total;
+
+    if(m_blocks.size() > 1)
+    {
+        // Replace the blocks with one block,
+        // where this frame would have fit in.
+        total = 0;
+        for(i=0;i<m_blocks.size();i++)
+        {
+            total += m_blocks[i].size;
+            free(m_blocks[i].mem);
+        }
+        m_blocks.clear();
+        AddBlock(total);
+    }
+    m_offset = 0;
+    m_used = 0;
+}
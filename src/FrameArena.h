@@ -0,0 +1,102 @@
+#pragma once
+
+#include "lynx.h"
+#include <vector>
+#include <new> // placement new
+#include <stddef.h> // ptrdiff_t
+
+/*
+    CFrameArena: memory for temporary data, that is only needed in
+    the current frame (query results, serialization helpers).
+
+    Alloc takes the next bytes from a large block (a linear or bump
+    allocator). There is no Free. Reset throws everything away at
+    once, CWorld calls Reset at the end of CWorld::Update.
+
+    If the block is full, the arena gets another one from the heap.
+    On Reset, the blocks are merged into one block, that is large
+    enough for the whole frame. So after a few frames, the arena
+    does not allocate from the heap anymore.
+
+    Use CFrameAllocator to put STL containers into the arena:
+
+        world_objlist_t objlist(GetWorld()->GetFrameArena());
+        GetWorld()->GetNearObj(origin, 50.0f, GetID(), GAME_OBJ_TYPE_PLAYER, &objlist);
+
+    The arena is not thread-safe. Don't keep pointers into the arena
+    for the next frame.
+ */
+
+#define FRAMEARENA_DEFAULT_SIZE     (64*1024) // bytes
+
+class CFrameArena
+{
+public:
+    CFrameArena(const size_t size=FRAMEARENA_DEFAULT_SIZE);
+    ~CFrameArena();
+
+    void*       Alloc(const size_t size); // 16 byte aligned
+    void        Reset(); // free everything
+
+    size_t      GetUsed() const { return m_used; } // bytes since the last Reset
+    size_t      GetPeak() const { return m_peak; } // max. bytes used in a frame
+    uint32_t    GetHeapAllocs() const { return m_heapallocs; } // blocks allocated so far
+
+private:
+    struct framearena_block_t
+    {
+        uint8_t* mem;
+        size_t  size;
+    };
+
+    std::vector<framearena_block_t> m_blocks; // the last one is the current block
+    size_t      m_offset; // in the current block
+    size_t      m_used;
+    size_t      m_peak;
+    uint32_t    m_heapallocs;
+
+    void        AddBlock(const size_t size);
+
+    // Rule of three
+    CFrameArena(const CFrameArena&);
+    CFrameArena& operator=(const CFrameArena&);
+};
+
+// STL allocator for CFrameArena, e.g.
+// std::vector<int, CFrameAllocator<int> > list(arena);
+// deallocate does nothing, the memory is freed by CFrameArena::Reset.
+template<class T>
+class CFrameAllocator
+{
+public:
+    typedef T               value_type;
+    typedef T*              pointer;
+    typedef const T*        const_pointer;
+    typedef T&              reference;
+    typedef const T&        const_reference;
+    typedef size_t          size_type;
+    typedef ptrdiff_t       difference_type;
+
+    template<class U> struct rebind { typedef CFrameAllocator<U> other; };
+
+    CFrameAllocator(CFrameArena* arena) : m_arena(arena) {}
+    template<class U> CFrameAllocator(const CFrameAllocator<U>& other) : m_arena(other.GetArena()) {}
+
+    pointer         address(reference r) const { return &r; }
+    const_pointer   address(const_reference r) const { return &r; }
+    pointer         allocate(size_type n, const void* hint=0) { return (pointer)m_arena->Alloc(n*sizeof(T)); }
+    void            deallocate(pointer p, size_type n) {}
+    size_type       max_size() const { return ((size_type)-1)/sizeof(T); }
+    void            construct(pointer p, const T& val) { ::new((void*)p) T(val); }
+    void            destroy(pointer p) { p->~T(); }
+
+    CFrameArena*    GetArena() const { return m_arena; }
+
+private:
+    CFrameArena*    m_arena;
+};
+
+template<class T, class U>
+bool operator==(const CFrameAllocator<T>& a, const CFrameAllocator<U>& b) { return a.GetArena() == b.GetArena(); }
+template<class T, class U>
+bool operator!=(const CFrameAllocator<T>& a, const CFrameAllocator<U>& b) { return a.GetArena() != b.GetArena(); }
@@ -37,7 +37,7 @@ void CGameLogic::Update(const float dt, const uint32_t ticks)
     assert(0);
 }
 
-void CGameLogic::ClientMove(CObj* clientobj, const std::vector<std::string>& clcmdlist)
+void CGameLogic::ClientMove(CObj* clientobj, uint32_t buttons)
 {
     vec3_t velocity, dir, side;
     vec3_t newdir(0,0,0);
@@ -49,29 +49,16 @@ void CGameLogic::ClientMove(CObj* clientobj, const std::vector<std::string>& clc
     rot.GetVec3(&dir, NULL, &side);
     dir = -dir;
 
-    for(size_t i=0;i<clcmdlist.size();i++)
-    {
-        if(clcmdlist[i] == "+mf") // move forward
-        {
-            newdir += dir;
-        }
-        else if(clcmdlist[i] == "+mb") // move backward
-        {
-            newdir -= dir;
-        }
-        else if(clcmdlist[i] == "+ml") // move left
-        {
-            newdir -= side;
-        }
-        else if(clcmdlist[i] == "+mr") // move right
-        {
-            newdir += side;
-        }
-        else if(clcmdlist[i] == "+jmp") // jump
-        {
-            jump = vec3_t(0,1.0f,0);
-        }
-    }
+    if(buttons & USERCMD_FORWARD)
+        newdir += dir;
+    if(buttons & USERCMD_BACKWARD)
+        newdir -= dir;
+    if(buttons & USERCMD_LEFT)
+        newdir -= side;
+    if(buttons & USERCMD_RIGHT)
+        newdir += side;
+    if(buttons & USERCMD_JUMP)
+        jump = vec3_t(0,1.0f,0);
 
     const float clientspeed = 20.0f;
     const float jumpspeed = 100.0f;
@@ -85,6 +72,13 @@ void CGameLogic::ClientMove(CObj* clientobj, const std::vector<std::string>& clc
     clientobj->SetVel(newdir);
 }
 
+void CGameLogic::ClientCmdMove(CObj* clientobj, const usercmd_t& cmd)
+{
+    ClientMouse(clientobj, cmd.lat, cmd.lon);
+    ClientMove(clientobj, cmd.buttons);
+    GetWorld()->ObjMove(clientobj, (float)cmd.msec*0.001f);
+}
+
 void CGameLogic::ClientMouse(CObj* clientobj, float lat, float lon)
 {
     // Welt sichtbare Rotation nur entlang der y-Achse anhand von lat und lon berechnen
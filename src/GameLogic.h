@@ -4,6 +4,7 @@
 #include "Events.h"
 #include "World.h"
 #include "Server.h"
+#include "UserCmd.h"
 
 class CGameLogic : public CObserver<EventNewClientConnected>,
                    public CObserver<EventClientDisconnected>
@@ -15,8 +16,11 @@ public:
     virtual bool InitGame(const char* level);
     virtual void Update(const float dt, const uint32_t ticks);
 
-    virtual void ClientMove(CObj* clientobj, const std::vector<std::string>& clcmdlist); // Client is using the same movement code
+    virtual void ClientMove(CObj* clientobj, uint32_t buttons); // USERCMD_* bits. Client is using the same movement code
     virtual void ClientMouse(CObj* clientobj, float lat, float lon);
+    // Move clientobj with one user command: the server for every command
+    // of the client, the client for the prediction.
+    void         ClientCmdMove(CObj* clientobj, const usercmd_t& cmd);
 
     virtual void Precache(CResourceManager* resman) {} // gets called by InitGame to preload resources
 
@@ -1,16 +1,14 @@
 #include "GameObj.h"
 #include <math.h> // atan2
-#include "ParticleSystemBlood.h"
-#include "ParticleSystemDust.h"
-#include "ParticleSystemExplosion.h"
-#include "ParticleSystemRocket.h"
 
 #ifdef _DEBUG
 #include <crtdbg.h>
 #define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
 #endif
 
-CGameObj::CGameObj(CWorld* world) : CObj(world)
+OBJPOOL_DEFINE(CGameObj)
+
+CGameObj::CGameObj(CWorld* world) : CObj(world), m_think(world->GetThinkScheduler())
 {
     m_health = GAME_OBJ_BASE_HEALTH;
 }
@@ -45,67 +43,55 @@ void CGameObj::Respawn(const vec3_t& location, const quaternion_t& rotation)
     SetHealth(GAME_OBJ_BASE_HEALTH);
 }
 
+void CGameObj::SpawnParticles(const std::string& system, const vec3_t& location,
+                              const vec3_t& dir, const float size, uint32_t lifetime)
+{
+    world_event_t event;
+    event.type = WORLD_EVENT_PARTICLES;
+    event.name = system;
+    event.origin = location;
+    event.dir = dir;
+    event.size = size;
+    event.lifetime = lifetime;
+    GetWorld()->AddEvent(event);
+}
+
 void CGameObj::SpawnParticleBlood(const vec3_t& location, const vec3_t& dir, const float size)
 {
     static const uint32_t BLOOD_LIFETIME = 1000; // ms
 
-    CGameObj* blood = new CGameObj(GetWorld());
-    blood->SetRadius(0.0f);
-    blood->SetOrigin(location);
-    blood->SetParticleSystem("blood|" + CParticleSystemBlood::GetConfigString(dir, size));
-    blood->m_think.AddFunc(new CThinkFuncRemoveMe(GetWorld()->GetLeveltime() + BLOOD_LIFETIME, GetWorld(), blood));
-    blood->AddFlags(OBJ_FLAGS_NOGRAVITY);
-    GetWorld()->AddObj(blood);
+    SpawnParticles("blood", location, dir, size, BLOOD_LIFETIME);
 }
 
 void CGameObj::SpawnParticleDust(const vec3_t& location, const vec3_t& dir)
 {
     static const uint32_t DUST_LIFETIME = 600; // ms
 
-    CGameObj* dust = new CGameObj(GetWorld());
-    dust->SetRadius(0.0f);
-    dust->SetOrigin(location);
-    dust->SetParticleSystem("dust|" + CParticleSystemDust::GetConfigString(dir));
-    dust->m_think.AddFunc(new CThinkFuncRemoveMe(GetWorld()->GetLeveltime() + DUST_LIFETIME, GetWorld(), dust));
-    dust->AddFlags(OBJ_FLAGS_NOGRAVITY);
-    GetWorld()->AddObj(dust);
+    SpawnParticles("dust", location, dir, 0.0f, DUST_LIFETIME);
 }
 
 void CGameObj::SpawnParticleRocket(const vec3_t& location, const vec3_t& dir)
 {
     static const uint32_t ROCKETTRAIL_LIFETIME = 500; // ms
 
-    CGameObj* rockettrail = new CGameObj(GetWorld());
-    rockettrail->SetRadius(0.0f);
-    rockettrail->SetOrigin(location);
-    rockettrail->SetParticleSystem("rock|" + CParticleSystemRocket::GetConfigString(dir));
-    rockettrail->m_think.AddFunc(new CThinkFuncRemoveMe(GetWorld()->GetLeveltime() + ROCKETTRAIL_LIFETIME, GetWorld(), rockettrail));
-    rockettrail->AddFlags(OBJ_FLAGS_NOGRAVITY);
-    GetWorld()->AddObj(rockettrail);
+    SpawnParticles("rock", location, dir, 0.0f, ROCKETTRAIL_LIFETIME);
 }
 
 void CGameObj::SpawnParticleExplosion(const vec3_t& location, const float size)
 {
     static const uint32_t EXPL_LIFETIME = 800; // ms
 
-    CGameObj* explosion = new CGameObj(GetWorld());
-    explosion->SetRadius(0.0f);
-    explosion->SetOrigin(location);
-    explosion->SetParticleSystem("expl|" + CParticleSystemExplosion::GetConfigString(size));
-    explosion->m_think.AddFunc(new CThinkFuncRemoveMe(GetWorld()->GetLeveltime() + EXPL_LIFETIME, GetWorld(), explosion));
-    explosion->AddFlags(OBJ_FLAGS_NOGRAVITY);
-    GetWorld()->AddObj(explosion);
+    SpawnParticles("expl", location, vec3_t::origin, size, EXPL_LIFETIME);
 }
 
-int CGameObj::CreateSoundObj(const vec3_t& location, const std::string& soundpath, uint32_t lifetime)
+void CGameObj::EmitSound(const vec3_t& location, const std::string& soundpath, uint32_t lifetime)
 {
-    CGameObj* sound = new CGameObj(GetWorld());
-    sound->SetRadius(0.0f);
-    sound->SetOrigin(location);
-    sound->m_think.AddFunc(new CThinkFuncRemoveMe(GetWorld()->GetLeveltime() + lifetime, GetWorld(), sound));
-    sound->AddFlags(OBJ_FLAGS_GHOST | OBJ_FLAGS_NOGRAVITY);
-    sound->SetResource(soundpath);
-    GetWorld()->AddObj(sound, true);
-    return sound->GetID();
+    world_event_t event;
+    event.type = WORLD_EVENT_SOUND;
+    event.name = soundpath;
+    event.origin = location;
+    event.dir = vec3_t::origin;
+    event.size = 0.0f;
+    event.lifetime = lifetime;
+    GetWorld()->AddEvent(event);
 }
-
@@ -2,6 +2,7 @@
 
 #include "Obj.h"
 #include "Think.h"
+#include "ObjPool.h"
 
 /*
     CGameObj: Serverside game logic
@@ -23,13 +24,14 @@ enum
 class CGameObj :
     public CObj
 {
+    OBJPOOL_DECLARE(CGameObj)
 public:
     CGameObj(CWorld* world);
     virtual ~CGameObj(void);
 
     virtual int GetType() const { return GAME_OBJ_TYPE_OBJ; }
 
-    int GetHealth() { return m_health; }
+    int GetHealth() const { return m_health; }
     void SetHealth(int health) { m_health = health; }
     void AddHealth(int health) { m_health += health; }
 
@@ -45,12 +47,16 @@ public:
 
     CThink m_think; // schedule events for the future
 
+    // One-shot effects: these are events for the clients (see world_event_t),
+    // not objects in the snapshots.
+    void SpawnParticles(const std::string& system, const vec3_t& location,
+                        const vec3_t& dir, const float size, uint32_t lifetime);
     void SpawnParticleBlood(const vec3_t& location, const vec3_t& dir, const float size);
     void SpawnParticleDust(const vec3_t& location, const vec3_t& dir);
     void SpawnParticleRocket(const vec3_t& location, const vec3_t& dir);
     void SpawnParticleExplosion(const vec3_t& location, const float size);
 
-    int CreateSoundObj(const vec3_t& location, const std::string& soundpath, uint32_t lifetime); // id of sound obj
+    void EmitSound(const vec3_t& location, const std::string& soundpath, uint32_t lifetime);
 
 private:
     int m_health;
@@ -32,6 +32,7 @@ CGameObjPlayer::CGameObjPlayer(CWorld* world) : CGameObj(world)
 {
     m_prim_triggered = 0;
     m_prim_triggered_time = 0;
+    m_viewtime = 0;
 
     m_clientid = -1;
     m_weapon_id = GetWeaponInfoByType(WEAPON_NONE);
@@ -141,7 +142,7 @@ void CGameObjPlayer::CmdFire(bool active)
 
 void CGameObjPlayer::FireGun()
 {
-    CGameObj::CreateSoundObj(GetOrigin(),
+    CGameObj::EmitSound(GetOrigin(),
                         CLynx::GetBaseDirSound() + "rifle.ogg",
                         GetWeapon()->firespeed+10);
 
@@ -152,6 +153,7 @@ void CGameObjPlayer::FireGun()
     trace.dir = dir;
     trace.start = GetOrigin();
     trace.excludeobj_id = GetID();
+    trace.rewindtime = m_viewtime;
     if(GetWorld()->TraceObj(&trace, GetWeapon()->maxdist)) // hit something
     {
         if(trace.hitobj) // object hit
@@ -186,7 +188,7 @@ void CGameObjPlayer::FireGun()
 
 void CGameObjPlayer::FireRocket()
 {
-    CreateSoundObj(GetOrigin(),
+    EmitSound(GetOrigin(),
               CLynx::GetBaseDirSound() + "rifle.ogg",
               GetWeapon()->firespeed+10);
 
@@ -30,6 +30,7 @@ public:
     ~CGameObjPlayer(void);
 
     virtual int     GetType() const { return GAME_OBJ_TYPE_PLAYER; }
+    virtual float   GetNetPriority() const { return 2.0f; } // other players matter more than zombies
 
     void            CmdFire(bool active); // Is cmd active?
 
@@ -47,6 +48,9 @@ public:
 
     void            SetLookDir(const quaternion_t& dir) { m_lookdir = dir; }
     quaternion_t    GetLookDir() { return m_lookdir; }
+    // Leveltime of the world the player sees, the gun hits the
+    // objects there (lag compensation). 0: current positions
+    void            SetViewTime(uint32_t viewtime) { m_viewtime = viewtime; }
 
     void            Respawn();
 
@@ -72,6 +76,7 @@ private:
     bool            m_prim_triggered; // if +fire active?
     uint32_t        m_prim_triggered_time;
     quaternion_t    m_lookdir;
+    uint32_t        m_viewtime;
 
     int             m_clientid;
     CGameLogic*     m_gamelogic;
@@ -7,6 +7,8 @@
 #define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
 #endif
 
+OBJPOOL_DEFINE(CGameObjRocket)
+
 CGameObjRocket::CGameObjRocket(CWorld* world) : CGameObj(world)
 {
     SetOwner(0); // someone should take later the ownership
@@ -17,6 +19,7 @@ CGameObjRocket::CGameObjRocket(CWorld* world) : CGameObj(world)
     // remove the rocket after 14 seconds no matter what:
     m_think.AddFunc(new CThinkFuncRemoveMe(GetWorld()->GetLeveltime() + 14000, GetWorld(), this));
     AddFlags(OBJ_FLAGS_NOGRAVITY); // move in a straight line through the world
+    locSetHitsObjs(true); // the world calls OnHitObject, if we hit someone
     // attach a nice smoke trail particle system to the rocket
     SetParticleSystem("rock|" + CParticleSystemRocket::GetConfigString(vec3_t(0.0f, 0.0f, 0.0f)));
 }
@@ -28,16 +31,34 @@ CGameObjRocket::~CGameObjRocket(void)
 
 void CGameObjRocket::OnHitWall(const vec3_t& location, const vec3_t& normal)
 {
-    std::vector<int> objtypes;
-    objtypes.push_back(GAME_OBJ_TYPE_PLAYER);
-    objtypes.push_back(GAME_OBJ_TYPE_ZOMBIE);
+    Explode(location);
+}
+
+void CGameObjRocket::OnHitObject(const vec3_t& location, CObj* hitobj)
+{
+    Explode(location);
+}
+
+bool CGameObjRocket::CanHitObj(const CObj* obj) const
+{
+    return obj->GetType() == GAME_OBJ_TYPE_PLAYER ||
+           obj->GetType() == GAME_OBJ_TYPE_ZOMBIE;
+}
+
+void CGameObjRocket::Explode(const vec3_t& location)
+{
+    // as a rocket is dealing splash damage, we need to include
+    // objects in a larger radius
+    static const int objtypes[] = {GAME_OBJ_TYPE_PLAYER, GAME_OBJ_TYPE_ZOMBIE};
 
     const float splashradius = GetSplashDamageRadius();
-    const std::vector<CObj*> splashobjlist =
-        GetWorld()->GetNearObjByTypeList(location,
-                                         splashradius,
-                                         GetID(),
-                                         objtypes);
+    world_objlist_t splashobjlist(GetWorld()->GetFrameArena());
+    GetWorld()->GetNearObjByTypeList(location,
+                                     splashradius,
+                                     GetID(),
+                                     objtypes,
+                                     sizeof(objtypes)/sizeof(objtypes[0]),
+                                     &splashobjlist);
     DealDamageToNearbyObjs(splashobjlist);
 
     DestroyRocket(location);
@@ -55,12 +76,12 @@ void CGameObjRocket::DestroyRocket(const vec3_t& location)
     m_think.RemoveAll(); // remove the safety delete thinkfunc, which might interrupt our fadeout
     m_think.AddFunc(new CThinkFuncRemoveMe(GetWorld()->GetLeveltime() + 800, GetWorld(), this));
 
-    CreateSoundObj(location,
+    EmitSound(location,
               CLynx::GetBaseDirSound() + "rifle.ogg",
               800);
 }
 
-void CGameObjRocket::DealDamageToNearbyObjs(const std::vector<CObj*>& nearobjs)
+void CGameObjRocket::DealDamageToNearbyObjs(const world_objlist_t& nearobjs)
 {
     bool killed_me;
     float damage;
@@ -90,7 +111,7 @@ void CGameObjRocket::DealDamageToNearbyObjs(const std::vector<CObj*>& nearobjs)
     }
 
     // for every hit object:
-    for(std::vector<CObj*>::const_iterator hititer =
+    for(world_objlist_t::const_iterator hititer =
             nearobjs.begin();
             hititer != nearobjs.end();
             hititer++)
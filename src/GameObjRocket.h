@@ -4,14 +4,19 @@
 class CGameObjRocket :
     public CGameObj
 {
+    OBJPOOL_DECLARE(CGameObjRocket)
 public:
     CGameObjRocket(CWorld* world);
     ~CGameObjRocket(void);
 
     virtual int      GetType() const { return GAME_OBJ_TYPE_ROCKET; }
+    virtual float    GetNetPriority() const { return 2.0f; } // fast and short lived
 
     // Wallhit notification
     virtual void     OnHitWall(const vec3_t& location, const vec3_t& normal);
+    // A player or a monster is in the way
+    virtual void     OnHitObject(const vec3_t& location, CObj* hitobj);
+    virtual bool     CanHitObj(const CObj* obj) const;
 
     // Rocket speed
     static float     GetRocketSpeed() { return 35.0f; } // m/s
@@ -19,7 +24,7 @@ public:
     static float     GetDamage() { return 80.0f; } // base value for splash damage
 
     // Deal damage to all objects in the nearobjs list
-    void             DealDamageToNearbyObjs(const std::vector<CObj*>& nearobjs);
+    void             DealDamageToNearbyObjs(const world_objlist_t& nearobjs);
 
     // which player fired this rocket?
     void             SetOwner(int objid) { m_owner = objid; }
@@ -27,6 +32,8 @@ public:
 
     void             DestroyRocket(const vec3_t& location);
 protected:
+    void             Explode(const vec3_t& location); // splash damage and DestroyRocket
+
     int m_owner;
 };
 
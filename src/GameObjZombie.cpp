@@ -23,6 +23,33 @@ static const monster_t g_monster_table[] =
 };
 static const int g_monster_table_size = sizeof(g_monster_table)/sizeof(g_monster_table[0]);
 
+OBJPOOL_DEFINE(CGameObjZombie)
+OBJPOOL_DEFINE(CThinkFuncZombie)
+
+// Random numbers for the AI. rand() is not thread safe and the order of
+// the calls would depend on the threads. This way a zombie gets the same
+// numbers at the same leveltime, no matter which thread does the work.
+static uint32_t ZombieRandSeed(int objid, uint32_t leveltime)
+{
+    uint32_t x = (uint32_t)objid*0x9E3779B1u ^ leveltime*0x85EBCA6Bu;
+    x ^= x >> 16; // murmur3 finalizer
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x ? x : 1; // xorshift gets stuck at 0
+}
+
+static uint32_t ZombieRand(uint32_t* state) // xorshift32
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
 CGameObjZombie::CGameObjZombie(CWorld* world) : CGameObj(world)
 {
     int monsterindex = rand()%g_monster_table_size;
@@ -30,7 +57,9 @@ CGameObjZombie::CGameObjZombie(CWorld* world) : CGameObj(world)
     SetResource(CLynx::GetBaseDirModel() + g_monster_table[monsterindex].modelpath);
     SetHealth(g_monster_table[monsterindex].basehealth);
     SetAnimation(ANIMATION_IDLE);
-    m_think.AddFunc(new CThinkFuncZombie(GetWorld()->GetLeveltime() + 50, GetWorld(), this));
+    m_aithink = new CThinkFuncZombie(GetWorld()->GetLeveltime() + 50, GetWorld(), this);
+    m_think.AddFunc(m_aithink);
+    m_ailod = ZOMBIE_AI_LOD_NEAR;
     currenttarget = -1;
 }
 
@@ -61,7 +90,7 @@ void CGameObjZombie::DealDamage(int damage,
         SpawnParticleBlood(hitpoint, dir, 4.0f);
         if(CLynx::randfabs() < 0.70f)
         {
-            CreateSoundObj(GetOrigin(),
+            EmitSound(GetOrigin(),
                       CLynx::GetBaseDirSound() + CLynx::GetRandNumInStr("monsterhit%i.ogg", 3),
                       180);
         }
@@ -75,6 +104,7 @@ void CGameObjZombie::DealDamage(int damage,
     }
     SetVel(dir.Normalized()*35.0f + vec3_t(0, 20.0f, 0)); // kick zombie back and a bit up
     AddFlags(OBJ_FLAGS_ELASTIC); // abuse this flag to mark zombie as dead
+    m_aithink = NULL;
     m_think.RemoveAll();
     m_think.AddFunc(new CThinkFuncRespawnZombie(
                     GetWorld()->GetLeveltime() + 500, // respawn time
@@ -82,27 +112,44 @@ void CGameObjZombie::DealDamage(int damage,
                     this));
     if(CLynx::randfabs() < 0.88f) // 88% change of sound playing
     {
-        CreateSoundObj(hitpoint, CLynx::GetBaseDirSound() + "monsterdie.ogg", 250);
+        EmitSound(hitpoint, CLynx::GetBaseDirSound() + "monsterdie.ogg", 250);
     }
 }
 
-void CGameObjZombie::FindVictim()
+int CGameObjZombie::FindVictim(uint32_t* randstate) const
 {
-    CObj* victim;
-    const std::vector<CObj*> objlist =
-        GetWorld()->GetNearObj(GetOrigin(), 50.0f, GetID(), GAME_OBJ_TYPE_PLAYER);
-    if(objlist.size() > 0)
+    // GetNearObj uses the frame arena, that is not thread safe
+    std::vector<CObj*> candidates;
+    int victim = -1;
+    uint32_t victimcount = 0;
+    const float radius2 = ZOMBIE_VICTIM_RADIUS*ZOMBIE_VICTIM_RADIUS;
+    CObj* obj;
+    size_t i;
+
+    GetWorld()->GetNearObjCandidates(GetOrigin(), ZOMBIE_VICTIM_RADIUS, candidates);
+    for(i=0;i<candidates.size();i++)
     {
-        int randid = rand()%(objlist.size());
-        victim = objlist[randid];
-        currenttarget = victim->GetID();
-        if(CLynx::randfabs() < 0.8f) // 80% change of sound playing
-        {
-            CreateSoundObj(GetOrigin(),
-                      CLynx::GetBaseDirSound() + CLynx::GetRandNumInStr("monsterstartle%i.ogg", 3),
-                      250);
-        }
+        obj = candidates[i];
+        if(obj->GetType() != GAME_OBJ_TYPE_PLAYER || obj->GetID() == GetID() ||
+           (obj->GetFlags() & OBJ_FLAGS_GHOST))
+            continue;
+        if((obj->GetOrigin() - GetOrigin()).AbsSquared() >= radius2)
+            continue;
+        victimcount++;
+        if(ZombieRand(randstate)%victimcount == 0) // every victim has the same chance
+            victim = obj->GetID();
     }
+    return victim;
+}
+
+void CGameObjZombie::SetAILod(int lod)
+{
+    const uint32_t leveltime = GetWorld()->GetLeveltime();
+
+    assert(lod >= 0 && lod < ZOMBIE_AI_LOD_COUNT);
+    if(lod < m_ailod && m_aithink && m_aithink->GetThinktime() > leveltime)
+        m_aithink->SetThinktime(leveltime);
+    m_ailod = lod;
 }
 
 bool CThinkFuncRespawnZombie::DoThink(uint32_t leveltime)
@@ -120,45 +167,98 @@ bool CThinkFuncRespawnZombie::DoThink(uint32_t leveltime)
     return true;
 }
 
-bool CThinkFuncZombie::DoThink(uint32_t leveltime)
+// Think interval in ms for every AI LOD: base + rand()%random
+struct zombie_think_interval_t
 {
-    CGameObjZombie* zombie = (CGameObjZombie*)GetObj();
-    if(zombie->GetHealth() < 1)
-        return true;
+    uint32_t chasebase, chaserandom; // zombie has a target
+    uint32_t idlebase, idlerandom; // no target
+};
 
-    int currenttarget = zombie->currenttarget;
-    CGameObj* target = (CGameObj*)GetWorld()->GetObj(currenttarget);
+static const zombie_think_interval_t g_zombie_think_interval[ZOMBIE_AI_LOD_COUNT] =
+{
+    {  50,  100,  400,  400}, // near
+    { 200,  200, 1000, 1000}, // mid
+    {1000, 1000, 2000, 2000}  // far
+};
+
+void CThinkFuncZombie::Calc(uint32_t leveltime)
+{
+    const CGameObjZombie* zombie = (const CGameObjZombie*)GetObj();
+    uint32_t randstate = ZombieRandSeed(zombie->GetID(), leveltime);
+
+    m_dead = zombie->GetHealth() < 1;
+    m_chase = false;
+    m_startled = false;
+    m_target = zombie->currenttarget;
+    if(m_dead)
+        return;
+
+    const int lod = zombie->GetAILod();
+    const zombie_think_interval_t& interval = g_zombie_think_interval[lod];
+    const CGameObj* target = (const CGameObj*)GetWorld()->GetObj(m_target);
     if(target == NULL)
     {
-        zombie->FindVictim();
-        SetThinktime(leveltime + 400 + rand()%400);
-        zombie->SetVel(vec3_t::origin);
-        return false;
+        // Only a near zombie can have a player within the
+        // victim radius, don't waste time on the others.
+        if(lod == ZOMBIE_AI_LOD_NEAR)
+        {
+            m_target = zombie->FindVictim(&randstate);
+            m_startled = m_target >= 0 && ZombieRand(&randstate)%10000 < 8000; // 80% change of sound playing
+        }
+        m_nextthink = leveltime + interval.idlebase + ZombieRand(&randstate)%interval.idlerandom;
+        m_vel = vec3_t::origin;
+        return;
     }
 
-    vec3_t dir = target->GetOrigin() - GetObj()->GetOrigin();
+    vec3_t dir = target->GetOrigin() - zombie->GetOrigin();
 
-    SetThinktime(leveltime + 50+rand()%100);
+    m_chase = true;
+    m_nextthink = leveltime + interval.chasebase + ZombieRand(&randstate)%interval.chaserandom;
     quaternion_t qTo = zombie->TurnTo(target->GetOrigin());
-    quaternion_t qFrom = zombie->GetRot();
 
-    zombie->SetRot(quaternion_t(qFrom, qTo, 0.5f));
+    if(lod == ZOMBIE_AI_LOD_NEAR) // turn smoothly, if someone can see it
+        m_rot = quaternion_t(zombie->GetRot(), qTo, 0.5f);
+    else
+        m_rot = qTo;
 
     if(dir.AbsSquared() > 42.0f)
     {
-        zombie->GetRot().GetVec3(&dir, NULL, NULL);
+        m_rot.GetVec3(&dir, NULL, NULL);
 
-        vec3_t targetvel = dir*-10.0f;
-        targetvel.y = zombie->GetVel().y; // preserve gravity
-        zombie->SetVel(targetvel);
-        zombie->SetAnimation(ANIMATION_RUN);
+        m_vel = dir*-10.0f;
+        m_vel.y = zombie->GetVel().y; // preserve gravity
+        m_animation = ANIMATION_RUN;
     }
     else
     {
-        zombie->SetVel(vec3_t::origin);
-        zombie->SetAnimation(ANIMATION_ATTACK);
+        m_vel = vec3_t::origin;
+        m_animation = ANIMATION_ATTACK;
     }
+}
+
+bool CThinkFuncZombie::DoThink(uint32_t leveltime)
+{
+    CGameObjZombie* zombie = (CGameObjZombie*)GetObj();
+    if(m_dead)
+    {
+        zombie->m_aithink = NULL;
+        return true;
+    }
+
+    zombie->currenttarget = m_target;
+    if(m_startled)
+    {
+        zombie->EmitSound(zombie->GetOrigin(),
+                  CLynx::GetBaseDirSound() + CLynx::GetRandNumInStr("monsterstartle%i.ogg", 3),
+                  250);
+    }
+    if(m_chase)
+    {
+        zombie->SetRot(m_rot);
+        zombie->SetAnimation(m_animation);
+    }
+    zombie->SetVel(m_vel);
+    SetThinktime(m_nextthink);
 
     return false;
 }
-
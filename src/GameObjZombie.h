@@ -1,9 +1,26 @@
 #pragma once
 #include "GameObj.h"
 
+// AI level of detail: zombies far away from every
+// player think less often and do less work.
+enum
+{
+    ZOMBIE_AI_LOD_NEAR = 0, // a player could be in reach: full AI
+    ZOMBIE_AI_LOD_MID,      // slower thinking, no victim search
+    ZOMBIE_AI_LOD_FAR,      // rare thinking, no crowd separation
+    ZOMBIE_AI_LOD_COUNT
+};
+
+#define ZOMBIE_VICTIM_RADIUS        50.0f // FindVictim search radius
+#define ZOMBIE_AI_LOD_NEAR_DIST     (ZOMBIE_VICTIM_RADIUS + 10.0f)
+#define ZOMBIE_AI_LOD_MID_DIST      150.0f
+
+class CThinkFuncZombie;
+
 class CGameObjZombie :
     public CGameObj
 {
+    OBJPOOL_DECLARE(CGameObjZombie)
 public:
     CGameObjZombie(CWorld* world);
     ~CGameObjZombie(void);
@@ -18,8 +35,21 @@ public:
                                CGameObj* dealer,
                                bool& killed_me);
 
-    void            FindVictim();
+    // Id of a random player within ZOMBIE_VICTIM_RADIUS or -1.
+    // Does not change anything, safe to call from a think Calc phase.
+    int             FindVictim(uint32_t* randstate) const;
     int             currenttarget;
+
+    // Set by the game, based on the distance to the nearest player.
+    // A zombie that comes closer to a player thinks right away.
+    int             GetAILod() const { return m_ailod; }
+    void            SetAILod(int lod);
+
+private:
+    int             m_ailod;
+    CThinkFuncZombie* m_aithink; // owned by m_think, NULL if the zombie is dead
+
+    friend class CThinkFuncZombie;
 };
 
 class CThinkFuncRespawnZombie : public CThinkFunc
@@ -30,10 +60,25 @@ public:
     virtual bool DoThink(uint32_t leveltime);
 };
 
+// The AI decision is made in Calc (in parallel for every zombie,
+// see Think.h), DoThink applies it to the zombie.
 class CThinkFuncZombie : public CThinkFunc
 {
+    OBJPOOL_DECLARE(CThinkFuncZombie) // too large for the CThinkFunc pool
 public:
     CThinkFuncZombie(uint32_t time, CWorld* world, CObj* obj) :
       CThinkFunc(time, world, obj) {}
+    virtual void Calc(uint32_t leveltime);
     virtual bool DoThink(uint32_t leveltime);
+
+private:
+    // Result of Calc
+    bool            m_dead;
+    bool            m_chase; // m_rot and m_animation are valid
+    bool            m_startled; // found a new victim, play a sound
+    int             m_target;
+    uint32_t        m_nextthink;
+    vec3_t          m_vel;
+    quaternion_t    m_rot;
+    animation_t     m_animation;
 };
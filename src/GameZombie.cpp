@@ -1,17 +1,20 @@
 #include <assert.h>
 #include <stdio.h>
+#include <algorithm> // min
 #include "GameZombie.h"
 #include "GameObjZombie.h"
-#include "GameObjRocket.h"
 
 #ifdef _DEBUG
 #include <crtdbg.h>
 #define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
 #endif
 
+#define THINK_BUDGET        5000 // default sv_thinkbudget in us
+
 CGameZombie::CGameZombie(CWorld* world, CServer* server) : CGameLogic(world, server)
 {
-
+    m_thinkbudget = CLynx::cfg.GetVarAsInt("sv_thinkbudget", THINK_BUDGET, true);
+    m_lagcomp = CLynx::cfg.GetVarAsInt("sv_lagcomp", LAGCOMP_MAX_TIME, true);
 }
 
 CGameZombie::~CGameZombie(void)
@@ -110,6 +113,7 @@ void CGameZombie::Notify(EventNewClientConnected e)
     player->SetResource(CLynx::GetBaseDirModel() + "marine/marine.md5mesh");
     player->SetRadius(2.0f);
     player->SetAnimation(ANIMATION_IDLE);
+    player->locSetIsControlled(true); // moved by ProcessClientCmds
 
     GetWorld()->AddObj(player, true); // set this argument to true, so that we are directly in the next serialize message
     e.client->m_obj = player->GetID(); // Link this object with the client
@@ -136,9 +140,9 @@ void CGameZombie::Notify(EventClientDisconnected e)
 void CGameZombie::Update(const float dt, const uint32_t ticks)
 {
     CGameObj* obj;
-    OBJITER iter;
     CClientInfo* client;
     bool thinktick;
+    int i;
     static uint32_t oldtime = 0;
 
     if(ticks - oldtime > THINK_INTERVAL)
@@ -151,14 +155,35 @@ void CGameZombie::Update(const float dt, const uint32_t ticks)
         thinktick = false;
     }
 
-    for(iter = GetWorld()->ObjBegin();iter!=GetWorld()->ObjEnd();iter++)
+    // Objects added with AddObj(obj, true) in this function are
+    // appended to the object list, they are updated in the next frame.
+    const int objcount = GetWorld()->GetObjCount();
+
+    // 1) Think functions, only the due ones are touched.
+    // The zombie AI is calculated on every core (see Think.h).
+    // If there are too many, the rest has to wait for the next frame.
+    GetWorld()->GetThinkScheduler()->Run(GetWorld()->GetLeveltime(), m_thinkbudget, &m_jobs);
+
+    // 2) Movement and collision detection with the level, on every core.
+    // The players are moved by the commands of their clients in 3).
+    GetWorld()->ObjMoveAll(dt, &m_jobs);
+
+    // 3) Game logic
+    if(thinktick) // player positions for the AI LOD
     {
-        obj = (CGameObj*)(*iter).second;
+        m_playerorigins.clear();
+        for(i=0;i<objcount;i++)
+        {
+            obj = (CGameObj*)GetWorld()->GetObjByIndex(i);
+            if(obj->GetType() == GAME_OBJ_TYPE_PLAYER)
+                m_playerorigins.push_back(obj->GetOrigin());
+        }
+    }
 
-        if(thinktick)
-            obj->m_think.DoThink(GetWorld()->GetLeveltime());
+    for(i=0;i<objcount;i++)
+    {
+        obj = (CGameObj*)GetWorld()->GetObjByIndex(i);
 
-        GetWorld()->ObjMove(obj, dt);
         if(obj->GetOrigin().y < -500.0f)
         {
             fprintf(stderr, "GameZombie: obj in free fall (on ground: %s) obj id: %i res: %s\n",
@@ -169,7 +194,7 @@ void CGameZombie::Update(const float dt, const uint32_t ticks)
             // zero velocity there.
             bspbin_spawn_t point = GetWorld()->GetBSP()->GetRandomSpawnPoint();
             obj->Respawn(point.point, point.rot);
-            return;
+            continue;
         }
 
         if(obj->GetType() == GAME_OBJ_TYPE_PLAYER)
@@ -183,7 +208,7 @@ void CGameZombie::Update(const float dt, const uint32_t ticks)
             client = ((CGameObjPlayer*)obj)->GetClient();
             if(client) // safety check: maybe the object is associated with an invalid client id
             {
-                ProcessClientCmds((CGameObjPlayer*)obj, client);
+                ProcessClientCmds((CGameObjPlayer*)obj, client, dt);
                 ClientMouse(obj, client->lat, client->lon);
 
                 // Calculate real view direction of the player.
@@ -194,101 +219,128 @@ void CGameZombie::Update(const float dt, const uint32_t ticks)
                 ((CGameObjPlayer*)obj)->SetLookDir(qlon*qlat);
             }
         }
-        else if(obj->GetType() == GAME_OBJ_TYPE_ZOMBIE && thinktick) // this if-condition branch applies a force to every other zombie.
-        {   // FIXME: O(n^2) complexity - bad?
-            OBJITER iter2;
-            CGameObj* obj2;
-            // FIXME use GameNearObj function?
-            // FIXME this code sucks
-            // FIXME FIXME FIXME
-            for(iter2 = GetWorld()->ObjBegin();iter2!=GetWorld()->ObjEnd();iter2++)
-            {
-                obj2 = (CGameObj*)(*iter2).second;
-                if(obj2 == obj || obj2->GetType() != GAME_OBJ_TYPE_ZOMBIE)
-                    continue;
-                if(obj2->GetHealth() <= 0) // don't push dead bodies
-                    continue;
-
-                const float savey = obj2->GetVel().y;
-                const float force = 175.0f; // not really a force, where f = ma
-                vec3_t diff(obj2->GetOrigin() - obj->GetOrigin());
-                float difflen = diff.AbsFast();
-                if(difflen > (obj2->GetRadius()+obj->GetRadius()))
-                    continue;
-                difflen = lynxmath::SqrtFast(difflen); // sqrtfast is ok here
-                if(difflen < 0.75f)
-                    difflen = 0.75f;
-                diff.y = 0.0f;
-                diff = dt*diff*force*1/(difflen*difflen);
-                diff += obj2->GetVel();
-                if(diff.AbsSquared()>25.0f)
-                    diff.SetLength(5.0f);
-                diff.y = savey;
-                obj2->SetVel(diff);
-            }
-        }
-        else if(obj->GetType() == GAME_OBJ_TYPE_ROCKET &&
-                !(obj->GetFlags()&OBJ_FLAGS_GHOST))
+        else if(obj->GetType() == GAME_OBJ_TYPE_ZOMBIE && thinktick)
         {
-            // rockets are ghosts for a few seconds after the impact, to fade
-            // out the rocket trail. ignore them as ghost objects.
-
-            // FIXME: is this really something the game logic has to
-            // take care of every frame? there should be an event callback
-            // similar to the level geometry collision callback.
-
-            // Check if the rocket is near a player or a monster.
-            // if yes, explode and deal damage
-            std::vector<int> objtypes;
-            objtypes.push_back(GAME_OBJ_TYPE_PLAYER);
-            objtypes.push_back(GAME_OBJ_TYPE_ZOMBIE);
-            const std::vector<CObj*> nearobjlist =
-                GetWorld()->GetNearObjByTypeList(obj->GetOrigin(),
-                                                 obj->GetRadius(),
-                                                 obj->GetID(),
-                                                 objtypes);
-            if(nearobjlist.size() > 0) // we have hit something
-            {
-                // as a rocket is dealing splash damage, we need to include
-                // objects in a larger radius
-                const float splashradius = ((CGameObjRocket*)obj)->GetSplashDamageRadius();
-                const std::vector<CObj*> splashobjlist =
-                    GetWorld()->GetNearObjByTypeList(obj->GetOrigin(),
-                                                     splashradius,
-                                                     obj->GetID(),
-                                                     objtypes);
-                assert(nearobjlist.size() > 0);
-                ((CGameObjRocket*)obj)->DealDamageToNearbyObjs(splashobjlist);
-                ((CGameObjRocket*)obj)->DestroyRocket(obj->GetOrigin());
-            }
+            UpdateAILod((CGameObjZombie*)obj);
+
+            // this zombie applies a force to every zombie nearby.
+            // no one can see, if far away zombies overlap.
+            if(((CGameObjZombie*)obj)->GetAILod() != ZOMBIE_AI_LOD_FAR)
+                PushNeighbours(obj, dt);
         }
     }
 }
 
-void CGameZombie::ProcessClientCmds(CGameObjPlayer* clientobj, CClientInfo* client)
+void CGameZombie::UpdateAILod(CGameObjZombie* zombie)
 {
-    bool bFire = false;
+    float mindist = ZOMBIE_AI_LOD_MID_DIST*ZOMBIE_AI_LOD_MID_DIST; // squared
+    float dist;
+    size_t i;
 
-    std::vector<std::string>::iterator iter;
-    for(iter = client->clcmdlist.begin();iter != client->clcmdlist.end();iter++)
+    for(i=0;i<m_playerorigins.size();i++)
     {
-        if((*iter) == "+fire")
-        {
-            bFire = true;
-        }
-        else if((*iter) == "w_rocket")
-        {
+        dist = (m_playerorigins[i] - zombie->GetOrigin()).AbsSquared();
+        if(dist < mindist)
+            mindist = dist;
+    }
+
+    if(mindist < ZOMBIE_AI_LOD_NEAR_DIST*ZOMBIE_AI_LOD_NEAR_DIST)
+        zombie->SetAILod(ZOMBIE_AI_LOD_NEAR);
+    else if(mindist < ZOMBIE_AI_LOD_MID_DIST*ZOMBIE_AI_LOD_MID_DIST)
+        zombie->SetAILod(ZOMBIE_AI_LOD_MID);
+    else
+        zombie->SetAILod(ZOMBIE_AI_LOD_FAR);
+}
+
+void CGameZombie::PushNeighbours(CGameObj* obj, const float dt)
+{
+    const float force = 175.0f; // not really a force, where f = ma
+    CGameObj* obj2;
+    size_t i;
+
+    // Build the neighbour list for this zombie: only zombies, that
+    // overlap with the zombie (radius sum) are affected.
+    // AbsFast is an approximation, so we search a bit further.
+    m_crowdcandidates.clear();
+    m_crowdneighbours.clear();
+    GetWorld()->GetNearObjCandidates(obj->GetOrigin(),
+                                     obj->GetRadius()*1.05f,
+                                     m_crowdcandidates);
+    for(i=0;i<m_crowdcandidates.size();i++)
+    {
+        obj2 = (CGameObj*)m_crowdcandidates[i];
+        if(obj2 == obj || obj2->GetType() != GAME_OBJ_TYPE_ZOMBIE)
+            continue;
+        if(obj2->GetHealth() <= 0) // don't push dead bodies
+            continue;
+        if((obj2->GetOrigin() - obj->GetOrigin()).AbsFast() > (obj2->GetRadius()+obj->GetRadius()))
+            continue;
+        m_crowdneighbours.push_back(obj2);
+    }
+
+    for(i=0;i<m_crowdneighbours.size();i++)
+    {
+        obj2 = m_crowdneighbours[i];
+
+        const float savey = obj2->GetVel().y;
+        vec3_t diff(obj2->GetOrigin() - obj->GetOrigin());
+        float difflen = diff.AbsFast();
+        difflen = lynxmath::SqrtFast(difflen); // sqrtfast is ok here
+        if(difflen < 0.75f)
+            difflen = 0.75f;
+        diff.y = 0.0f;
+        diff = dt*diff*force*1/(difflen*difflen);
+        diff += obj2->GetVel();
+        if(diff.AbsSquared()>25.0f)
+            diff.SetLength(5.0f);
+        diff.y = savey;
+        obj2->SetVel(diff);
+    }
+}
+
+void CGameZombie::ProcessClientCmds(CGameObjPlayer* clientobj, CClientInfo* client, const float dt)
+{
+    client->movetime = std::min(client->movetime + dt, USERCMD_MAX_MOVETIME);
+
+    const std::vector<usercmd_t>& cmds = client->usercmds.GetPending();
+    if(cmds.size() == 0) // nothing new from the client in this frame
+    {
+        clientobj->CmdFire(false);
+        return;
+    }
+
+    // Every command in order: a shot from a lost packet is fired
+    // with the view direction of its command. The player moves with
+    // the same code as the client prediction, the last command is
+    // sent back to the client (see CServer::SendWorldToClient).
+    for(size_t i=0;i<cmds.size();i++)
+    {
+        usercmd_t cmd = cmds[i];
+        const float movetime = std::min((float)cmd.msec*0.001f, client->movetime);
+        client->movetime -= movetime;
+        cmd.msec = (uint32_t)(movetime*1000.0f + 0.5f);
+        ClientCmdMove(clientobj, cmd);
+        client->usercmdack = cmd.seq;
+
+        if(cmd.buttons & USERCMD_ROCKET)
             clientobj->ActivateRocket();
-        }
-        else if((*iter) == "w_gun")
-        {
+        if(cmd.buttons & USERCMD_GUN)
             clientobj->ActivateGun();
-        }
 
+        client->lat = cmd.lat;
+        client->lon = cmd.lon;
+        const quaternion_t qlat(vec3_t::xAxis, cmd.lat*lynxmath::DEGTORAD);
+        const quaternion_t qlon(vec3_t::yAxis, cmd.lon*lynxmath::DEGTORAD);
+        clientobj->SetLookDir(qlon*qlat);
+        // the client can't shoot further into the past than sv_lagcomp
+        const uint32_t now = GetWorld()->GetLeveltime();
+        if(m_lagcomp > 0 && cmd.viewtime > 0 && cmd.viewtime <= now)
+            clientobj->SetViewTime(std::max(cmd.viewtime, now - std::min(now, m_lagcomp)));
+        else
+            clientobj->SetViewTime(0);
+        clientobj->CmdFire((cmd.buttons & USERCMD_FIRE) != 0);
     }
 
-    clientobj->CmdFire(bFire);
-
-    client->clcmdlist.clear();
+    client->usercmds.ClearPending();
 }
 
@@ -3,6 +3,8 @@
 #include "GameLogic.h"
 #include "GameObj.h"
 #include "GameObjPlayer.h"
+#include "GameObjZombie.h"
+#include "JobSystem.h"
 
 class CGameZombie : public CGameLogic
 {
@@ -20,5 +22,21 @@ protected:
     virtual void Notify(EventNewClientConnected);
     virtual void Notify(EventClientDisconnected);
 
-    virtual void ProcessClientCmds(CGameObjPlayer* clientobj, CClientInfo* client);
+    // Move the player with the new user commands of its client. dt: time since
+    // the last call, the client can't move for longer (speed hack).
+    virtual void ProcessClientCmds(CGameObjPlayer* clientobj, CClientInfo* client, const float dt);
+
+    // Crowd separation: push zombies, that are too close to obj, away.
+    void PushNeighbours(CGameObj* obj, const float dt);
+    std::vector<CObj*> m_crowdcandidates; // broadphase result, reused every call
+    std::vector<CGameObj*> m_crowdneighbours; // zombies touching the current zombie
+
+    // AI level of detail, see GameObjZombie.h
+    void UpdateAILod(CGameObjZombie* zombie);
+    std::vector<vec3_t> m_playerorigins; // collected every think interval
+
+    uint32_t m_thinkbudget; // max. time in us for think functions per frame (sv_thinkbudget)
+    uint32_t m_lagcomp; // max. rewind time in ms for the player shots (sv_lagcomp, 0: off)
+
+    CJobSystem m_jobs; // for the think functions and CWorld::ObjMoveAll
 };
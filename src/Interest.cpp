@@ -0,0 +1,176 @@
+#include <assert.h>
+#include <algorithm> // sort, unique, lower_bound, remove_if
+#include "Interest.h"
+#include "World.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+static bool InterestObjLess(const interest_obj_t& a, const interest_obj_t& b)
+{
+    return a.id < b.id;
+}
+
+static bool InterestObjSameID(const interest_obj_t& a, const interest_obj_t& b)
+{
+    return a.id == b.id;
+}
+
+static const interest_obj_t* FindInterestObj(const std::vector<interest_obj_t>& objs, int id)
+{
+    interest_obj_t key;
+    key.id = id;
+    std::vector<interest_obj_t>::const_iterator iter = std::lower_bound(objs.begin(), objs.end(), key, InterestObjLess);
+    if(iter == objs.end() || iter->id != id)
+        return NULL;
+    return &(*iter);
+}
+
+// remove_if predicate for the left list
+struct interest_left_older_t
+{
+    uint32_t worldid;
+    bool operator()(const interest_left_t& left) const { return left.left <= worldid; }
+};
+
+CInterestSet::CInterestSet()
+{
+    m_near = INTEREST_NEAR_RADIUS;
+    m_far = INTEREST_FAR_RADIUS;
+    m_linger = INTEREST_LINGER;
+    m_tracecount = 0;
+}
+
+CInterestSet::~CInterestSet()
+{
+}
+
+void CInterestSet::SetRange(const float nearradius, const float farradius, const uint32_t linger)
+{
+    m_near = nearradius;
+    m_far = std::max(nearradius, farradius);
+    m_linger = linger;
+}
+
+void CInterestSet::Clear()
+{
+    m_objs.clear();
+    m_left.clear();
+}
+
+bool CInterestSet::IsRelevant(const CWorld* world, const CObj* obj, const vec3_t& eye)
+{
+    const float distsqr = (obj->GetOrigin() - eye).AbsSquared();
+    if(distsqr <= m_near*m_near)
+        return true;
+    if(distsqr > m_far*m_far || (obj->GetFlags() & OBJ_FLAGS_GHOST))
+        return false;
+    m_tracecount++;
+    return world->IsLineOfSight(eye, obj->GetOrigin());
+}
+
+void CInterestSet::Update(const CWorld* world, const CObj* viewer, uint32_t oldestbaseline)
+{
+    const uint32_t worldid = world->GetWorldID();
+    const uint32_t leveltime = world->GetLeveltime();
+    const interest_obj_t* old;
+    interest_obj_t entry;
+    size_t i;
+
+    m_tracecount = 0;
+    m_next.clear();
+    entry.entered = 0;
+    entry.lastseen = leveltime;
+
+    if(!viewer) // no player object: everything
+    {
+        const std::vector<int>& ids = world->GetObjStore()->GetIDArray();
+        for(i=0;i<ids.size();i++)
+        {
+            entry.id = ids[i];
+            m_next.push_back(entry);
+        }
+    }
+    else
+    {
+        const vec3_t& eye = viewer->GetOrigin();
+        m_candidates.clear();
+        world->GetNearObjCandidates(eye, m_far, m_candidates);
+        for(i=0;i<m_candidates.size();i++)
+        {
+            const CObj* obj = m_candidates[i];
+            entry.id = obj->GetID();
+            old = FindInterestObj(m_objs, entry.id);
+            // visible objects are checked again after half the linger time
+            if(old && leveltime - old->lastseen < m_linger/2)
+            {
+                m_next.push_back(*old);
+                continue;
+            }
+            // not in the set: test a part of them in every snapshot
+            if(!old && obj != viewer && ((uint32_t)entry.id + worldid) % INTEREST_RETEST != 0 &&
+               (obj->GetOrigin() - eye).AbsSquared() > m_near*m_near)
+                continue;
+            if(obj == viewer || IsRelevant(world, obj, eye))
+                m_next.push_back(entry);
+            else if(old && leveltime - old->lastseen < m_linger)
+                m_next.push_back(*old);
+        }
+        std::sort(m_next.begin(), m_next.end(), InterestObjLess);
+
+        // Objects out of the far radius linger as well
+        const size_t count = m_next.size();
+        for(i=0;i<m_objs.size();i++)
+        {
+            if(leveltime - m_objs[i].lastseen >= m_linger ||
+               !world->GetObj(m_objs[i].id) ||
+               std::binary_search(m_next.begin(), m_next.begin() + count, m_objs[i], InterestObjLess))
+                continue;
+            m_next.push_back(m_objs[i]);
+        }
+    }
+    std::sort(m_next.begin(), m_next.end(), InterestObjLess);
+    m_next.erase(std::unique(m_next.begin(), m_next.end(), InterestObjSameID), m_next.end());
+
+    // Merge with the old set: keep the entered worldid of the objects
+    // that stay, remember the objects that left.
+    std::vector<interest_obj_t>::iterator olditer = m_objs.begin();
+    std::vector<interest_obj_t>::iterator newiter = m_next.begin();
+    while(olditer != m_objs.end() || newiter != m_next.end())
+    {
+        if(newiter == m_next.end() || (olditer != m_objs.end() && olditer->id < newiter->id))
+        {
+            interest_left_t left;
+            left.id = olditer->id;
+            left.entered = olditer->entered;
+            left.left = worldid;
+            m_left.push_back(left);
+            ++olditer;
+        }
+        else if(olditer == m_objs.end() || newiter->id < olditer->id)
+        {
+            newiter->entered = worldid;
+            ++newiter;
+        }
+        else
+        {
+            newiter->entered = olditer->entered;
+            ++olditer;
+            ++newiter;
+        }
+    }
+    m_objs.swap(m_next);
+
+    // The client has a newer baseline than these
+    interest_left_older_t older;
+    older.worldid = oldestbaseline;
+    m_left.erase(std::remove_if(m_left.begin(), m_left.end(), older), m_left.end());
+}
+
+uint32_t CInterestSet::GetEntered(int id) const
+{
+    const interest_obj_t* obj = FindInterestObj(m_objs, id);
+    return obj ? obj->entered : 0;
+}
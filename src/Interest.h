@@ -0,0 +1,84 @@
+#pragma once
+
+#include "lynx.h"
+#include "math/vec3.h"
+#include <vector>
+
+class CWorld;
+class CObj;
+
+/*
+    CInterestSet: the objects a client gets in the snapshots
+    (interest management, see CServer::SendWorldToClient).
+
+    An object is relevant for a client, if it is in the near radius
+    of the player object, or if it is in the far radius and the line
+    of sight through the level is free. Sound objects (ghosts) only
+    use the near radius. The player object itself is always relevant.
+    An object stays in the set for the linger time after it is no
+    longer relevant, so it does not pop in and out at the border.
+
+    The line of sight tests are expensive: visible objects are tested
+    again after half the linger time, hidden objects are spread over
+    INTEREST_RETEST snapshots.
+
+    The set remembers since which snapshot an object is in the set
+    and when objects have left it. The delta compression needs this
+    (see CWorld::Serialize): an object that entered the set after the
+    baseline is sent in full, an object that was in the set at the
+    baseline and is gone now is removed on the client.
+ */
+
+#define INTEREST_NEAR_RADIUS        40.0f // default sv_interestnear
+#define INTEREST_FAR_RADIUS         200.0f // default sv_interestfar
+#define INTEREST_LINGER             1000 // default sv_interestlinger in ms
+#define INTEREST_RETEST             4 // hidden objects are tested every n-th snapshot
+
+struct interest_obj_t
+{
+    int         id;
+    uint32_t    entered; // worldid of the first snapshot with the object in the set
+    uint32_t    lastseen; // leveltime, when the object was relevant the last time
+};
+
+struct interest_left_t
+{
+    int         id;
+    uint32_t    entered; // the object was in the set from entered
+    uint32_t    left; // to the snapshot before left
+};
+
+class CInterestSet
+{
+public:
+    CInterestSet();
+    ~CInterestSet();
+
+    void        SetRange(const float nearradius, const float farradius, const uint32_t linger);
+
+    // Build the set for the current snapshot of world. viewer is the
+    // player object (NULL: every object is relevant). Objects that have
+    // left the set before oldestbaseline are forgotten.
+    void        Update(const CWorld* world, const CObj* viewer, uint32_t oldestbaseline);
+    void        Clear();
+
+    // worldid since id is in the set, 0 if it is not in the set
+    uint32_t    GetEntered(int id) const;
+
+    const std::vector<interest_obj_t>&  GetObjs() const { return m_objs; } // sorted by id
+    const std::vector<interest_left_t>& GetLeft() const { return m_left; }
+    int         GetTraceCount() const { return m_tracecount; } // line of sight tests in the last Update
+
+private:
+    bool        IsRelevant(const CWorld* world, const CObj* obj, const vec3_t& eye);
+
+    std::vector<interest_obj_t> m_objs;
+    std::vector<interest_obj_t> m_next; // scratch for Update
+    std::vector<interest_left_t> m_left;
+    std::vector<CObj*> m_candidates; // scratch for Update
+
+    float       m_near;
+    float       m_far;
+    uint32_t    m_linger;
+    int         m_tracecount;
+};
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include "JobSystem.h"
+#include "lynxsys.h"
+#include <SDL/SDL.h>
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+#define JOBSYSTEM_MAX_THREADS       64
+
+CJobSystem::CJobSystem(int threadcount)
+{
+    int i;
+
+    if(threadcount < 1)
+        threadcount = CLynxSys::GetCPUCount();
+    if(threadcount < 1)
+        threadcount = 1;
+    if(threadcount > JOBSYSTEM_MAX_THREADS)
+        threadcount = JOBSYSTEM_MAX_THREADS;
+
+    m_mutex = SDL_CreateMutex();
+    m_wakeup = SDL_CreateCond();
+    m_done = SDL_CreateCond();
+    m_generation = 0;
+    m_job = NULL;
+    m_batchsize = 1;
+    m_remaining = 0;
+    m_quit = false;
+
+    m_queues.resize(threadcount);
+    for(i=0;i<threadcount;i++)
+    {
+        m_queues[i].mutex = SDL_CreateMutex();
+        m_queues[i].generation = 0;
+        m_queues[i].begin = 0;
+        m_queues[i].end = 0;
+    }
+
+    // The workers get a pointer to their m_workers entry,
+    // so the vector must not change its size from here.
+    m_workers.resize(threadcount-1);
+    for(i=0;i<threadcount-1;i++)
+    {
+        m_workers[i].jobsystem = this;
+        m_workers[i].index = i+1;
+        m_workers[i].thread = SDL_CreateThread(WorkerThread, &m_workers[i]);
+        if(!m_workers[i].thread)
+        {
+            // the other threads will steal the work from this queue
+            fprintf(stderr, "JobSystem: Failed to create worker thread %i\n", i+1);
+        }
+    }
+}
+
+CJobSystem::~CJobSystem()
+{
+    size_t i;
+
+    SDL_LockMutex(m_mutex);
+    m_quit = true;
+    SDL_CondBroadcast(m_wakeup);
+    SDL_UnlockMutex(m_mutex);
+
+    for(i=0;i<m_workers.size();i++)
+    {
+        if(m_workers[i].thread)
+            SDL_WaitThread(m_workers[i].thread, NULL);
+    }
+    m_workers.clear();
+
+    for(i=0;i<m_queues.size();i++)
+        SDL_DestroyMutex(m_queues[i].mutex);
+    m_queues.clear();
+
+    SDL_DestroyCond(m_done);
+    SDL_DestroyCond(m_wakeup);
+    SDL_DestroyMutex(m_mutex);
+}
+
+int CJobSystem::WorkerThread(void* data)
+{
+    jobsystem_worker_t* worker = (jobsystem_worker_t*)data;
+    CJobSystem* jobsystem = worker->jobsystem;
+    uint32_t generation = 0;
+    CJob* job;
+    int batchsize;
+
+    SDL_LockMutex(jobsystem->m_mutex);
+    for(;;)
+    {
+        while(!jobsystem->m_quit && jobsystem->m_generation == generation)
+            SDL_CondWait(jobsystem->m_wakeup, jobsystem->m_mutex);
+        if(jobsystem->m_quit)
+            break;
+
+        generation = jobsystem->m_generation;
+        job = jobsystem->m_job;
+        batchsize = jobsystem->m_batchsize;
+        SDL_UnlockMutex(jobsystem->m_mutex);
+
+        jobsystem->Work(worker->index, generation, job, batchsize);
+
+        SDL_LockMutex(jobsystem->m_mutex);
+    }
+    SDL_UnlockMutex(jobsystem->m_mutex);
+
+    return 0;
+}
+
+void CJobSystem::ParallelFor(CJob* job, const int count, const int batchsize)
+{
+    const int threadcount = GetThreadCount();
+    const int batch = batchsize > 0 ? batchsize : 1;
+    uint32_t generation;
+    int i;
+
+    if(count < 1)
+        return;
+    if(threadcount < 2 || count <= batch) // not worth waking up the workers
+    {
+        job->Run(0, count);
+        return;
+    }
+
+    SDL_LockMutex(m_mutex);
+    generation = ++m_generation;
+    m_job = job;
+    m_batchsize = batch;
+    m_remaining = count;
+    for(i=0;i<threadcount;i++) // every thread gets an equal share
+    {
+        SDL_LockMutex(m_queues[i].mutex);
+        m_queues[i].generation = generation;
+        m_queues[i].begin = (int)((int64_t)count*i/threadcount);
+        m_queues[i].end = (int)((int64_t)count*(i+1)/threadcount);
+        SDL_UnlockMutex(m_queues[i].mutex);
+    }
+    SDL_CondBroadcast(m_wakeup);
+    SDL_UnlockMutex(m_mutex);
+
+    Work(0, generation, job, batch);
+
+    SDL_LockMutex(m_mutex);
+    while(m_remaining > 0)
+        SDL_CondWait(m_done, m_mutex);
+    m_job = NULL;
+    SDL_UnlockMutex(m_mutex);
+}
+
+void CJobSystem::Work(const int index, const uint32_t generation, CJob* job, const int batchsize)
+{
+    int begin, end;
+
+    do
+    {
+        while(TakeBatch(index, generation, batchsize, &begin, &end))
+        {
+            job->Run(begin, end);
+            FinishBatch(end - begin);
+        }
+    } while(Steal(index, generation));
+}
+
+bool CJobSystem::TakeBatch(const int index, const uint32_t generation, const int batchsize, int* begin, int* end)
+{
+    jobsystem_queue_t& queue = m_queues[index];
+    bool success = false;
+
+    SDL_LockMutex(queue.mutex);
+    if(queue.generation == generation && queue.begin < queue.end)
+    {
+        *begin = queue.begin;
+        *end = queue.begin + batchsize;
+        if(*end > queue.end)
+            *end = queue.end;
+        queue.begin = *end;
+        success = true;
+    }
+    SDL_UnlockMutex(queue.mutex);
+
+    return success;
+}
+
+bool CJobSystem::Steal(const int index, const uint32_t generation)
+{
+    const int threadcount = GetThreadCount();
+    int i, begin = 0, end = 0;
+
+    for(i=1;i<threadcount && begin == end;i++)
+    {
+        jobsystem_queue_t& victim = m_queues[(index + i) % threadcount];
+
+        SDL_LockMutex(victim.mutex);
+        if(victim.generation == generation && victim.begin < victim.end)
+        {
+            // take the second half, the owner continues with the first half
+            begin = victim.begin + (victim.end - victim.begin)/2;
+            end = victim.end;
+            victim.end = begin;
+        }
+        SDL_UnlockMutex(victim.mutex);
+    }
+    if(begin == end)
+        return false;
+
+    // Only one queue is locked at a time, so two threads
+    // stealing from each other can't deadlock.
+    jobsystem_queue_t& queue = m_queues[index];
+    SDL_LockMutex(queue.mutex);
+    queue.generation = generation;
+    queue.begin = begin;
+    queue.end = end;
+    SDL_UnlockMutex(queue.mutex);
+
+    return true;
+}
+
+void CJobSystem::FinishBatch(const int count)
+{
+    SDL_LockMutex(m_mutex);
+    m_remaining -= count;
+    assert(m_remaining >= 0);
+    if(m_remaining == 0)
+        SDL_CondBroadcast(m_done);
+    SDL_UnlockMutex(m_mutex);
+}
+
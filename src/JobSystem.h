@@ -0,0 +1,85 @@
+#pragma once
+
+#include "lynx.h"
+#include <vector>
+
+struct SDL_Thread;
+struct SDL_mutex;
+struct SDL_cond;
+
+/*
+    CJobSystem: runs a loop body on every CPU core.
+
+    ParallelFor(job, count, batchsize) calls job->Run(begin, end) for
+    the index range 0 to count-1. The range is split up between all
+    threads (the calling thread is working too). A thread takes
+    batchsize indices from its own range at a time. If a thread has
+    nothing left to do, it steals the second half of the range of
+    another thread. ParallelFor returns when every index is done.
+
+    The job must only write to data that belongs to its index
+    (e.g. result[i]). Then the result does not depend on the number
+    of threads or the order of execution.
+
+    With one thread (or a single core CPU) everything runs on the
+    calling thread.
+ */
+
+class CJob
+{
+public:
+    virtual ~CJob() {}
+    virtual void Run(int begin, int end) = 0; // process index begin to end-1
+};
+
+class CJobSystem
+{
+public:
+    CJobSystem(int threadcount=0); // 0 = one thread per CPU core
+    ~CJobSystem();
+
+    void        ParallelFor(CJob* job, const int count, const int batchsize);
+
+    int         GetThreadCount() const { return (int)m_queues.size(); } // including calling thread
+
+private:
+    struct jobsystem_queue_t
+    {
+        SDL_mutex*  mutex;
+        uint32_t    generation; // range belongs to this ParallelFor call
+        int         begin;
+        int         end;
+    };
+
+    struct jobsystem_worker_t
+    {
+        CJobSystem* jobsystem;
+        int         index; // queue index
+        SDL_Thread* thread;
+    };
+
+    std::vector<jobsystem_queue_t> m_queues; // one per thread, 0 is the calling thread
+    std::vector<jobsystem_worker_t> m_workers;
+
+    // Worker threads wait here for a new ParallelFor call
+    SDL_mutex*  m_mutex;
+    SDL_cond*   m_wakeup;
+    SDL_cond*   m_done;
+    uint32_t    m_generation;
+    CJob*       m_job;
+    int         m_batchsize;
+    int         m_remaining; // indices not done yet
+    bool        m_quit;
+
+    void        Work(const int index, const uint32_t generation, CJob* job, const int batchsize);
+    bool        TakeBatch(const int index, const uint32_t generation, const int batchsize, int* begin, int* end);
+    bool        Steal(const int index, const uint32_t generation);
+    void        FinishBatch(const int count);
+
+    static int  WorkerThread(void* data);
+
+    // Rule of three
+    CJobSystem(const CJobSystem&);
+    CJobSystem& operator=(const CJobSystem&);
+};
+
@@ -0,0 +1,105 @@
+#include <assert.h>
+#include "LagCompensation.h"
+#include "World.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+CLagCompensation::CLagCompensation()
+{
+    m_lasttime = 0;
+}
+
+CLagCompensation::~CLagCompensation()
+{
+}
+
+void CLagCompensation::Clear()
+{
+    m_objs.clear();
+    m_lasttime = 0;
+}
+
+static void AddPos(lagcomp_obj_t& hist, uint32_t time, const vec3_t& origin)
+{
+    lagcomp_pos_t* pos;
+    if(hist.count < LAGCOMP_HISTORY)
+    {
+        pos = &hist.pos[(hist.first + hist.count) % LAGCOMP_HISTORY];
+        hist.count++;
+    }
+    else // overwrite the oldest
+    {
+        pos = &hist.pos[hist.first];
+        hist.first = (hist.first + 1) % LAGCOMP_HISTORY;
+    }
+    pos->time = time;
+    pos->origin = origin;
+}
+
+void CLagCompensation::Record(const CWorld* world)
+{
+    const uint32_t time = world->GetLeveltime();
+    const int objcount = world->GetObjCount();
+    const std::vector<int>& ids = world->GetObjStore()->GetIDArray();
+    const std::vector<vec3_t>& origins = world->GetObjStore()->GetOriginArray();
+
+    for(int i=0;i<objcount;i++)
+    {
+        const int slot = CObjStore::GetHandleIndex(ids[i]);
+        if(slot >= (int)m_objs.size())
+        {
+            lagcomp_obj_t unused;
+            unused.id = 0;
+            unused.first = 0;
+            unused.count = 0;
+            m_objs.resize(slot + 1, unused);
+        }
+
+        lagcomp_obj_t& hist = m_objs[slot];
+        if(hist.id != ids[i]) // new object in this slot
+        {
+            hist.id = ids[i];
+            hist.first = 0;
+            hist.count = 0;
+            AddPos(hist, time, origins[i]);
+            continue;
+        }
+
+        const lagcomp_pos_t& last = hist.pos[(hist.first + hist.count - 1) % LAGCOMP_HISTORY];
+        if(last.origin == origins[i])
+            continue;
+        // The object has not moved since last.time, it was still
+        // there at the frame before this one
+        if(last.time < m_lasttime)
+            AddPos(hist, m_lasttime, last.origin);
+        AddPos(hist, time, origins[i]);
+    }
+    m_lasttime = time;
+}
+
+vec3_t CLagCompensation::GetOrigin(const CObj* obj, uint32_t time) const
+{
+    const int slot = CObjStore::GetHandleIndex(obj->GetID());
+    if(slot >= (int)m_objs.size() || m_objs[slot].id != obj->GetID())
+        return obj->GetOrigin(); // not recorded yet
+
+    // newest entry first
+    const lagcomp_obj_t& hist = m_objs[slot];
+    const lagcomp_pos_t* next = NULL;
+    for(int i=hist.count-1;i>=0;i--)
+    {
+        const lagcomp_pos_t& pos = hist.pos[(hist.first + i) % LAGCOMP_HISTORY];
+        if(pos.time <= time)
+        {
+            if(!next || next->time == pos.time)
+                return pos.origin; // no newer entry: the object is still there
+            const float f = (float)(time - pos.time) / (float)(next->time - pos.time);
+            return vec3_t::Lerp(pos.origin, next->origin, f);
+        }
+        next = &pos;
+    }
+    return next ? next->origin : obj->GetOrigin(); // older than the history
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "lynx.h"
+#include "math/vec3.h"
+#include <vector>
+
+class CWorld;
+class CObj;
+
+/*
+    CLagCompensation: where the objects were in the last server frames
+    (see CWorld::TraceObj with world_obj_trace_t::rewindtime).
+
+    A client renders the world RENDER_DELAY behind its newest snapshot,
+    and the snapshot is already half a round trip old. A shot has to be
+    tested against the objects the player has seen, not against the
+    current positions on the server.
+
+    The server records the origin of every object at the end of each
+    frame, together with the leveltime of the frame. An object that
+    does not move does not get a new entry. GetOrigin lerps between the
+    two entries around the requested time.
+
+    The history is indexed by the slot of the object id (see CObjStore),
+    a lookup is an array access.
+ */
+
+#define LAGCOMP_HISTORY         32 // positions per object
+#define LAGCOMP_MAX_TIME        500 // default sv_lagcomp: max. rewind in ms
+
+struct lagcomp_pos_t
+{
+    uint32_t    time; // leveltime
+    vec3_t      origin;
+};
+
+struct lagcomp_obj_t
+{
+    int         id; // 0: unused slot
+    int         first; // oldest entry in pos
+    int         count;
+    lagcomp_pos_t pos[LAGCOMP_HISTORY]; // ring buffer, oldest first
+};
+
+class CLagCompensation
+{
+public:
+    CLagCompensation();
+    ~CLagCompensation();
+
+    // End of a server frame: remember the positions of the objects in
+    // world with the current leveltime
+    void        Record(const CWorld* world);
+
+    // Origin of obj at leveltime time. If the history does not go back that
+    // far, this is the oldest known position.
+    vec3_t      GetOrigin(const CObj* obj, uint32_t time) const;
+
+    void        Clear();
+
+private:
+    std::vector<lagcomp_obj_t> m_objs; // index: CObjStore::GetHandleIndex of the id
+    uint32_t    m_lasttime; // leveltime of the last Record call
+};
@@ -32,41 +32,51 @@ void CMixer::Shutdown()
 
 void CMixer::Update(const float dt, const uint32_t ticks)
 {
-    OBJITER iter;
     CObj* obj;
-    bool success;
+    int i;
 
-    for(iter=m_world->ObjBegin();iter!=m_world->ObjEnd();iter++)
+    for(i=0;i<m_world->GetObjCount();i++)
     {
-        obj = (*iter).second;
+        obj = m_world->GetObjByIndex(i);
 
         if(obj->GetSound() && !obj->GetSoundState()->is_playing)
-        {
-            success = obj->GetSound()->Play(obj->GetSoundState());
+            Play(obj->GetSound(), obj->GetSoundState(), obj->GetOrigin());
+    }
+
+    // One-shot sounds from the server
+    std::vector<client_effect_t>& effects = m_world->GetEffects();
+    for(size_t j=0;j<effects.size();j++)
+    {
+        if(effects[j].sound && !effects[j].soundstate.is_playing)
+            Play(effects[j].sound, &effects[j].soundstate, effects[j].origin);
+    }
+}
+
+void CMixer::Play(const CSound* sound, sound_state_t* state, const vec3_t& origin)
+{
+    const bool success = sound->Play(state);
 
-            CObj* localplayer = m_world->GetLocalObj();
-            if(success && localplayer)
-            {
-                // Distance to sound source
-                const vec3_t diff = localplayer->GetOrigin() - obj->GetOrigin();
-                const float dist = std::min(diff.Abs(), SOUND_MAX_DIST);
-                int volume = (int)(dist*255/SOUND_MAX_DIST);
-                if(volume > 255)
-                    volume = 255;
+    CObj* localplayer = m_world->GetLocalObj();
+    if(success && localplayer)
+    {
+        // Distance to sound source
+        const vec3_t diff = localplayer->GetOrigin() - origin;
+        const float dist = std::min(diff.Abs(), SOUND_MAX_DIST);
+        int volume = (int)(dist*255/SOUND_MAX_DIST);
+        if(volume > 255)
+            volume = 255;
 
-                uint16_t angle; // 0-360 deg. for Mix_SetPosition
-                vec3_t playerlook; // player is looking in this direction
-                float fAlpha; // riwi to sound source
-                float fBeta; // riwi look dir
-                m_world->GetLocalController()->GetDir(&playerlook, NULL, NULL);
+        uint16_t angle; // 0-360 deg. for Mix_SetPosition
+        vec3_t playerlook; // player is looking in this direction
+        float fAlpha; // riwi to sound source
+        float fBeta; // riwi look dir
+        m_world->GetLocalController()->GetDir(&playerlook, NULL, NULL);
 
-                fAlpha = atan2(diff.x, -diff.z);
-                fBeta = atan2(playerlook.x, -playerlook.z);
-                angle = (uint16_t)((fAlpha - fBeta)*180/lynxmath::PI);
-                Mix_SetPosition(obj->GetSoundState()->cur_channel,
-                                angle, (uint8_t)volume);
-            }
-        }
+        fAlpha = atan2(diff.x, -diff.z);
+        fBeta = atan2(playerlook.x, -playerlook.z);
+        angle = (uint16_t)((fAlpha - fBeta)*180/lynxmath::PI);
+        Mix_SetPosition(state->cur_channel,
+                        angle, (uint8_t)volume);
     }
 }
 
@@ -14,6 +14,8 @@ public:
     void Update(const float dt, const uint32_t ticks);
 
 protected:
+    // Play the sound with the position relative to the player
+    void Play(const CSound* sound, sound_state_t* state, const vec3_t& origin);
 
 private:
     CWorldClient* m_world;
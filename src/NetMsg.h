@@ -10,7 +10,7 @@ public:
     static int  ReadHeader(CStream* stream); // returns msg type
 };
 
-#define NET_VERSION             33      // Protocol compatible
+#define NET_VERSION             42      // Protocol compatible
 #define NET_MAGIC               0x5     // 101 (binary)
 
 typedef enum
@@ -20,6 +20,7 @@ typedef enum
     NET_MSG_CLIENT_CTRL,           // client input data
     NET_MSG_CLIENT_CHALLENGE,      // first message from client after connect
     NET_MSG_CLIENT_CHALLENGE_OK,   // server accepts us
+    NET_MSG_EVENTS,                // one-shot sounds and effects (see CEventChannel)
 
     NET_MSG_MAX                    // make this the last entry
 } net_msg_t;
@@ -13,23 +13,10 @@
 #define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
 #endif
 
-#define OBJ_STATE_ORIGIN         (1 <<  0)
-#define OBJ_STATE_VEL            (1 <<  1)
-#define OBJ_STATE_ROT            (1 <<  2)
-#define OBJ_STATE_RADIUS         (1 <<  3)
-#define OBJ_STATE_RESOURCE       (1 <<  4)
-#define OBJ_STATE_ANIMATION      (1 <<  5)
-#define OBJ_STATE_FLAGS          (1 <<  6)
-#define OBJ_STATE_PARTICLES      (1 <<  7)
-
-#define OBJ_STATE_FULLUPDATE     ((1 << 8)-1)
-
-int CObj::m_idpool = 0;
-
 CObj::CObj(CWorld* world)
 {
     assert(world);
-    m_id = ++m_idpool;
+    m_id = 0; // the world sets the id in AddObj
     state.radius = 2*lynxmath::SQRT_2;
     state.animation = ANIMATION_NONE;
     state.flags = 0;
@@ -41,11 +28,73 @@ CObj::CObj(CWorld* world)
 
     // Local attributes
     m_locIsOnGround = false;
+    m_locIsSleeping = false;
+    m_locHitsObjs = false;
+    m_locIsControlled = false;
+
+    m_gridcell = 0;
+    m_ingrid = false;
+    state.resource = 0;
+    state.particles = 0;
+    m_firstworldid = 0;
+    MarkChanged(OBJ_STATE_FULLUPDATE);
 }
 
 CObj::~CObj(void)
 {
     SAFE_RELEASE(m_mesh_state);
+    if(!m_world->IsClient())
+    {
+        m_world->GetStringTable()->Release(state.resource, m_world->GetLeveltime());
+        m_world->GetStringTable()->Release(state.particles, m_world->GetLeveltime());
+    }
+}
+
+uint16_t CObj::InternString(const std::string& str, uint16_t oldid)
+{
+    // The client gets the string ids from the server
+    assert(!m_world->IsClient());
+    if(m_world->IsClient())
+        return oldid;
+
+    CStringTable* strings = m_world->GetStringTable();
+    const int id = strings->Acquire(str, m_world->GetWorldID() + 1, m_world->GetLeveltime());
+    strings->Release(oldid, m_world->GetLeveltime());
+    return (uint16_t)id;
+}
+
+void CObj::MarkChanged(uint32_t fields)
+{
+    // The server increments the worldid before it sends the next
+    // snapshot, so the change is part of snapshot worldid+1 at the
+    // earliest.
+    m_changed = m_world->GetWorldID() + 1;
+    for(int i=0;i<OBJ_STATE_FIELDCOUNT;i++)
+        if(fields & (1 << i))
+            m_fieldchanged[i] = m_changed;
+    m_sharedstatedirty = true;
+    m_world->OnObjChanged(this);
+}
+
+std::shared_ptr<const obj_state_t> CObj::GetSharedState()
+{
+    if(m_sharedstatedirty || !m_sharedstate)
+    {
+        m_sharedstate = std::make_shared<obj_state_t>(state);
+        m_sharedstatedirty = false;
+    }
+    return m_sharedstate;
+}
+
+void CObj::SetOrigin(const vec3_t& origin)
+{
+    if(origin != state.origin)
+    {
+        state.origin = origin;
+        MarkChanged(OBJ_STATE_ORIGIN);
+    }
+    m_locIsSleeping = false;
+    m_world->OnObjMoved(this);
 }
 
 void CObj::SetRot(const quaternion_t& rotation)
@@ -54,6 +103,7 @@ void CObj::SetRot(const quaternion_t& rotation)
     if(bupdate)
     {
         state.rot = rotation;
+        MarkChanged(OBJ_STATE_ROT);
         UpdateMatrix();
     }
 }
@@ -75,12 +125,18 @@ float CObj::GetRadius() const
 
 void CObj::SetRadius(float radius)
 {
-    state.radius = radius;
+    if(radius != state.radius)
+    {
+        state.radius = radius;
+        MarkChanged(OBJ_STATE_RADIUS);
+    }
+    m_locIsSleeping = false;
+    m_world->OnObjMoved(this); // the grid needs to know about large objects
 }
 
 const std::string& CObj::GetResource() const
 {
-    return state.resource;
+    return m_world->GetStringTable()->Get(state.resource);
 }
 
 void CObj::SetResource(std::string resource)
@@ -91,13 +147,14 @@ void CObj::SetResource(std::string resource)
     if(resource.size() >= USHRT_MAX)
         return;
 
-    if(state.resource != resource)
+    if(GetResource() != resource)
     {
-        state.resource = resource;
+        state.resource = InternString(resource, state.resource);
+        MarkChanged(OBJ_STATE_RESOURCE);
         UpdateResources();
         if(m_mesh)
         {
-            state.radius = m_mesh->GetSphere();
+            SetRadius(m_mesh->GetSphere());
         }
     }
 }
@@ -112,6 +169,7 @@ void CObj::SetAnimation(animation_t animation)
     if(animation != state.animation)
     {
         state.animation = animation;
+        MarkChanged(OBJ_STATE_ANIMATION);
         UpdateResources();
     }
 }
@@ -123,17 +181,22 @@ OBJFLAGTYPE CObj::GetFlags() const
 
 void CObj::SetFlags(OBJFLAGTYPE flags)
 {
-    state.flags = flags;
+    if(state.flags != flags) // e.g. gravity on or off
+    {
+        state.flags = flags;
+        m_locIsSleeping = false;
+        MarkChanged(OBJ_STATE_FLAGS);
+    }
 }
 
 void CObj::AddFlags(OBJFLAGTYPE flags)
 {
-    state.flags |= flags;
+    SetFlags(state.flags | flags);
 }
 
 void CObj::RemoveFlags(OBJFLAGTYPE flags)
 {
-    state.flags = state.flags & ~flags;
+    SetFlags(state.flags & ~flags);
 }
 
 void CObj::UpdateParticles()
@@ -141,13 +204,14 @@ void CObj::UpdateParticles()
     if(!GetWorld()->IsClient())
         return;
 
-    if(state.particles.size() < 1)
+    const std::string& particles = GetParticleSystemName();
+    if(particles.size() < 1)
     {
         m_particlesys = std::auto_ptr<CParticleSystem>(NULL);
         return;
     }
 
-    std::istringstream iss(state.particles);
+    std::istringstream iss(particles);
     std::string psystem, pconfig;
     if(getline(iss, psystem, '|') && getline(iss, pconfig, '|'))
     {
@@ -169,13 +233,17 @@ void CObj::UpdateParticles()
 
 void CObj::SetParticleSystem(const std::string psystem)
 {
-    state.particles = psystem;
+    if(psystem != GetParticleSystemName())
+    {
+        state.particles = InternString(psystem, state.particles);
+        MarkChanged(OBJ_STATE_PARTICLES);
+    }
     UpdateParticles();
 }
 
 const std::string& CObj::GetParticleSystemName() const
 {
-    return state.particles;
+    return m_world->GetStringTable()->Get(state.particles);
 }
 
 // DELTA COMPRESSION CODE ----------------------------------------
@@ -298,10 +366,210 @@ int DeltaDiffBytes(const uint8_t* newstate,
     return 0;
 }
 
-bool CObj::Serialize(bool write, CStream* stream, int id, const obj_state_t* oldstate)
+// Snapshot encoding of one object (bit packed, see CStream::WriteBits),
+// CWorld::Serialize has written the object id (32 bits) already:
+//  - updateflags: variable length, groups of OBJ_STATE_GROUPBITS bits.
+//    The first group holds origin, vel and rot, these change most of the time.
+//  - origin, vel: fixed point numbers, rot: smallest three (see world_quant_t)
+//  - the origin starts with a bit: 1 = predicted from an older state
+//    (see obj_netbase_t): the age of this state in snapshots, a bit for
+//    "no difference" and otherwise the difference to the prediction
+//    (zigzag, groups of OBJ_NETBASE_RESIDUALBITS bits). 0 = fixed point numbers.
+//  - the strings start at the next full byte
+// Values are compared after the quantization, a change below the
+// precision is not sent.
+#define OBJ_STATE_GROUPBITS      3
+
+static bool DeltaDiffFixedVec3(const vec3_t& newstate, const vec3_t* oldstate, int bits, int fracbits)
+{
+    if(oldstate && newstate == *oldstate) // most objects don't move
+        return false;
+    return !oldstate ||
+           CStream::Quantize(newstate.x, bits, fracbits) != CStream::Quantize(oldstate->x, bits, fracbits) ||
+           CStream::Quantize(newstate.y, bits, fracbits) != CStream::Quantize(oldstate->y, bits, fracbits) ||
+           CStream::Quantize(newstate.z, bits, fracbits) != CStream::Quantize(oldstate->z, bits, fracbits);
+}
+
+// origin + vel*dt (dt in ms), in the quantized values of world_quant_t.
+// Only integers, so the client gets the same result as the server.
+static int32_t PredictFixed(int32_t origin, int32_t vel, uint32_t dt, const world_quant_t& quant)
+{
+    const int64_t num = ((int64_t)vel * dt) << quant.originfrac;
+    const int64_t den = (int64_t)1000 << quant.velfrac;
+    return origin + (int32_t)(num >= 0 ? (num + den/2)/den : -((-num + den/2)/den));
+}
+
+static uint32_t ZigZag(int32_t value) // 0, -1, 1, -2, 2 ... -> 0, 1, 2, 3, 4 ...
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t UnZigZag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static uint32_t FloatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float BitsFloat(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+uint32_t CObj::GetUpdateFlags(const obj_state_t* oldstate, uint32_t baselineid) const
+{
+    const world_quant_t& quant = m_world->GetQuant();
+    uint32_t updateflags = 0;
+    uint32_t dirty = OBJ_STATE_FULLUPDATE; // fields to compare
+
+    if(oldstate && baselineid > 0)
+    {
+        // Only compare, what has been touched after the baseline.
+        dirty = GetChangedFields(baselineid);
+        if(dirty == 0)
+            return 0;
+    }
+
+    if((dirty & OBJ_STATE_ORIGIN) && DeltaDiffFixedVec3(state.origin, oldstate ? &oldstate->origin : NULL, quant.GetOriginBits(), quant.originfrac))
+        updateflags |= OBJ_STATE_ORIGIN;
+    if((dirty & OBJ_STATE_VEL) && DeltaDiffFixedVec3(state.vel, oldstate ? &oldstate->vel : NULL, quant.GetVelBits(), quant.velfrac))
+        updateflags |= OBJ_STATE_VEL;
+    if((dirty & OBJ_STATE_ROT) && (!oldstate || (state.rot != oldstate->rot &&
+       CStream::QuantizeQuat(state.rot, quant.rotbits) != CStream::QuantizeQuat(oldstate->rot, quant.rotbits))))
+        updateflags |= OBJ_STATE_ROT;
+    if(dirty & OBJ_STATE_RADIUS)
+        DeltaDiffFloat(&state.radius,      oldstate ? &oldstate->radius : NULL,     OBJ_STATE_RADIUS,     &updateflags, NULL);
+    if((dirty & OBJ_STATE_RESOURCE) && (!oldstate || state.resource != oldstate->resource))
+        updateflags |= OBJ_STATE_RESOURCE;
+    if(dirty & OBJ_STATE_ANIMATION)
+        DeltaDiffInt16(&state.animation,   oldstate ? &oldstate->animation : NULL,  OBJ_STATE_ANIMATION,  &updateflags, NULL);
+    if(dirty & OBJ_STATE_FLAGS)
+        DeltaDiffBytes(&state.flags,       oldstate ? &oldstate->flags : NULL,      OBJ_STATE_FLAGS,      &updateflags, NULL, sizeof(state.flags));
+    if((dirty & OBJ_STATE_PARTICLES) && (!oldstate || state.particles != oldstate->particles))
+        updateflags |= OBJ_STATE_PARTICLES;
+
+    assert(oldstate ? 1 : (updateflags == OBJ_STATE_FULLUPDATE));
+    return updateflags;
+}
+
+uint32_t CObj::GetChangedFields(uint32_t worldid) const
+{
+    uint32_t fields = 0;
+    if(m_changed <= worldid)
+        return 0;
+    for(int i=0;i<OBJ_STATE_FIELDCOUNT;i++)
+        if(m_fieldchanged[i] > worldid)
+            fields |= 1 << i;
+    return fields;
+}
+
+void CObj::GetNetBase(obj_netbase_t* base, const obj_state_t* objstate,
+                      uint32_t worldid, uint32_t leveltime) const
+{
+    const world_quant_t& quant = m_world->GetQuant();
+    const int originbits = quant.GetOriginBits();
+    const int velbits = quant.GetVelBits();
+
+    base->worldid = worldid;
+    base->leveltime = leveltime;
+    base->origin[0] = CStream::Quantize(objstate->origin.x, originbits, quant.originfrac);
+    base->origin[1] = CStream::Quantize(objstate->origin.y, originbits, quant.originfrac);
+    base->origin[2] = CStream::Quantize(objstate->origin.z, originbits, quant.originfrac);
+    base->vel[0] = CStream::Quantize(objstate->vel.x, velbits, quant.velfrac);
+    base->vel[1] = CStream::Quantize(objstate->vel.y, velbits, quant.velfrac);
+    base->vel[2] = CStream::Quantize(objstate->vel.z, velbits, quant.velfrac);
+}
+
+void CObj::AddNetBase(uint32_t worldid, uint32_t leveltime)
+{
+    if(m_netbase.empty())
+    {
+        obj_netbase_t unused;
+        memset(&unused, 0, sizeof(unused));
+        m_netbase.resize(OBJ_NETBASE_HISTORY, unused);
+    }
+    GetNetBase(&m_netbase[worldid % OBJ_NETBASE_HISTORY], &state, worldid, leveltime);
+}
+
+void CObj::WriteState(CStream* stream, uint32_t updateflags, const obj_netbase_t* base) const
+{
+    const world_quant_t& quant = m_world->GetQuant();
+    const int originbits = quant.GetOriginBits();
+    const int velbits = quant.GetVelBits();
+    const uint32_t worldid = m_world->GetWorldID();
+    const uint32_t leveltime = m_world->GetLeveltime();
+    int32_t residual[3];
+    int i;
+
+    stream->WriteVarBits(updateflags, OBJ_STATE_GROUPBITS);
+    if(updateflags & OBJ_STATE_ORIGIN)
+    {
+        // The client has a state that is not too old: predict
+        bool predict = base && base->worldid > 0 && base->worldid < worldid &&
+                       worldid - base->worldid < OBJ_NETBASE_HISTORY &&
+                       base->leveltime <= leveltime;
+        if(predict)
+        {
+            const int32_t origin[3] = { CStream::Quantize(state.origin.x, originbits, quant.originfrac),
+                                        CStream::Quantize(state.origin.y, originbits, quant.originfrac),
+                                        CStream::Quantize(state.origin.z, originbits, quant.originfrac) };
+            for(i=0;i<3 && predict;i++)
+            {
+                residual[i] = origin[i] - PredictFixed(base->origin[i], base->vel[i], leveltime - base->leveltime, quant);
+                predict = residual[i] > -OBJ_NETBASE_MAXRESIDUAL && residual[i] < OBJ_NETBASE_MAXRESIDUAL;
+            }
+        }
+        stream->WriteBits(predict ? 1 : 0, 1);
+        if(predict)
+        {
+            const bool exact = residual[0] == 0 && residual[1] == 0 && residual[2] == 0;
+            stream->WriteVarBits(worldid - base->worldid, OBJ_NETBASE_AGEBITS);
+            stream->WriteBits(exact ? 1 : 0, 1);
+            for(i=0;i<3 && !exact;i++)
+                stream->WriteVarBits(ZigZag(residual[i]), OBJ_NETBASE_RESIDUALBITS);
+        }
+        else
+        {
+            stream->WriteFixed(state.origin.x, originbits, quant.originfrac);
+            stream->WriteFixed(state.origin.y, originbits, quant.originfrac);
+            stream->WriteFixed(state.origin.z, originbits, quant.originfrac);
+        }
+    }
+    if(updateflags & OBJ_STATE_VEL)
+    {
+        stream->WriteFixed(state.vel.x, velbits, quant.velfrac);
+        stream->WriteFixed(state.vel.y, velbits, quant.velfrac);
+        stream->WriteFixed(state.vel.z, velbits, quant.velfrac);
+    }
+    if(updateflags & OBJ_STATE_ROT)
+        stream->WriteQuatSmallest3(state.rot, quant.rotbits);
+    if(updateflags & OBJ_STATE_RADIUS)
+        stream->WriteBits(FloatBits(state.radius), 32);
+    if(updateflags & OBJ_STATE_ANIMATION)
+        stream->WriteBits((uint16_t)state.animation, 16);
+    if(updateflags & OBJ_STATE_FLAGS)
+        stream->WriteBits(state.flags, sizeof(state.flags)*8);
+    if(updateflags & OBJ_STATE_RESOURCE)
+        stream->WriteBits(state.resource, 16);
+    if(updateflags & OBJ_STATE_PARTICLES)
+        stream->WriteBits(state.particles, 16);
+}
+
+bool CObj::Serialize(bool write, CStream* stream, int id, const obj_state_t* oldstate,
+                     uint32_t baselineid, uint32_t baselinetime)
 {
     assert(!(!write && oldstate));
     assert(stream);
+    const world_quant_t& quant = m_world->GetQuant();
+    const int originbits = quant.GetOriginBits();
+    const int velbits = quant.GetVelBits();
     uint32_t updateflags = 0;
     if(!stream)
         return false;
@@ -310,47 +578,84 @@ bool CObj::Serialize(bool write, CStream* stream, int id, const obj_state_t* old
     {
         assert(GetID() == id);
         assert(id < INT_MAX);
-        CStream tempstream = stream->GetShallowCopy(); // we remember the position of the updateflags
-        stream->WriteAdvance(sizeof(uint32_t)); // we advance by sizeof(DWORD) bytes
-
-        DeltaDiffVec3(&state.origin,       oldstate ? &oldstate->origin : NULL,     OBJ_STATE_ORIGIN,     &updateflags, stream);
-        DeltaDiffVec3(&state.vel,          oldstate ? &oldstate->vel : NULL,        OBJ_STATE_VEL,        &updateflags, stream);
-        DeltaDiffQuat(&state.rot,          oldstate ? &oldstate->rot : NULL,        OBJ_STATE_ROT,        &updateflags, stream);
-        DeltaDiffFloat(&state.radius,      oldstate ? &oldstate->radius : NULL,     OBJ_STATE_RADIUS,     &updateflags, stream);
-        DeltaDiffString(&state.resource,   oldstate ? &oldstate->resource : NULL,   OBJ_STATE_RESOURCE,   &updateflags, stream);
-        DeltaDiffInt16(&state.animation,   oldstate ? &oldstate->animation : NULL,  OBJ_STATE_ANIMATION,  &updateflags, stream);
-        DeltaDiffBytes(&state.flags,       oldstate ? &oldstate->flags : NULL,      OBJ_STATE_FLAGS,      &updateflags, stream, sizeof(state.flags));
-        DeltaDiffString(&state.particles,  oldstate ? &oldstate->particles : NULL,  OBJ_STATE_PARTICLES,  &updateflags, stream);
-
-        tempstream.WriteDWORD(updateflags); // now we can write the updateflags
 
-        assert(oldstate ? 1 : (updateflags == OBJ_STATE_FULLUPDATE));
+        updateflags = GetUpdateFlags(oldstate, baselineid);
+        if(oldstate && baselineid > 0)
+        {
+            // The client applies this to its newest state, not to the
+            // baseline: a field that is back to the baseline value might
+            // be different there (see CPacketScheduler).
+            updateflags |= GetChangedFields(baselineid);
+            obj_netbase_t base;
+            GetNetBase(&base, oldstate, baselineid, baselinetime);
+            WriteState(stream, updateflags, &base);
+        }
+        else
+        {
+            WriteState(stream, updateflags);
+        }
     }
     else
     {
-        stream->ReadDWORD(&updateflags);
+        updateflags = stream->ReadVarBits(OBJ_STATE_GROUPBITS);
 
-        if(updateflags & OBJ_STATE_ORIGIN)
-            stream->ReadVec3(&state.origin);
+        if((updateflags & OBJ_STATE_ORIGIN) && stream->ReadBits(1))
+        {
+            const uint32_t age = stream->ReadVarBits(OBJ_NETBASE_AGEBITS);
+            int32_t residual[3] = { 0, 0, 0 };
+            if(!stream->ReadBits(1))
+            {
+                for(int i=0;i<3;i++)
+                    residual[i] = UnZigZag(stream->ReadVarBits(OBJ_NETBASE_RESIDUALBITS));
+            }
+            const uint32_t worldid = m_world->GetWorldID() - age;
+            const obj_netbase_t* base = m_netbase.empty() ? NULL : &m_netbase[worldid % OBJ_NETBASE_HISTORY];
+            if(base && base->worldid == worldid && base->leveltime <= m_world->GetLeveltime())
+            {
+                const uint32_t dt = m_world->GetLeveltime() - base->leveltime;
+                const float scale = 1.0f / (float)(1 << quant.originfrac); // like ReadFixed
+                state.origin.x = (float)(PredictFixed(base->origin[0], base->vel[0], dt, quant) + residual[0]) * scale;
+                state.origin.y = (float)(PredictFixed(base->origin[1], base->vel[1], dt, quant) + residual[1]) * scale;
+                state.origin.z = (float)(PredictFixed(base->origin[2], base->vel[2], dt, quant) + residual[2]) * scale;
+            }
+            else
+            {
+                // We don't have the base of the server: keep the origin
+                updateflags &= ~OBJ_STATE_ORIGIN;
+            }
+        }
+        else if(updateflags & OBJ_STATE_ORIGIN)
+        {
+            state.origin.x = stream->ReadFixed(originbits, quant.originfrac);
+            state.origin.y = stream->ReadFixed(originbits, quant.originfrac);
+            state.origin.z = stream->ReadFixed(originbits, quant.originfrac);
+        }
         if(updateflags & OBJ_STATE_VEL)
-            stream->ReadVec3(&state.vel);
+        {
+            state.vel.x = stream->ReadFixed(velbits, quant.velfrac);
+            state.vel.y = stream->ReadFixed(velbits, quant.velfrac);
+            state.vel.z = stream->ReadFixed(velbits, quant.velfrac);
+        }
         if(updateflags & OBJ_STATE_ROT)
         {
-            stream->ReadQuat(&state.rot);
+            stream->ReadQuatSmallest3(&state.rot, quant.rotbits);
             UpdateMatrix();
         }
         if(updateflags & OBJ_STATE_RADIUS)
-            stream->ReadFloat(&state.radius);
-        if(updateflags & OBJ_STATE_RESOURCE)
-            stream->ReadString(&state.resource);
+            state.radius = BitsFloat(stream->ReadBits(32));
         if(updateflags & OBJ_STATE_ANIMATION)
-            stream->ReadInt16(&state.animation);
+            state.animation = (animation_t)(int16_t)stream->ReadBits(16);
         if(updateflags & OBJ_STATE_FLAGS)
-            stream->ReadBytes(&state.flags, sizeof(state.flags));
+            state.flags = (OBJFLAGTYPE)stream->ReadBits(sizeof(state.flags)*8);
+        if(updateflags & OBJ_STATE_RESOURCE)
+            state.resource = (uint16_t)stream->ReadBits(16);
         if(updateflags & OBJ_STATE_PARTICLES)
-            stream->ReadString(&state.particles);
+            state.particles = (uint16_t)stream->ReadBits(16);
 
         m_id = id;
+        MarkChanged(updateflags);
+        if(updateflags & OBJ_STATE_ORIGIN || updateflags & OBJ_STATE_RADIUS)
+            m_world->OnObjMoved(this);
         if(updateflags & OBJ_STATE_RESOURCE || updateflags & OBJ_STATE_ANIMATION)
             UpdateResources();
         if(updateflags & OBJ_STATE_PARTICLES)
@@ -369,7 +674,17 @@ void CObj::SetObjState(const obj_state_t* objstate, int id)
     bool rotationchange = objstate->rot != state.rot;
     bool particlechange = objstate->particles != state.particles;
 
+    if(!m_world->IsClient())
+    {
+        CStringTable* strings = m_world->GetStringTable();
+        strings->AddRef(objstate->resource);
+        strings->AddRef(objstate->particles);
+        strings->Release(state.resource, m_world->GetLeveltime());
+        strings->Release(state.particles, m_world->GetLeveltime());
+    }
     state = *objstate;
+    MarkChanged(OBJ_STATE_FULLUPDATE);
+    m_world->OnObjMoved(this);
     if(resourcechange)
         UpdateResources();
     if(rotationchange)
@@ -385,50 +700,54 @@ void CObj::CopyObjStateFrom(const CObj* source)
 
 void CObj::UpdateResources()
 {
+    // Keep the old model state, if the model stays the same
+    // (e.g. only the animation has changed).
+    const CModel* oldmesh = m_mesh;
     m_mesh = NULL;
     m_sound = NULL;
 
-    if(state.resource == "")
+    const std::string& resource = GetResource();
+    if(resource == "")
         return;
 
-    if(state.resource.find(".md5") != std::string::npos)
+    if(resource.find(".md5") != std::string::npos)
     {
-        CModelMD5* mesh = (CModelMD5*)m_world->GetResourceManager()->GetModel(state.resource);
-        if(mesh != m_mesh)
+        CModelMD5* mesh = (CModelMD5*)m_world->GetResourceManager()->GetModel(resource);
+        if(mesh != oldmesh || !m_mesh_state)
         {
             if(m_mesh_state)
                 delete m_mesh_state;
             m_mesh_state = new md5_state_t();
-            m_mesh = mesh;
         }
+        m_mesh = mesh;
         if(m_mesh)
             m_mesh->SetAnimation(m_mesh_state, state.animation);
     }
-    else if(state.resource.find(".md2") != std::string::npos)
+    else if(resource.find(".md2") != std::string::npos)
     {
-        CModelMD2* mesh = (CModelMD2*)m_world->GetResourceManager()->GetModel(state.resource);
-        if(mesh != m_mesh)
+        CModelMD2* mesh = (CModelMD2*)m_world->GetResourceManager()->GetModel(resource);
+        if(mesh != oldmesh || !m_mesh_state)
         {
             if(m_mesh_state)
                 delete m_mesh_state;
             m_mesh_state = new md2_state_t();
-            m_mesh = mesh;
         }
+        m_mesh = mesh;
         if(m_mesh)
             m_mesh->SetAnimation(m_mesh_state, state.animation);
     }
-    else if(state.resource.find(".ogg") != std::string::npos)
+    else if(resource.find(".ogg") != std::string::npos)
     {
-        if(m_sound_state.soundpath != state.resource)
+        if(m_sound_state.soundpath != resource)
         {
-            m_sound = m_world->GetResourceManager()->GetSound(state.resource);
+            m_sound = m_world->GetResourceManager()->GetSound(resource);
             m_sound_state.init();
-            m_sound_state.soundpath = state.resource;
+            m_sound_state.soundpath = resource;
         }
     }
     else
     {
-        fprintf(stderr, "Unknown resource: %s\n", state.resource.c_str());
+        fprintf(stderr, "Unknown resource: %s\n", resource.c_str());
     }
 }
 
@@ -11,6 +11,7 @@ struct obj_state_t;
 #include "Model.h"
 #include "Sound.h"
 #include <memory>
+#include <vector>
 #include "ParticleSystem.h"
 
 #define OBJ_FLAGS_ELASTIC       (1 << 0)
@@ -19,6 +20,20 @@ struct obj_state_t;
 
 #define OBJFLAGTYPE             uint8_t
 
+// Fields of obj_state_t, used for the delta compression and the
+// dirty tracking
+#define OBJ_STATE_ORIGIN         (1 <<  0)
+#define OBJ_STATE_VEL            (1 <<  1)
+#define OBJ_STATE_ROT            (1 <<  2)
+#define OBJ_STATE_RADIUS         (1 <<  3)
+#define OBJ_STATE_RESOURCE       (1 <<  4)
+#define OBJ_STATE_ANIMATION      (1 <<  5)
+#define OBJ_STATE_FLAGS          (1 <<  6)
+#define OBJ_STATE_PARTICLES      (1 <<  7)
+
+#define OBJ_STATE_FIELDCOUNT     8
+#define OBJ_STATE_FULLUPDATE     ((1 << OBJ_STATE_FIELDCOUNT)-1)
+
 // Ghost objects:
 // --------------
 // For light weight objects with no graphical representation.
@@ -78,6 +93,8 @@ int DeltaDiffBytes(const uint8_t* newstate,
 // property. The Lynx physical model is in general pretty
 // simple. But forces should be handled on the server side
 // anyway.
+// The strings are ids in the CStringTable of the world, so this
+// struct can be copied and compared like plain data.
 struct obj_state_t
 {
     vec3_t          origin;         // Position
@@ -85,12 +102,30 @@ struct obj_state_t
     quaternion_t    rot;            // Rotation
 
     float           radius;
-    std::string     resource;
+    uint16_t        resource;       // String id (path to the model or sound)
     animation_t     animation;
     OBJFLAGTYPE     flags;
-    std::string     particles;      // Particlesystem bound to this object. The
-                                    // string looks something like this:
-                                    // "blood|dx=0.1,dy=0.6,dz=23".
+    uint16_t        particles;      // String id of the particlesystem bound to
+                                    // this object. The string looks something
+                                    // like this: "blood|dx=0.1,dy=0.6,dz=23".
+};
+
+// Predicted origin (see CObj::WriteState): encoder and decoder move the
+// origin of a snapshot the client has with its velocity to the new
+// snapshot time, only the difference to this is sent.
+// The values are quantized (see world_quant_t), so both sides get
+// exactly the same prediction.
+#define OBJ_NETBASE_HISTORY      16 // client: received states per object, the base can be this many snapshots old
+#define OBJ_NETBASE_AGEBITS      3 // snapshots from the base to the update, groups of 3 bits
+#define OBJ_NETBASE_RESIDUALBITS 2 // difference to the prediction, groups of 2 bits
+#define OBJ_NETBASE_MAXRESIDUAL  (1 << 8) // a larger difference sends the origin
+
+struct obj_netbase_t
+{
+    uint32_t    worldid; // snapshot of this state, 0: unused
+    uint32_t    leveltime;
+    int32_t     origin[3]; // CStream::Quantize
+    int32_t     vel[3];
 };
 
 class CObj
@@ -101,24 +136,57 @@ public:
 
     int         GetID() const { return m_id; }
     virtual int GetType() const { return 0; } // poor man's rtti
+    // Weight of this object for the packet scheduler (see PacketScheduler.h)
+    virtual float GetNetPriority() const { return 1.0f; }
 
     // Serialize:
     // Write object to a byte stream. If there is an oldstate available,
     // the delta compression/decompression is used.
     // For writing, id should match GetID(), for reading, id is the new object id.
+    // baselineid is the worldid of oldstate: fields that have not been
+    // touched since then are not compared (0 = compare everything).
+    // baselinetime is the leveltime of oldstate, for the predicted origin.
     bool        Serialize(bool write, CStream* stream,
-                          int id, const obj_state_t* oldstate=NULL);
+                          int id, const obj_state_t* oldstate=NULL,
+                          uint32_t baselineid=0, uint32_t baselinetime=0);
+    // GetUpdateFlags: Which parts of the state Serialize would write
+    // for this oldstate (after quantization). 0 = nothing has changed.
+    uint32_t    GetUpdateFlags(const obj_state_t* oldstate,
+                               uint32_t baselineid=0) const;
+    // GetChangedFields: fields touched after snapshot worldid (dirty tracking)
+    uint32_t    GetChangedFields(uint32_t worldid) const;
+    // WriteState: Write these fields of the state, like Serialize
+    // (the packet scheduler picks the fields itself).
+    // The origin is predicted from base, if the client has it (NULL: no base).
+    void        WriteState(CStream* stream, uint32_t updateflags,
+                           const obj_netbase_t* base=NULL) const;
+    // GetNetBase: base for WriteState from a state of snapshot worldid
+    void        GetNetBase(obj_netbase_t* base, const obj_state_t* objstate,
+                           uint32_t worldid, uint32_t leveltime) const;
+    // Client: keep the current state as base of snapshot worldid (see CWorld::Serialize)
+    void        AddNetBase(uint32_t worldid, uint32_t leveltime);
 
     obj_state_t GetObjState() const { return state; }
+    // GetSharedState: Immutable copy of the state for the world
+    // snapshots. The copy is shared until the state changes.
+    std::shared_ptr<const obj_state_t> GetSharedState();
     void        SetObjState(const obj_state_t* objstate, int id);
     // CopyObjStateFrom: Copy from other object.
     // This will also update the resources.
     void        CopyObjStateFrom(const CObj* source);
 
     const vec3_t&       GetOrigin() const { return state.origin; }
-    void                SetOrigin(const vec3_t& origin) { state.origin = origin; }
+    void                SetOrigin(const vec3_t& origin);
     const vec3_t&       GetVel() const { return state.vel; }
-    void                SetVel(const vec3_t& velocity) { state.vel = velocity; }
+    void                SetVel(const vec3_t& velocity)
+    {
+        if(velocity != state.vel)
+        {
+            state.vel = velocity;
+            m_locIsSleeping = false;
+            MarkChanged(OBJ_STATE_VEL);
+        }
+    }
     const quaternion_t& GetRot() const { return state.rot; }
     void                SetRot(const quaternion_t& rotation);
     void                GetDir(vec3_t* dir, vec3_t* up, vec3_t* side) const;
@@ -139,6 +207,21 @@ public:
     // Local Attributes
     // Has this object touched the ground? Set by World::ObjMove
     bool                locGetIsOnGround() const { return m_locIsOnGround; }
+    void                locSetIsOnGround(bool onground) { m_locIsOnGround = onground; } // client prediction
+    // Sleeping objects rest on the ground and are skipped by
+    // World::ObjMoveAll. A new velocity, origin, radius or flags
+    // wake the object up.
+    bool                locGetIsSleeping() const { return m_locIsSleeping; }
+    void                locWakeUp() { m_locIsSleeping = false; }
+    // Objects that collide with other objects (e.g. projectiles).
+    // World::ObjMove sweeps the object sphere along the path and calls
+    // OnHitObject for the first object hit (see CanHitObj).
+    bool                locGetHitsObjs() const { return m_locHitsObjs; }
+    void                locSetHitsObjs(bool hitsobjs) { m_locHitsObjs = hitsobjs; }
+    // Objects that are moved by the user commands of a client (see
+    // CGameLogic::ClientCmdMove) and are skipped by World::ObjMoveAll.
+    bool                locGetIsControlled() const { return m_locIsControlled; }
+    void                locSetIsControlled(bool controlled) { m_locIsControlled = controlled; }
 
     // Rotation
     // Direct access to the rotation matrix, used by the renderer
@@ -158,6 +241,14 @@ public:
     // Wallhit notification, called by World::ObjMove(...)
     virtual void        OnHitWall(const vec3_t& location, const vec3_t& normal) {}
 
+    // Object hit notification, called by World::ObjMove(...), if
+    // locGetHitsObjs() is true. The object stops at location, where
+    // it touches hitobj.
+    virtual void        OnHitObject(const vec3_t& location, CObj* hitobj) {}
+    // Should this object hit obj (and stop)? The movement runs on
+    // many threads, don't change anything here.
+    virtual bool        CanHitObj(const CObj* obj) const { return false; }
+
 protected:
     obj_state_t         state; // Core data
 
@@ -181,21 +272,51 @@ protected:
 
     // Particle extension
     void                UpdateParticles();
+
+    // String table (server): id for str with a reference,
+    // the reference of oldid is released.
+    uint16_t            InternString(const std::string& str, uint16_t oldid);
     std::auto_ptr<CParticleSystem> m_particlesys;
 
     // Local Attributes
     bool                m_locIsOnGround;
+    bool                m_locIsSleeping;
+    bool                m_locHitsObjs;
+    bool                m_locIsControlled;
+
+    // Broadphase, managed by CSpatialHash
+    uint64_t            m_gridcell; // key of the grid cell we are in
+    bool                m_ingrid; // are we stored in the world's grid?
+
+    // Client: worldid of the first snapshot with this object (see CWorld::Serialize)
+    uint32_t            m_firstworldid;
+    // Client: received states, index worldid % OBJ_NETBASE_HISTORY
+    std::vector<obj_netbase_t> m_netbase;
+
+    // Dirty tracking: the first snapshot that can contain the last
+    // change of each field (indexed by OBJ_STATE_* bit) and of the
+    // whole object. Everything that writes to state has to call this,
+    // after the write: it also updates the hot fields in the object store.
+    void                MarkChanged(uint32_t fields);
+    uint32_t            m_fieldchanged[OBJ_STATE_FIELDCOUNT];
+    uint32_t            m_changed;
+
+    // Snapshot extension, see GetSharedState
+    std::shared_ptr<const obj_state_t> m_sharedstate;
+    bool                m_sharedstatedirty;
 
     friend class CWorld;
+    friend class CSpatialHash;
+    friend class CPacketScheduler;
+    friend class CObjStore;
     CWorld*             GetWorld() { return m_world; }
+    const CWorld*       GetWorld() const { return m_world; }
 
 private:
     // Don't touch these
-    int                 m_id;
+    int                 m_id; // handle from CObjStore, 0 until added to the world
     CWorld*             m_world;
 
-    static int          m_idpool; // unique id number for new objects
-
     // Rule of three
     CObj(const CObj&);
     CObj& operator=(const CObj&);
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <new> // bad_alloc
+#include "ObjPool.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+#define OBJPOOL_ALIGN               16
+
+objpool_stats_t CObjPool::m_stats = {0, 0, 0, 0};
+
+CObjPool::CObjPool(const char* name, const size_t blocksize)
+{
+    m_name = name;
+    m_blocksize = (blocksize + OBJPOOL_ALIGN - 1) & ~(size_t)(OBJPOOL_ALIGN - 1);
+    m_freelist = NULL;
+    m_inuse = 0;
+}
+
+CObjPool::~CObjPool()
+{
+    assert(m_inuse == 0); // someone has not deleted his objects
+    for(size_t i=0;i<m_chunks.size();i++)
+        free(m_chunks[i]);
+    m_chunks.clear();
+    m_freelist = NULL;
+}
+
+void CObjPool::AllocChunk()
+{
+    uint8_t* chunk = (uint8_t*)malloc(m_blocksize * OBJPOOL_BLOCKS_PER_CHUNK);
+    if(!chunk)
+        return;
+    m_chunks.push_back(chunk);
+    m_stats.heapallocs++;
+
+    // link the new blocks into the free list
+    for(int i=OBJPOOL_BLOCKS_PER_CHUNK-1;i>=0;i--)
+    {
+        objpool_block_t* block = (objpool_block_t*)(chunk + i*m_blocksize);
+        block->next = m_freelist;
+        m_freelist = block;
+    }
+}
+
+void* CObjPool::Alloc(const size_t size)
+{
+    void* p;
+
+    m_stats.allocs++;
+    m_stats.inuse++;
+    if(size > m_blocksize) // subclass of a pooled class
+    {
+        m_stats.heapallocs++;
+        p = malloc(size);
+    }
+    else
+    {
+        if(!m_freelist)
+            AllocChunk();
+        p = m_freelist;
+        if(p)
+        {
+            m_freelist = m_freelist->next;
+            m_inuse++;
+        }
+    }
+
+    if(!p)
+    {
+        m_stats.inuse--;
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void CObjPool::Free(void* p, const size_t size)
+{
+    if(!p)
+        return;
+
+    m_stats.frees++;
+    m_stats.inuse--;
+    if(size > m_blocksize)
+    {
+        free(p);
+        return;
+    }
+
+    assert(m_inuse > 0);
+    m_inuse--;
+    objpool_block_t* block = (objpool_block_t*)p;
+    block->next = m_freelist; // last in, first out: the memory is probably still in the cache
+    m_freelist = block;
+}
+
+void CObjPool::GetStats(objpool_stats_t* stats)
+{
+    *stats = m_stats;
+}
+
+void CObjPool::ResetStats()
+{
+    m_stats.allocs = 0;
+    m_stats.heapallocs = 0;
+    m_stats.frees = 0;
+    // inuse is not a counter
+}
+
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "lynx.h"
+#include <vector>
+
+/*
+    CObjPool: memory pool for objects that are created and destroyed
+    all the time (zombies, rockets, sound objects).
+
+    The pool allocates the memory for many objects at once (a chunk)
+    and keeps the memory of destroyed objects in a free list. The next
+    object of the same class gets this memory back. The memory is only
+    returned to the system, if the pool itself is destroyed.
+
+    The objects are still created with new and deleted with delete
+    (e.g. by CWorld::UpdatePendingObjs), so nothing changes for the
+    world and the game code. The constructor and destructor run as
+    usual, a recycled object starts with a fresh state.
+
+    Use OBJPOOL_DECLARE in the class declaration and OBJPOOL_DEFINE in
+    the .cpp file:
+
+        class CGameObjRocket : public CGameObj
+        {
+            OBJPOOL_DECLARE(CGameObjRocket)
+            ...
+        };
+
+        OBJPOOL_DEFINE(CGameObjRocket)
+
+    Subclasses of a pooled class inherit operator new. If a subclass is
+    larger than the block size, the memory comes from the heap.
+ */
+
+#define OBJPOOL_BLOCKS_PER_CHUNK    64
+
+// Counters, summed up over every pool
+struct objpool_stats_t
+{
+    uint32_t allocs; // objects created
+    uint32_t heapallocs; // calls to malloc (new chunk or object too large)
+    uint32_t frees; // objects destroyed
+    uint32_t inuse; // objects alive at the moment
+};
+
+class CObjPool
+{
+public:
+    CObjPool(const char* name, const size_t blocksize);
+    ~CObjPool();
+
+    void*       Alloc(const size_t size);
+    void        Free(void* p, const size_t size);
+
+    const char* GetName() const { return m_name; }
+    uint32_t    GetInUse() const { return m_inuse; }
+
+    // Counters since the last ResetStats() call.
+    // allocs - heapallocs is the number of heap allocations avoided.
+    static void GetStats(objpool_stats_t* stats);
+    static void ResetStats();
+
+private:
+    struct objpool_block_t
+    {
+        objpool_block_t* next;
+    };
+
+    const char* m_name;
+    size_t      m_blocksize;
+    objpool_block_t* m_freelist;
+    std::vector<void*> m_chunks;
+    uint32_t    m_inuse;
+
+    void        AllocChunk();
+
+    static objpool_stats_t m_stats;
+
+    // Rule of three
+    CObjPool(const CObjPool&);
+    CObjPool& operator=(const CObjPool&);
+};
+
+// Class specific operator new and delete. The debug version of new
+// is needed, because the .cpp files #define new for leak detection.
+#ifdef _DEBUG
+#define OBJPOOL_DEBUG_NEW(classname) \
+    static void* operator new(size_t size, int, const char*, int) { return m_pool.Alloc(size); } \
+    static void operator delete(void* p, int, const char*, int) { m_pool.Free(p, sizeof(classname)); }
+#else
+#define OBJPOOL_DEBUG_NEW(classname)
+#endif
+
+#define OBJPOOL_DECLARE(classname) \
+public: \
+    static void* operator new(size_t size) { return m_pool.Alloc(size); } \
+    static void operator delete(void* p, size_t size) { m_pool.Free(p, size); } \
+    OBJPOOL_DEBUG_NEW(classname) \
+private: \
+    static CObjPool m_pool; \
+public:
+
+#define OBJPOOL_DEFINE(classname) \
+    CObjPool classname::m_pool(#classname, sizeof(classname));
+
@@ -0,0 +1,170 @@
+#include <assert.h>
+#include "ObjStore.h"
+#include "Obj.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+CObjStore::CObjStore()
+{
+    assert(sizeof(OBJFLAGTYPE) == sizeof(m_flags[0]));
+}
+
+CObjStore::~CObjStore()
+{
+}
+
+int CObjStore::NextGeneration(int id)
+{
+    int gen = ((id >> OBJ_HANDLE_INDEXBITS) + 1) & OBJ_HANDLE_GENMASK;
+    if(gen == 0) // id 0 is "no object"
+        gen = 1;
+    return gen;
+}
+
+CObjStore::objstore_slot_t* CObjStore::GetSlot(int index)
+{
+    assert(index >= 0 && index <= OBJ_HANDLE_INDEXMASK);
+    if(index >= (int)m_slots.size())
+    {
+        objstore_slot_t empty;
+        empty.id = 0;
+        empty.obj = NULL;
+        empty.dense = -1;
+        empty.used = false;
+        m_slots.resize(index+1, empty);
+    }
+    return &m_slots[index];
+}
+
+int CObjStore::Alloc()
+{
+    int index = -1;
+
+    // The free list can contain slots, that are used in the
+    // meantime (Insert with an id from the server). Skip them.
+    while(m_free.size() > OBJ_HANDLE_MIN_FREE)
+    {
+        const int candidate = m_free.front();
+        m_free.pop_front();
+        if(!m_slots[candidate].used)
+        {
+            index = candidate;
+            break;
+        }
+    }
+    if(index < 0)
+        index = (int)m_slots.size();
+
+    objstore_slot_t* slot = GetSlot(index);
+    assert(!slot->used);
+    slot->id = (NextGeneration(slot->id) << OBJ_HANDLE_INDEXBITS) | index;
+    slot->used = true;
+    slot->obj = NULL;
+    return slot->id;
+}
+
+bool CObjStore::Insert(CObj* obj)
+{
+    const int id = obj->GetID();
+    assert(id != 0);
+    if(id == 0)
+        return false;
+
+    objstore_slot_t* slot = GetSlot(GetHandleIndex(id));
+    if(slot->used && (slot->id != id || slot->obj))
+    {
+        assert(0); // slot is taken by another object
+        return false;
+    }
+
+    slot->id = id;
+    slot->used = true;
+    slot->obj = obj;
+    slot->dense = (int)m_dense.size();
+    m_dense.push_back(obj);
+    ResizeHot(m_dense.size());
+    CopyHot(slot->dense, obj);
+    return true;
+}
+
+void CObjStore::Remove(int id)
+{
+    const int index = GetHandleIndex(id);
+    assert(index < (int)m_slots.size() && m_slots[index].id == id);
+    if(index >= (int)m_slots.size() || m_slots[index].id != id)
+        return;
+
+    objstore_slot_t* slot = &m_slots[index];
+    if(slot->obj)
+    {
+        // Fill the gap with the last object
+        const int gap = slot->dense;
+        const size_t last = m_dense.size()-1;
+        m_dense[gap] = m_dense[last];
+        m_slots[GetHandleIndex(m_dense[gap]->GetID())].dense = gap;
+        m_ids[gap] = m_ids[last];
+        m_origins[gap] = m_origins[last];
+        m_vels[gap] = m_vels[last];
+        m_rots[gap] = m_rots[last];
+        m_radii[gap] = m_radii[last];
+        m_flags[gap] = m_flags[last];
+        m_changed[gap] = m_changed[last];
+        m_dense.pop_back();
+        ResizeHot(m_dense.size());
+    }
+
+    slot->obj = NULL;
+    slot->dense = -1;
+    slot->used = false;
+    m_free.push_back(index);
+}
+
+void CObjStore::Clear()
+{
+    // The slots are kept, so that the generations keep counting
+    // and old ids stay invalid.
+    m_dense.clear();
+    ResizeHot(0);
+    m_free.clear();
+    for(size_t i=0;i<m_slots.size();i++)
+    {
+        m_slots[i].obj = NULL;
+        m_slots[i].dense = -1;
+        m_slots[i].used = false;
+        m_free.push_back((int)i);
+    }
+}
+
+
+void CObjStore::UpdateHot(const CObj* obj)
+{
+    const int index = GetHandleIndex(obj->GetID());
+    if(index >= (int)m_slots.size() || m_slots[index].obj != obj)
+        return;
+    CopyHot(m_slots[index].dense, obj);
+}
+
+void CObjStore::CopyHot(int dense, const CObj* obj)
+{
+    m_ids[dense] = obj->GetID();
+    m_origins[dense] = obj->GetOrigin();
+    m_vels[dense] = obj->GetVel();
+    m_rots[dense] = obj->GetRot();
+    m_radii[dense] = obj->GetRadius();
+    m_flags[dense] = obj->GetFlags();
+    m_changed[dense] = obj->m_changed;
+}
+
+void CObjStore::ResizeHot(size_t size)
+{
+    m_ids.resize(size);
+    m_origins.resize(size);
+    m_vels.resize(size);
+    m_rots.resize(size);
+    m_radii.resize(size);
+    m_flags.resize(size);
+    m_changed.resize(size);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+class CObj;
+#include "lynx.h"
+#include "math/vec3.h"
+#include "math/quaternion.h"
+#include <vector>
+#include <deque>
+
+/*
+    CObjStore is the object storage of CWorld (a slot map).
+
+    The object id is a handle with two parts:
+     - the lower OBJ_HANDLE_INDEXBITS are the index of a slot
+     - the upper bits are the generation of the slot
+
+    Every time a slot is freed, the generation is incremented. An old
+    id of a deleted object will never match the new object in the same
+    slot. GetObj is an array access and a compare, no hashing.
+
+    The objects themselves are stored in a dense array without holes,
+    so the per-frame loops can walk over them with an index:
+
+        for(int i=0;i<world->GetObjCount();i++)
+        {
+            CObj* obj = world->GetObjByIndex(i);
+            ...
+        }
+
+    Removing an object moves the last object into the gap, so the
+    order of the dense array is not stable (but objects are only
+    removed in CWorld::UpdatePendingObjs, never in the middle of a loop).
+
+    The hot fields of the objects (id, origin, velocity, rotation, radius,
+    flags and the last change) are mirrored in parallel arrays with the
+    same index (structure of arrays). The movement, snapshot and culling
+    loops read these arrays instead of jumping from CObj to CObj:
+
+        const std::vector<uint8_t>& flags = store->GetFlagsArray();
+        for(int i=0;i<store->GetCount();i++)
+            if(flags[i] & OBJ_FLAGS_GHOST)
+                ...
+
+    CObj is still the owner of the data. Every write to a hot field calls
+    CObj::MarkChanged, which copies the new values with UpdateHot.
+
+    The server allocates new ids with Alloc. The client gets the ids
+    from the server and inserts the objects with the same id.
+ */
+
+#define OBJ_HANDLE_INDEXBITS        20
+#define OBJ_HANDLE_INDEXMASK        ((1 << OBJ_HANDLE_INDEXBITS)-1)
+#define OBJ_HANDLE_GENBITS          11 // the id is a positive int
+#define OBJ_HANDLE_GENMASK          ((1 << OBJ_HANDLE_GENBITS)-1)
+#define OBJ_HANDLE_MIN_FREE         1024 // don't reuse a slot, if there are not enough free slots (keeps the generations from wrapping around too fast)
+
+class CObjStore
+{
+public:
+    CObjStore();
+    ~CObjStore();
+
+    // Reserve a new id. The slot stays empty until Insert is called.
+    int         Alloc();
+    // Store obj at the slot of obj->GetID(). The id is either
+    // from Alloc or from the server (client side).
+    bool        Insert(CObj* obj);
+    // Remove obj from the store and free the slot.
+    // Does not delete the object.
+    void        Remove(int id);
+    // Forget everything. Objects are not deleted.
+    void        Clear();
+    // Copy the hot fields of obj to the arrays. Does nothing, if obj
+    // is not (yet) stored here.
+    void        UpdateHot(const CObj* obj);
+
+    CObj*       Get(int id) const
+    {
+        const uint32_t index = (uint32_t)id & OBJ_HANDLE_INDEXMASK;
+        if(index >= m_slots.size() || m_slots[index].id != id)
+            return NULL;
+        return m_slots[index].obj;
+    }
+
+    int         GetCount() const { return (int)m_dense.size(); }
+    CObj*       GetByIndex(int i) const { return m_dense[i]; } // 0 <= i < GetCount()
+
+    static int  GetHandleIndex(int id) { return id & OBJ_HANDLE_INDEXMASK; }
+
+    // Hot fields, same index as GetByIndex. Read only, see UpdateHot.
+    const std::vector<int>&             GetIDArray() const { return m_ids; }
+    const std::vector<vec3_t>&          GetOriginArray() const { return m_origins; }
+    const std::vector<vec3_t>&          GetVelArray() const { return m_vels; }
+    const std::vector<quaternion_t>&    GetRotArray() const { return m_rots; }
+    const std::vector<float>&           GetRadiusArray() const { return m_radii; }
+    const std::vector<uint8_t>&         GetFlagsArray() const { return m_flags; } // OBJFLAGTYPE
+    const std::vector<uint32_t>&        GetChangedArray() const { return m_changed; } // CObj::m_changed
+
+private:
+    struct objstore_slot_t
+    {
+        int     id; // current handle of this slot (0 = never used)
+        CObj*   obj; // NULL, if the slot is free or only reserved
+        int     dense; // index in m_dense
+        bool    used; // reserved or in use
+    };
+
+    std::vector<objstore_slot_t> m_slots;
+    std::vector<CObj*> m_dense; // all objects, without holes
+    std::deque<int> m_free; // free slot indices, oldest first
+
+    // Hot fields, parallel to m_dense
+    std::vector<int> m_ids;
+    std::vector<vec3_t> m_origins;
+    std::vector<vec3_t> m_vels;
+    std::vector<quaternion_t> m_rots;
+    std::vector<float> m_radii;
+    std::vector<uint8_t> m_flags; // OBJFLAGTYPE, Obj.h is not complete here
+    std::vector<uint32_t> m_changed;
+
+    void        CopyHot(int dense, const CObj* obj); // obj -> arrays at index dense
+    void        ResizeHot(size_t size);
+
+    objstore_slot_t* GetSlot(int index); // grows m_slots if necessary
+    static int  NextGeneration(int id); // returns the next generation (never 0)
+};
+
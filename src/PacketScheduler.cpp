@@ -0,0 +1,453 @@
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm> // sort, lower_bound, find
+#include "PacketScheduler.h"
+#include "ServerClient.h"
+#include "World.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+// sort the queues by priority, highest first (the id for the same priority)
+struct packet_priority_greater_t
+{
+    const std::vector<packet_obj_t>* objs;
+    bool operator()(int a, int b) const
+    {
+        const packet_obj_t& oa = (*objs)[a];
+        const packet_obj_t& ob = (*objs)[b];
+        if(oa.priority != ob.priority)
+            return oa.priority > ob.priority;
+        return oa.id < ob.id;
+    }
+};
+
+// Remember an update, until the client acknowledges it
+static void PacketObjSent(packet_obj_t* pobj, uint32_t worldid)
+{
+    if(pobj->unackedcount == PACKET_UNACKED)
+        pobj->unackedoverflow = worldid;
+    else
+        pobj->unacked[pobj->unackedcount++] = worldid;
+}
+
+// The client has the update of worldid and everything before
+static void PacketObjAcked(packet_obj_t* pobj, uint32_t worldid)
+{
+    int i, count = 0;
+    for(i=0;i<pobj->unackedcount;i++)
+    {
+        if(pobj->unacked[i] > worldid)
+            pobj->unacked[count++] = pobj->unacked[i];
+    }
+    pobj->unackedcount = count;
+    if(pobj->unackedoverflow <= worldid)
+        pobj->unackedoverflow = 0;
+}
+
+// The fields, that can be different between the state of the object
+// and one of the updates the client might have after the acked state.
+uint32_t CPacketScheduler::GetUnackedFields(const packet_obj_t& pobj, const CObj* obj)
+{
+    uint32_t oldest;
+    if(pobj.unackedoverflow) // the oldest is lost
+        oldest = pobj.ackedworldid;
+    else if(pobj.unackedcount > 0)
+        oldest = pobj.unacked[0];
+    else
+        return 0;
+    return obj->GetChangedFields(oldest);
+}
+
+CPacketScheduler::CPacketScheduler()
+{
+    m_objlists.SetSize(MAX_SV_PACKETLEN);
+    m_header.SetSize(MAX_SV_PACKETLEN);
+    m_sent.resize(PACKET_HISTORY);
+    m_packetsize = PACKET_SIZE;
+    m_budget = PACKET_BUDGET;
+    m_seq = 0;
+    Clear();
+}
+
+CPacketScheduler::~CPacketScheduler()
+{
+}
+
+void CPacketScheduler::SetLimits(int packetsize, int budget)
+{
+    m_packetsize = packetsize;
+    m_budget = budget;
+}
+
+void CPacketScheduler::Clear()
+{
+    size_t i;
+
+    m_objs.clear();
+    m_queue.clear();
+    m_removals.clear();
+    m_queuepos = 0;
+    m_removalpos = 0;
+    m_stringadded.clear();
+    for(i=0;i<m_sent.size();i++)
+    {
+        m_sent[i].seq = 0;
+        m_sent[i].objs.clear();
+    }
+    m_worldid = 0;
+    m_leveltime = 0;
+    m_budgetleft = 0;
+    m_headerbytes = 0;
+    m_ackedcount = 0;
+}
+
+static bool PacketObjLess(const packet_obj_t& a, const packet_obj_t& b)
+{
+    return a.id < b.id;
+}
+
+packet_obj_t* CPacketScheduler::FindObj(int id)
+{
+    packet_obj_t key;
+    key.id = id;
+    std::vector<packet_obj_t>::iterator iter = std::lower_bound(m_objs.begin(), m_objs.end(), key, PacketObjLess);
+    if(iter == m_objs.end() || iter->id != id)
+        return NULL;
+    return &(*iter);
+}
+
+void CPacketScheduler::Update(CWorld* world, const CObj* viewer, const CInterestSet* interest)
+{
+    size_t i;
+
+    m_worldid = world->GetWorldID();
+    m_leveltime = world->GetLeveltime();
+
+    m_relevant.clear();
+    if(interest)
+    {
+        const std::vector<interest_obj_t>& objs = interest->GetObjs(); // sorted
+        for(i=0;i<objs.size();i++)
+            m_relevant.push_back(objs[i].id);
+    }
+    else
+    {
+        const std::vector<int>& ids = world->GetObjStore()->GetIDArray();
+        m_relevant.insert(m_relevant.end(), ids.begin(), ids.end());
+        std::sort(m_relevant.begin(), m_relevant.end());
+    }
+
+    // Merge the relevant objects with the objects we know
+    packet_obj_t newobj;
+    newobj.ackedworldid = 0;
+    newobj.ackedleveltime = 0;
+    newobj.sentworldid = 0;
+    newobj.removedworldid = 0;
+    newobj.unackedcount = 0;
+    newobj.unackedoverflow = 0;
+    newobj.updateflags = 0;
+    newobj.priority = 0.0f;
+    newobj.relevant = true;
+    newobj.known = false;
+    newobj.pending = false;
+    m_next.clear();
+    std::vector<packet_obj_t>::iterator olditer = m_objs.begin();
+    std::vector<int>::const_iterator newiter = m_relevant.begin();
+    while(olditer != m_objs.end() || newiter != m_relevant.end())
+    {
+        if(newiter == m_relevant.end() || (olditer != m_objs.end() && olditer->id < *newiter))
+        {
+            // not relevant anymore, the client needs a removal
+            if(olditer->known)
+            {
+                m_next.push_back(*olditer);
+                m_next.back().relevant = false;
+            }
+            ++olditer;
+        }
+        else if(olditer == m_objs.end() || *newiter < olditer->id)
+        {
+            newobj.id = *newiter;
+            m_next.push_back(newobj);
+            ++newiter;
+        }
+        else
+        {
+            m_next.push_back(*olditer);
+            m_next.back().relevant = true;
+            ++olditer;
+            ++newiter;
+        }
+    }
+    m_objs.swap(m_next);
+    m_next.clear(); // release the shared states
+
+    // Priorities
+    const vec3_t eye = viewer ? viewer->GetOrigin() : vec3_t();
+    m_queue.clear();
+    m_removals.clear();
+    m_queuepos = 0;
+    m_removalpos = 0;
+    for(i=0;i<m_objs.size();i++)
+    {
+        packet_obj_t& pobj = m_objs[i];
+        CObj* obj = pobj.relevant ? world->GetObj(pobj.id) : NULL;
+        float weight = 1.0f;
+        if(obj)
+        {
+            if(!pobj.acked)
+                pobj.updateflags = OBJ_STATE_FULLUPDATE;
+            else
+            {
+                pobj.updateflags = obj->m_changed > pobj.ackedworldid ?
+                                   obj->GetUpdateFlags(pobj.acked.get(), pobj.ackedworldid) : 0;
+                pobj.updateflags |= GetUnackedFields(pobj, obj);
+            }
+            pobj.pending = pobj.updateflags != 0;
+            weight = obj->GetNetPriority();
+            if(viewer)
+                weight *= PACKET_PRIORITY_DISTANCE / (PACKET_PRIORITY_DISTANCE + (obj->GetOrigin() - eye).Abs());
+        }
+        else
+        {
+            pobj.relevant = false;
+            pobj.pending = pobj.known;
+        }
+
+        if(!pobj.pending)
+        {
+            pobj.priority = 0.0f;
+            continue;
+        }
+        pobj.priority += weight;
+        if(pobj.relevant)
+            m_queue.push_back((int)i);
+        else
+            m_removals.push_back((int)i);
+    }
+    packet_priority_greater_t greater;
+    greater.objs = &m_objs;
+    std::sort(m_queue.begin(), m_queue.end(), greater);
+    std::sort(m_removals.begin(), m_removals.end(), greater);
+
+    m_budgetleft = m_budget;
+
+    // Size of a packet without strings and objects
+    m_strings.clear();
+    m_objlists.ResetWritePosition();
+    m_header.ResetWritePosition();
+    m_header.WriteDWORD(0); // packet number
+    world->SerializePartial(&m_header, m_strings, m_objlists);
+    m_headerbytes = (int)m_header.GetBytesWritten();
+}
+
+void CPacketScheduler::AddString(CWorld* world, int id, int* bytes)
+{
+    if(id == 0)
+        return;
+    const uint32_t added = world->GetStringTable()->GetAdded(id);
+    if(id < (int)m_stringadded.size() && m_stringadded[id] == added) // the client has it
+        return;
+    if(std::find(m_strings.begin(), m_strings.end(), id) != m_strings.end())
+        return;
+    m_strings.push_back(id);
+    *bytes += 3 + (int)CStream::StringSize(world->GetStringTable()->Get(id)); // 1+16 bits and the string
+}
+
+bool CPacketScheduler::WritePacket(CWorld* world, CStream* stream)
+{
+    if(m_budgetleft <= 0 ||
+       (m_queuepos >= m_queue.size() && m_removalpos >= m_removals.size()))
+        return false;
+
+    // bytes for the strings and the object lists
+    const int limit = std::min(m_packetsize, m_budgetleft) - (int)stream->GetBytesWritten() - m_headerbytes;
+    const int emptylimit = std::min(m_packetsize, m_budget) - (int)stream->GetBytesWritten() - m_headerbytes;
+    const int maxlimit = MAX_SV_PACKETLEN - (int)stream->GetBytesWritten() - m_headerbytes;
+    const uint32_t seq = m_seq + 1;
+    packet_sent_t& sent = m_sent[seq % PACKET_HISTORY];
+    packet_sentobj_t sentobj;
+    unsigned int mark;
+    bool full = false;
+    bool alone = false;
+    int stringbytes = 0;
+    int bytes;
+    size_t stringcount;
+
+    sent.seq = seq;
+    sent.worldid = m_worldid;
+    sent.leveltime = m_leveltime;
+    sent.acked = false;
+    sent.objs.clear();
+    sent.strings.clear();
+    sent.stringadded.clear();
+    m_strings.clear();
+    m_objlists.ResetWritePosition();
+
+    // removed: 33 bits each, they go first
+    for(;m_removalpos<m_removals.size();m_removalpos++)
+    {
+        packet_obj_t& pobj = m_objs[m_removals[m_removalpos]];
+        mark = m_objlists.GetBitsWritten();
+        m_objlists.WriteBits(1, 1);
+        m_objlists.WriteBits((uint32_t)pobj.id, 32);
+        if((int)(m_objlists.GetBitsWritten() + 3 + 7)/8 > limit)
+        {
+            m_objlists.RewindWrite(mark);
+            full = true;
+            break;
+        }
+        pobj.removedworldid = m_worldid;
+        pobj.acked.reset(); // the next update is a full update
+        pobj.unackedcount = 0;
+        pobj.unackedoverflow = 0;
+        pobj.priority = 0.0f;
+        sentobj.id = pobj.id;
+        sentobj.state.reset();
+        sent.objs.push_back(sentobj);
+    }
+    m_objlists.WriteBits(0, 1);
+    m_objlists.WriteBits(0, 1); // no created list, full updates are in the changed list
+
+    // changed: full state or delta to the acknowledged state
+    for(;m_queuepos<m_queue.size() && !full;m_queuepos++)
+    {
+        packet_obj_t& pobj = m_objs[m_queue[m_queuepos]];
+        CObj* obj = world->GetObj(pobj.id);
+        assert(obj);
+        const std::shared_ptr<const obj_state_t> state = obj->GetSharedState();
+        const int oldstringbytes = stringbytes;
+        stringcount = m_strings.size();
+        AddString(world, state->resource, &stringbytes);
+        AddString(world, state->particles, &stringbytes);
+
+        mark = m_objlists.GetBitsWritten();
+        m_objlists.WriteBits(1, 1);
+        m_objlists.WriteBits((uint32_t)pobj.id, 32);
+        if(pobj.acked)
+        {
+            obj_netbase_t base;
+            obj->GetNetBase(&base, pobj.acked.get(), pobj.ackedworldid, pobj.ackedleveltime);
+            obj->WriteState(&m_objlists, pobj.updateflags, &base);
+        }
+        else
+        {
+            obj->WriteState(&m_objlists, pobj.updateflags);
+        }
+        bytes = (int)(m_objlists.GetBitsWritten() + 1 + 7)/8 + stringbytes + 1;
+        if(bytes > limit || m_objlists.GetWriteOverflow())
+        {
+            // An object, that does not even fit into an empty packet, is
+            // sent alone in a larger packet (ENet splits it into fragments).
+            // Otherwise it would stay at the front of the queue and block
+            // every other object.
+            alone = sent.objs.size() == 0 && bytes > emptylimit;
+            if(!alone || bytes > maxlimit || m_objlists.GetWriteOverflow())
+            {
+                m_objlists.RewindWrite(mark);
+                m_strings.resize(stringcount);
+                stringbytes = oldstringbytes;
+                if(alone) // too large for any packet, the others go first
+                {
+                    fprintf(stderr, "Object %i is too large for a packet\n", pobj.id);
+                    alone = false;
+                    continue;
+                }
+                full = true;
+                break;
+            }
+        }
+        pobj.sentworldid = m_worldid;
+        pobj.known = true;
+        PacketObjSent(&pobj, m_worldid);
+        pobj.priority = 0.0f;
+        sentobj.id = pobj.id;
+        sentobj.state = state;
+        sent.objs.push_back(sentobj);
+        if(alone)
+        {
+            m_queuepos++;
+            break;
+        }
+    }
+    m_objlists.WriteBits(0, 1);
+
+    if(sent.objs.size() == 0) // not even one object fits
+    {
+        sent.seq = 0;
+        m_budgetleft = 0;
+        return false;
+    }
+
+    const unsigned int start = stream->GetBytesWritten();
+    m_seq = seq;
+    stream->WriteDWORD(seq);
+    world->SerializePartial(stream, m_strings, m_objlists);
+    for(size_t i=0;i<m_strings.size();i++)
+    {
+        sent.strings.push_back(m_strings[i]);
+        sent.stringadded.push_back(world->GetStringTable()->GetAdded(m_strings[i]));
+    }
+    m_budgetleft -= (int)(stream->GetBytesWritten() - start);
+    return !stream->GetWriteOverflow();
+}
+
+void CPacketScheduler::Ack(uint32_t seq, uint32_t mask)
+{
+    int i;
+
+    // oldest first, the objects have to see the packets in order
+    for(i=PACKET_ACK_BITS;i>0;i--)
+    {
+        if((mask & (1u << (i-1))) && seq > (uint32_t)i)
+            AckPacket(seq - i);
+    }
+    AckPacket(seq);
+}
+
+void CPacketScheduler::AckPacket(uint32_t seq)
+{
+    size_t i;
+    packet_sent_t& sent = m_sent[seq % PACKET_HISTORY];
+    if(seq == 0 || sent.seq != seq || sent.acked)
+        return;
+    sent.acked = true;
+    m_ackedcount++;
+
+    for(i=0;i<sent.objs.size();i++)
+    {
+        packet_obj_t* pobj = FindObj(sent.objs[i].id);
+        if(!pobj)
+            continue;
+        if(!sent.objs[i].state) // removal
+        {
+            // no update after the removal: the client has deleted the object
+            if(sent.worldid > pobj->sentworldid)
+                pobj->known = false;
+        }
+        else if(sent.worldid > pobj->removedworldid && sent.worldid > pobj->ackedworldid)
+        {
+            pobj->acked = sent.objs[i].state;
+            pobj->ackedworldid = sent.worldid;
+            pobj->ackedleveltime = sent.leveltime;
+            PacketObjAcked(pobj, sent.worldid);
+        }
+    }
+    sent.objs.clear(); // release the shared states
+
+    for(i=0;i<sent.strings.size();i++)
+    {
+        const int id = sent.strings[i];
+        if(id >= (int)m_stringadded.size())
+            m_stringadded.resize(id+1, 0);
+        m_stringadded[id] = sent.stringadded[i];
+    }
+}
+
+int CPacketScheduler::GetPendingCount() const
+{
+    return (int)(m_queue.size() - m_queuepos) + (int)(m_removals.size() - m_removalpos);
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "lynx.h"
+#include "Stream.h"
+#include <vector>
+#include <memory>
+
+class CWorld;
+class CObj;
+class CInterestSet;
+struct obj_state_t;
+
+/*
+    CPacketScheduler: the world updates for one client, split into
+    packets that fit into one UDP datagram (see CServer::SendWorldToClient).
+
+    Every packet can be decoded on its own (see CWorld::SerializePartial).
+    It has the world header, the string table entries the client does not
+    know yet and some objects. An object is sent as delta to the last state
+    the client has acknowledged, or in full, if there is no such state.
+    A lost packet only delays the objects in it: they are still different
+    from the acknowledged state and are sent again.
+    The client applies a delta to its newest state, which can be from a
+    packet after the acknowledged one. So a delta also has the fields that
+    have changed since the oldest update that is not acknowledged yet,
+    even if they are back to the acknowledged value.
+    The origin is predicted from the acknowledged state (see obj_netbase_t),
+    the client keeps the last received states of every object for this.
+
+    Every snapshot, the objects that have to be sent gain priority
+    (GetNetPriority of the object, closer to the player is more). The
+    packets are filled with the objects with the highest priority until
+    the byte budget of the snapshot is used up. A sent object starts
+    again with priority 0, so the other objects get their turn. An object
+    that is larger than a packet is sent alone in a larger packet, ENet
+    splits it into fragments.
+
+    The client acknowledges the packet numbers (the newest one and a bit
+    mask for the PACKET_ACK_BITS packets before), the scheduler keeps
+    what was in the last PACKET_HISTORY packets.
+ */
+
+#define PACKET_SIZE                 1200 // default sv_packetsize: max. bytes of a packet, below the MTU
+#define PACKET_BUDGET               (16*1024) // default sv_packetbudget: max. bytes per client and snapshot
+#define PACKET_HISTORY              256 // sent packets, that can be acknowledged
+#define PACKET_ACK_BITS             32 // the client acknowledges a packet and the 32 before it
+#define PACKET_PRIORITY_DISTANCE    50.0f // an object this far away from the player has half the priority
+#define PACKET_UNACKED              8 // updates of an object, that are tracked until they are acknowledged
+
+// The scheduler state of an object for one client
+struct packet_obj_t
+{
+    int         id;
+    std::shared_ptr<const obj_state_t> acked; // the state the client has, NULL: send the full state
+    uint32_t    ackedworldid; // snapshot of acked
+    uint32_t    ackedleveltime; // leveltime of this snapshot, for the predicted origin
+    uint32_t    sentworldid; // last snapshot with an update
+    uint32_t    removedworldid; // last snapshot with a removal, older updates are not acknowledged
+    uint32_t    unacked[PACKET_UNACKED]; // snapshots of the sent updates after acked, oldest first
+    int         unackedcount;
+    uint32_t    unackedoverflow; // newest update that did not fit into unacked, 0: none
+    uint32_t    updateflags; // fields for this snapshot
+    float       priority;
+    bool        relevant; // in the current snapshot for this client
+    bool        known; // the client might have the object (an update was sent after the last removal)
+    bool        pending; // has to be sent in this snapshot
+};
+
+// An object in a sent packet
+struct packet_sentobj_t
+{
+    int         id;
+    std::shared_ptr<const obj_state_t> state; // NULL: removal
+};
+
+// A sent packet, until it is acknowledged
+struct packet_sent_t
+{
+    uint32_t    seq; // 0: unused slot
+    uint32_t    worldid;
+    uint32_t    leveltime;
+    bool        acked;
+    std::vector<packet_sentobj_t> objs;
+    std::vector<int> strings; // string table ids
+    std::vector<uint32_t> stringadded; // GetAdded of strings
+};
+
+class CPacketScheduler
+{
+public:
+    CPacketScheduler();
+    ~CPacketScheduler();
+
+    void        SetLimits(int packetsize, int budget);
+
+    // New snapshot: find the objects that have to be sent and update
+    // their priority. The objects in interest are sent (every object of
+    // world, if interest is NULL), the others are removed on the client.
+    void        Update(CWorld* world, const CObj* viewer, const CInterestSet* interest);
+
+    // Append the next packet to stream (after the message header) and
+    // give it the next packet number. Returns false, if there is nothing
+    // left to send in this snapshot or the budget is used up.
+    bool        WritePacket(CWorld* world, CStream* stream);
+    uint32_t    GetPacketSeq() const { return m_seq; } // number of the last written packet
+
+    // Client ACK: packet seq and the packets before (bit i is seq-1-i)
+    void        Ack(uint32_t seq, uint32_t mask);
+
+    void        Clear(); // Forget everything, the next updates are full updates
+
+    int         GetPendingCount() const; // objects, that could not be sent in this snapshot
+    int         GetAckedCount() const { return m_ackedcount; } // acknowledged packets since the last Clear()
+
+private:
+    packet_obj_t* FindObj(int id);
+    void        AckPacket(uint32_t seq);
+    void        AddString(CWorld* world, int id, int* bytes);
+    static uint32_t GetUnackedFields(const packet_obj_t& pobj, const CObj* obj);
+
+    std::vector<packet_obj_t> m_objs; // sorted by id
+    std::vector<packet_obj_t> m_next; // scratch for Update
+    std::vector<int> m_relevant; // scratch for Update: ids of the objects for this client
+    std::vector<int> m_queue; // indices of the pending updates in m_objs, highest priority first
+    std::vector<int> m_removals; // the same for the pending removals
+    size_t      m_queuepos; // next m_queue entry to send
+    size_t      m_removalpos; // next m_removals entry to send
+    std::vector<packet_sent_t> m_sent; // ring buffer, index: seq % PACKET_HISTORY
+    std::vector<uint32_t> m_stringadded; // GetAdded of the string table entries the client has (index: id)
+    std::vector<int> m_strings; // scratch: strings of the current packet
+    CStream     m_objlists; // scratch: object lists of the current packet
+    CStream     m_header; // scratch: to measure the packet header
+
+    uint32_t    m_seq; // last packet number, the first packet is 1
+    uint32_t    m_worldid; // snapshot of the last Update
+    uint32_t    m_leveltime;
+    int         m_packetsize;
+    int         m_budget;
+    int         m_budgetleft; // bytes left in this snapshot
+    int         m_headerbytes; // size of the packet number and the world header
+    int         m_ackedcount;
+
+    // Rule of three
+    CPacketScheduler(const CPacketScheduler&);
+    CPacketScheduler& operator=(const CPacketScheduler&);
+};
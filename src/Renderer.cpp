@@ -155,7 +155,7 @@ void CRenderer::DrawScene(const CFrustum& frustum,
                           bool generateShadowMap)
 {
     CObj* obj;
-    OBJITER iter;
+    int i;
 
     // Draw the level
     if(!generateShadowMap && world->GetBSP()->IsLoaded())
@@ -170,18 +170,25 @@ void CRenderer::DrawScene(const CFrustum& frustum,
             glUniform1i(m_uselightmap, 0);
     }
 
-    // Draw every object
-    for(iter=world->ObjBegin();iter!=world->ObjEnd();++iter)
+    // Draw every object. The culling only reads the hot field arrays.
+    const int objcount = world->GetObjCount();
+    const CObjStore* store = world->GetObjStore();
+    const std::vector<int>& ids = store->GetIDArray();
+    const std::vector<vec3_t>& origins = store->GetOriginArray();
+    const std::vector<float>& radii = store->GetRadiusArray();
+    const std::vector<uint8_t>& flags = store->GetFlagsArray();
+    for(i=0;i<objcount;i++)
     {
-        obj = (*iter).second;
-
-        if((obj->GetFlags() & OBJ_FLAGS_GHOST) || // ghosts are invisible - duh
-            obj->GetID() == localctrlid || // don't draw the player object
-           !obj->GetMesh()) // object has no md5 model
+        if((flags[i] & OBJ_FLAGS_GHOST) || // ghosts are invisible - duh
+            ids[i] == localctrlid) // don't draw the player object
             continue;
 
         // check if object is in view frustum
-        if(!generateShadowMap && !frustum.TestSphere(obj->GetOrigin(), obj->GetRadius()))
+        if(!generateShadowMap && !frustum.TestSphere(origins[i], radii[i]))
+            continue;
+
+        obj = world->GetObjByIndex(i);
+        if(!obj->GetMesh()) // object has no md5 model
             continue;
 
         glPushMatrix();
@@ -264,7 +271,7 @@ void CRenderer::Update(const float dt, const uint32_t ticks)
 {
     CObj* obj, *localctrl;
     int localctrlid;
-    OBJITER iter;
+    int i;
     matrix_t m;
     vec3_t dir, up, side;
     CFrustum frustum;
@@ -339,9 +346,9 @@ void CRenderer::Update(const float dt, const uint32_t ticks)
     // Particle Draw
     glDisable(GL_LIGHTING);
     glDepthMask(false);
-    for(iter=world->ObjBegin();iter!=world->ObjEnd();++iter)
+    for(i=0;i<world->GetObjCount();i++)
     {
-        obj = (*iter).second;
+        obj = world->GetObjByIndex(i);
 
         if(obj->GetMesh())
         {
@@ -360,6 +367,15 @@ void CRenderer::Update(const float dt, const uint32_t ticks)
         // Draw the particles. FIXME: this should use a frustum test
         obj->GetParticleSystem()->Render(side, up, dir);
     }
+    // One-shot effects from the server
+    std::vector<client_effect_t>& effects = m_world->GetEffects();
+    for(size_t j=0;j<effects.size();j++)
+    {
+        if(!effects[j].particles)
+            continue;
+        effects[j].particles->Update(dt, ticks, effects[j].origin);
+        effects[j].particles->Render(side, up, dir);
+    }
     glDepthMask(true);
     glColor4f(1,1,1,1);
     glEnable(GL_LIGHTING);
@@ -2,6 +2,7 @@
 #include "NetMsg.h"
 #include "Server.h"
 #include "ServerClient.h"
+#include "lynxsys.h"
 #include <algorithm> // remove and remove_if
 
 #ifdef _DEBUG
@@ -14,14 +15,41 @@ CServer::CServer(CWorld* world)
     enet_initialize();
     m_server = NULL;
     m_lastupdate = 0;
+    m_updatetime = SERVER_UPDATETIME;
     m_world = world;
     m_stream.SetSize(MAX_SV_PACKETLEN);
+    m_interestencode.stream.SetSize(MAX_SV_PACKETLEN);
+    m_encodecount = 0;
+    m_encodeworldid = 0;
+    m_encodehits = 0;
+    m_encodemisses = 0;
+    m_history.resize(MAX_WORLD_BACKLOG);
+    m_historyfirst = 0;
+    m_historycount = 0;
+
+    // Snapshot precision, see world_quant_t
+    world_quant_t quant = m_world->GetQuant();
+    quant.originfrac = (uint8_t)CLynx::cfg.GetVarAsInt("sv_originprecision", quant.originfrac, true);
+    quant.velfrac = (uint8_t)CLynx::cfg.GetVarAsInt("sv_velprecision", quant.velfrac, true);
+    quant.rotbits = (uint8_t)CLynx::cfg.GetVarAsInt("sv_rotbits", quant.rotbits, true);
+    m_world->SetQuant(quant);
+
+    m_interest = CLynx::cfg.GetVarAsInt("sv_interest", 0, true) != 0;
+    m_interestnear = (float)CLynx::cfg.GetVarAsInt("sv_interestnear", (int)INTEREST_NEAR_RADIUS, true);
+    m_interestfar = (float)CLynx::cfg.GetVarAsInt("sv_interestfar", (int)INTEREST_FAR_RADIUS, true);
+    m_interestlinger = (uint32_t)CLynx::cfg.GetVarAsInt("sv_interestlinger", INTEREST_LINGER, true);
+
+    m_packets = CLynx::cfg.GetVarAsInt("sv_packets", 1, true) != 0;
+    m_packetsize = CLynx::cfg.GetVarAsInt("sv_packetsize", PACKET_SIZE, true);
+    m_packetbudget = CLynx::cfg.GetVarAsInt("sv_packetbudget", PACKET_BUDGET, true);
 }
 
 CServer::~CServer(void)
 {
     Shutdown();
     enet_deinitialize();
+    for(size_t i=0;i<m_encodecache.size();i++)
+        delete m_encodecache[i];
 }
 
 bool CServer::Create(int port)
@@ -71,80 +99,100 @@ int CServer::GetClientCount() const
     return (int)m_clientlist.size();
 }
 
-void CServer::Update(const float dt, const uint32_t ticks)
+void CServer::Receive(const uint32_t timeout, const uint32_t ticks)
 {
     ENetEvent event;
+
+    if(enet_host_service(m_server, &event, timeout) <= 0)
+        return;
+    do
+    {
+        OnEvent(&event, ticks);
+    } while(enet_host_service(m_server, &event, 0) > 0);
+}
+
+void CServer::OnEvent(ENetEvent* event, const uint32_t ticks)
+{
     CClientInfo* clientinfo;
     std::map<int, CClientInfo*>::iterator iter;
     CStream stream;
 
-    while(enet_host_service(m_server, &event, 0) > 0)
+    switch (event->type)
     {
-        switch (event.type)
+    case ENET_EVENT_TYPE_CONNECT:
+        // Fire Event
         {
-        case ENET_EVENT_TYPE_CONNECT:
-            // Fire Event
-            {
-            // first we get a human readable hostname
-            char hostname[1024];
-            enet_address_get_host_ip(&event.peer->address,
-                                     hostname, sizeof(hostname));
-
-            // create client object
-            clientinfo = new CClientInfo(event.peer, hostname, ticks);
-            event.peer->data = clientinfo;
-            m_clientlist[clientinfo->GetID()] = clientinfo;
-
-            fprintf(stderr, "A new client connected from %s:%u.\n",
-                    hostname,
-                    event.peer->address.port);
-
-            EventNewClientConnected e;
-            e.client = clientinfo;
-            CSubject<EventNewClientConnected>::NotifyAll(e);
-            }
+        // first we get a human readable hostname
+        char hostname[1024];
+        enet_address_get_host_ip(&event->peer->address,
+                                 hostname, sizeof(hostname));
+
+        // create client object
+        clientinfo = new CClientInfo(event->peer, hostname, ticks);
+        clientinfo->interest.SetRange(m_interestnear, m_interestfar, m_interestlinger);
+        clientinfo->packets.SetLimits(m_packetsize, m_packetbudget);
+        event->peer->data = clientinfo;
+        m_clientlist[clientinfo->GetID()] = clientinfo;
+
+        fprintf(stderr, "A new client connected from %s:%u.\n",
+                hostname,
+                event->peer->address.port);
+
+        EventNewClientConnected e;
+        e.client = clientinfo;
+        CSubject<EventNewClientConnected>::NotifyAll(e);
+        }
 
-            break;
+        break;
 
-        case ENET_EVENT_TYPE_RECEIVE:
-            stream.SetBuffer(event.packet->data,
-                             event.packet->dataLength,
-                             event.packet->dataLength);
-            OnReceive(&stream, (CClientInfo*)event.peer->data);
-            enet_packet_destroy (event.packet);
-            break;
+    case ENET_EVENT_TYPE_RECEIVE:
+        stream.SetBuffer(event->packet->data,
+                         event->packet->dataLength,
+                         event->packet->dataLength);
+        OnReceive(&stream, (CClientInfo*)event->peer->data);
+        enet_packet_destroy (event->packet);
+        break;
 
-        case ENET_EVENT_TYPE_DISCONNECT:
-            clientinfo = (CClientInfo*)event.peer->data;
-            assert(clientinfo);
-            if(!clientinfo)
-                break; // this should not happen
+    case ENET_EVENT_TYPE_DISCONNECT:
+        clientinfo = (CClientInfo*)event->peer->data;
+        assert(clientinfo);
+        if(!clientinfo)
+            break; // this should not happen
 
-            fprintf(stderr, "Client %i disconnected.\n", clientinfo->GetID());
+        fprintf(stderr, "Client %i disconnected.\n", clientinfo->GetID());
 
-            // Message to all observer
-            {
-            EventClientDisconnected e;
-            e.client = clientinfo;
-            CSubject<EventClientDisconnected>::NotifyAll(e);
-            }
+        // Message to all observer
+        {
+        EventClientDisconnected e;
+        e.client = clientinfo;
+        CSubject<EventClientDisconnected>::NotifyAll(e);
+        }
 
-            // Remove client from list and free memory
-            iter = m_clientlist.find(clientinfo->GetID());
-            assert(iter != m_clientlist.end());
-            delete (*iter).second;
-            m_clientlist.erase(iter);
-            event.peer->data = NULL;
-            break;
+        // Remove client from list and free memory
+        iter = m_clientlist.find(clientinfo->GetID());
+        assert(iter != m_clientlist.end());
+        delete (*iter).second;
+        m_clientlist.erase(iter);
+        event->peer->data = NULL;
+        break;
 
-        case ENET_EVENT_TYPE_NONE:
-            break;
-        }
+    case ENET_EVENT_TYPE_NONE:
+        break;
     }
+}
 
-    if((ticks - m_lastupdate) > SERVER_UPDATETIME)
+void CServer::Update(const float dt, const uint32_t ticks)
+{
+    ENetEvent event;
+    std::map<int, CClientInfo*>::iterator iter;
+
+    while(enet_host_service(m_server, &event, 0) > 0)
+        OnEvent(&event, ticks);
+
+    if((ticks - m_lastupdate) >= m_updatetime)
     {
         int sent = 0;
+        AddEventsToClients();
         for(iter = m_clientlist.begin();iter!=m_clientlist.end();iter++)
         {
             CClientInfo* client = (*iter).second;
@@ -155,7 +203,7 @@ void CServer::Update(const float dt, const uint32_t ticks)
             // if we have not received this message after a certain
             // time (SV_MAX_CHALLENGE_TIME in ms) we disconnect the client.
             if(!client->got_challenge &&
-               (ticks - client->GetConnecttime() > SV_MAX_CHALLENGE_TIME))
+               (int32_t)(ticks - client->GetConnecttime()) > SV_MAX_CHALLENGE_TIME)
             {
                 fprintf(stderr, "Client challenge timeout.\n");
                 enet_peer_disconnect_later(client->GetPeer(), 0);
@@ -165,13 +213,14 @@ void CServer::Update(const float dt, const uint32_t ticks)
 
             if(SendWorldToClient(client))
                 sent++;
+            SendEventsToClient(client);
         }
 
         m_lastupdate = ticks;
-        if(sent > 0)
+        if(sent > 0 && !m_packets) // the packet scheduler needs no snapshots
         {
-            assert(m_history.find(m_world->GetWorldID()) == m_history.end());
-            m_history[m_world->GetWorldID()] = m_world->GetWorldState();
+            assert(GetHistory(m_world->GetWorldID()) == NULL);
+            AddHistory();
         }
         UpdateHistoryBuffer();
     }
@@ -205,41 +254,21 @@ void CServer::OnReceiveClientCtrl(CStream* stream, CClientInfo* client)
         return;
 
     uint32_t worldid;
+    uint32_t packetseq, packetmask;
+    uint32_t eventack;
     stream->ReadDWORD(&worldid);
-    ClientHistoryACK(client, worldid);
-
-    CObj* obj = m_world->GetObj(client->m_obj);
-    assert(obj);
-    if(!obj)
-    {
-        fprintf(stderr, "Invalid client message\n");
-        return;
-    }
-    vec3_t origin, vel;
-    stream->ReadVec3(&origin);
-    stream->ReadVec3(&vel);
-    stream->ReadFloat(&client->lat);
-    stream->ReadFloat(&client->lon);
-    if((origin - obj->GetOrigin()).AbsSquared() < MAX_SV_CL_POS_DIFF)
-    {
-        obj->SetOrigin(origin);
-    }
+    stream->ReadDWORD(&packetseq);
+    stream->ReadDWORD(&packetmask);
+    stream->ReadDWORD(&eventack);
+    if(m_packets) // no snapshot history, see SendPacketsToClient
+        client->packets.Ack(packetseq, packetmask);
     else
-    {
-        fprintf(stderr, "SV: Not accepting client position\n");
-    }
-    obj->SetVel(vel);
+        ClientHistoryACK(client, worldid);
+    client->events.Ack(eventack);
 
-    assert(client->clcmdlist.size() < 30);
-    uint16_t cmdcount;
-    stream->ReadWORD(&cmdcount);
-    client->clcmdlist.clear();
-    for(int i=0;i<cmdcount;i++)
-    {
-        std::string cmd;
-        stream->ReadString(&cmd);
-        client->clcmdlist.push_back(cmd);
-    }
+    // The player is moved by the game logic with these commands,
+    // the server does not take a position from the client.
+    client->usercmds.Serialize(false, stream);
 }
 
 void CServer::OnReceiveChallenge(CStream* stream, CClientInfo* client)
@@ -286,11 +315,44 @@ void CServer::OnReceiveChallenge(CStream* stream, CClientInfo* client)
     }
 }
 
+void CServer::AddHistory()
+{
+    const int size = (int)m_history.size();
+    if(m_historycount == size)
+    {
+        fprintf(stderr, "Server History Buffer full. Dropping oldest snapshot.\n");
+        m_history[m_historyfirst].ClearObjStates();
+        m_historyfirst = (m_historyfirst + 1) % size;
+        m_historycount--;
+    }
+    m_world->GetWorldState(&m_history[(m_historyfirst + m_historycount) % size]);
+    m_historycount++;
+}
+
+const world_state_t* CServer::GetHistory(uint32_t worldid) const
+{
+    // binary search, the worldid is increasing from the oldest slot on
+    const int size = (int)m_history.size();
+    int lo = 0;
+    int hi = m_historycount;
+    while(lo < hi)
+    {
+        const int mid = (lo + hi) / 2;
+        if(m_history[(m_historyfirst + mid) % size].worldid < worldid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if(lo < m_historycount && m_history[(m_historyfirst + lo) % size].worldid == worldid)
+        return &m_history[(m_historyfirst + lo) % size];
+    return NULL;
+}
+
 void CServer::UpdateHistoryBuffer()
 {
     uint32_t lowestworldid = 0;
     CClientInfo* client;
-    std::map<uint32_t, world_state_t>::iterator worlditer;
+    const world_state_t* worldstate;
     std::map<int, CClientInfo*>::iterator clientiter;
     uint32_t worldtime;
     uint32_t curtime = m_world->GetLeveltime();
@@ -302,15 +364,15 @@ void CServer::UpdateHistoryBuffer()
         if(client->worldidACK == 0) // dieser client hat keine bekannte welt
             continue;
 
-        worlditer = m_history.find(client->worldidACK);
-        if(worlditer == m_history.end())
+        worldstate = GetHistory(client->worldidACK);
+        if(!worldstate)
         {
             //assert(0);
             client->worldidACK = 0;
             fprintf(stderr, "Client last known world is not in history buffer\n");
             continue;
         }
-        worldtime = ((*worlditer).second).leveltime;
+        worldtime = worldstate->leveltime;
         if(curtime - worldtime > SERVER_MAX_WORLD_AGE)
         {
             fprintf(stderr, "Client world is too old (%i ms)\n", (int)(curtime - worldtime));
@@ -323,26 +385,17 @@ void CServer::UpdateHistoryBuffer()
         }
     }
 
-    for(worlditer = m_history.begin();worlditer != m_history.end();)
+    // The oldest snapshots are in front, drop them until the first
+    // one that is still needed.
+    while(m_historycount > 0)
     {
-        worldtime = ((*worlditer).second).leveltime;
-        if(curtime - worldtime > SERVER_MAX_WORLD_AGE ||
-            ((*worlditer).second).worldid < lowestworldid)
-        {
-            //worlditer = m_history.erase(worlditer);
-            m_history.erase(worlditer++);
-        }
-        else
-        {
-            ++worlditer;
-        }
-    }
-
-    assert(m_history.size() < MAX_WORLD_BACKLOG);
-    if(m_history.size() >= MAX_WORLD_BACKLOG)
-    {
-        fprintf(stderr, "Server History Buffer too large. Reset History Buffer.\n");
-        m_history.clear();
+        world_state_t& oldest = m_history[m_historyfirst];
+        if(curtime - oldest.leveltime <= SERVER_MAX_WORLD_AGE &&
+           oldest.worldid >= lowestworldid)
+            break;
+        oldest.ClearObjStates(); // release the shared object states
+        m_historyfirst = (m_historyfirst + 1) % (int)m_history.size();
+        m_historycount--;
     }
 }
 
@@ -356,36 +409,58 @@ bool CServer::SendWorldToClient(CClientInfo* client)
 {
     if(client->got_challenge == false) // don't send this client until auth'd
         return true;
+    if(m_packets)
+        return SendPacketsToClient(client);
 
     ENetPacket* packet;
     int localobj = client->m_obj;
     m_stream.ResetWritePosition();
 
     CNetMsg::WriteHeader(&m_stream, NET_MSG_SERIALIZE_WORLD); // Writing Header
-    m_stream.WriteDWORD((uint32_t)localobj); // which object is linked to the player
-    client->hud.Serialize(true, &m_stream, NULL); // player head up display information
+    WriteClientHeader(client);
+    m_stream.WriteDWORD(0); // packet number: the whole snapshot is in this packet
 
-    std::map<uint32_t, world_state_t>::iterator iter;
-    iter = m_history.find(client->worldidACK);
-    if(iter == m_history.end())
+    const server_encode_t* encoded;
+    const world_state_t* baseline = GetHistory(client->worldidACK);
+    if(m_interest)
     {
-        m_world->Serialize(true, &m_stream, NULL);
+        // The client will not use a baseline older than these
+        uint32_t oldestbaseline = client->worldidACK;
+        if(m_historycount > 0)
+            oldestbaseline = std::max(oldestbaseline, m_history[m_historyfirst].worldid);
+        client->interest.Update(m_world, m_world->GetObj(localobj), oldestbaseline);
+
+        m_interestencode.baseline = baseline ? baseline->worldid : 0;
+        m_interestencode.stream.ResetWritePosition();
+        m_interestencode.changed = m_world->Serialize(true, &m_interestencode.stream, baseline, &client->interest);
+        m_encodemisses++;
+        encoded = &m_interestencode;
+        if(baseline && !encoded->changed)
+        {
+            client->worldidACK = m_world->GetWorldID();
+            return true;
+        }
+    }
+    else if(!baseline)
+    {
+        encoded = GetEncoded(NULL);
         //fprintf(stderr, "NET: Full update. Bytes to be send: %i (MTU: %i)\n",
                 //m_stream.GetBytesWritten(),
                 //client->GetPeer()->mtu);
     }
     else
     {
-        world_state_t diffstate = (*iter).second;
-        if(!m_world->Serialize(true, &m_stream, &diffstate))
+        encoded = GetEncoded(baseline);
+        if(!encoded->changed)
         {
             // No change since last update, client needs no update
             client->worldidACK = m_world->GetWorldID();
             return true;
         }
     }
+    m_stream.WriteStream(encoded->stream);
 
-    if(m_stream.GetWriteOverflow())
+    if(m_stream.GetWriteOverflow() || encoded->stream.GetWriteOverflow())
     {
         fprintf(stderr,
                 "Failed to send packet to client. Pending data too large: %i\n",
@@ -405,3 +480,144 @@ bool CServer::SendWorldToClient(CClientInfo* client)
     return enet_peer_send(client->GetPeer(), 0, packet) == 0;
 }
 
+void CServer::WriteClientHeader(CClientInfo* client)
+{
+    const CObj* obj = m_world->GetObj(client->m_obj);
+
+    m_stream.WriteDWORD((uint32_t)client->m_obj); // which object is linked to the player
+    client->hud.Serialize(true, &m_stream, NULL); // player head up display information
+
+    // The client prediction starts here and replays the newer commands.
+    // Full precision, so that the client gets the same result as the server.
+    m_stream.WriteDWORD(client->usercmdack);
+    m_stream.WriteVec3(obj ? obj->GetOrigin() : vec3_t::origin);
+    m_stream.WriteVec3(obj ? obj->GetVel() : vec3_t::origin);
+    m_stream.WriteBYTE((obj && obj->locGetIsOnGround()) ? 1 : 0);
+}
+
+bool CServer::SendPacketsToClient(CClientInfo* client)
+{
+    ENetPacket* packet;
+    const int localobj = client->m_obj;
+    const CObj* viewer = m_world->GetObj(localobj);
+
+    if(m_interest) // the scheduler needs only the current set, not the left objects
+        client->interest.Update(m_world, viewer, m_world->GetWorldID());
+    client->packets.Update(m_world, viewer, m_interest ? &client->interest : NULL);
+
+    while(true)
+    {
+        m_stream.ResetWritePosition();
+        CNetMsg::WriteHeader(&m_stream, NET_MSG_SERIALIZE_WORLD);
+        WriteClientHeader(client); // in every packet, the client might get only this one
+        if(!client->packets.WritePacket(m_world, &m_stream))
+            break;
+
+        // unreliable and sequenced: ENet drops packets older than the
+        // last one, the client never applies an old update.
+        packet = enet_packet_create(m_stream.GetBuffer(),
+                                    m_stream.GetBytesWritten(),
+                                    0);
+        assert(packet);
+        if(!packet)
+            return false;
+        if(enet_peer_send(client->GetPeer(), 0, packet) != 0)
+        {
+            enet_packet_destroy(packet);
+            return false;
+        }
+    }
+    return true;
+}
+
+void CServer::AddEventsToClients()
+{
+    const std::vector<world_event_t>& events = m_world->GetEvents();
+    const float maxdist2 = m_interestfar*m_interestfar;
+    std::map<int, CClientInfo*>::iterator iter;
+    size_t i;
+
+    for(iter = m_clientlist.begin();iter!=m_clientlist.end() && !events.empty();iter++)
+    {
+        CClientInfo* client = (*iter).second;
+        if(client->disconnected || !client->got_challenge)
+            continue;
+        // With the interest management, the client gets the events
+        // in the range of its objects.
+        const CObj* viewer = m_interest ? m_world->GetObj(client->m_obj) : NULL;
+        for(i=0;i<events.size();i++)
+        {
+            if(viewer && (events[i].origin - viewer->GetOrigin()).AbsSquared() > maxdist2)
+                continue;
+            client->events.Add(events[i], m_world->GetLeveltime());
+        }
+    }
+    m_world->ClearEvents();
+}
+
+bool CServer::SendEventsToClient(CClientInfo* client)
+{
+    if(client->disconnected || !client->got_challenge ||
+       !client->events.HasPending(m_world->GetLeveltime()))
+        return true;
+
+    ENetPacket* packet;
+    m_stream.ResetWritePosition();
+    CNetMsg::WriteHeader(&m_stream, NET_MSG_EVENTS);
+    client->events.Write(&m_stream, m_world->GetQuant());
+    if(m_stream.GetWriteOverflow())
+    {
+        assert(0);
+        return false;
+    }
+
+    // unreliable: the events are sent again, until the client has them.
+    // Channel 1, the world packets on channel 0 are sequenced.
+    packet = enet_packet_create(m_stream.GetBuffer(),
+                                m_stream.GetBytesWritten(),
+                                0);
+    assert(packet);
+    if(!packet)
+        return false;
+    if(enet_peer_send(client->GetPeer(), 1, packet) != 0)
+    {
+        enet_packet_destroy(packet); // ENet only owns the packet, if it is queued
+        return false;
+    }
+    return true;
+}
+
+const CServer::server_encode_t* CServer::GetEncoded(const world_state_t* baseline)
+{
+    const uint32_t baselineid = baseline ? baseline->worldid : 0;
+    server_encode_t* encoded;
+    int i;
+
+    if(m_encodeworldid != m_world->GetWorldID()) // new snapshot
+    {
+        m_encodeworldid = m_world->GetWorldID();
+        m_encodecount = 0;
+    }
+
+    for(i=0;i<m_encodecount;i++)
+    {
+        if(m_encodecache[i]->baseline == baselineid)
+        {
+            m_encodehits++;
+            return m_encodecache[i];
+        }
+    }
+
+    if(m_encodecount == (int)m_encodecache.size())
+    {
+        encoded = new server_encode_t;
+        encoded->stream.SetSize(MAX_SV_PACKETLEN);
+        m_encodecache.push_back(encoded);
+    }
+    encoded = m_encodecache[m_encodecount++];
+    encoded->baseline = baselineid;
+    encoded->stream.ResetWritePosition();
+    encoded->changed = m_world->Serialize(true, &encoded->stream, baseline);
+    m_encodemisses++;
+    return encoded;
+}
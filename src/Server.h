@@ -20,8 +20,18 @@ public:
     bool            Create(int port); // Start server on port
     void            Shutdown(); // Stop server
 
-    // Server business
+    // Server business: process network messages and send
+    // a snapshot to every client, if the update time has passed.
     void            Update(const float dt, const uint32_t ticks);
+    // Wait up to timeout ms for network messages and process them.
+    // Returns after the first message (or the timeout). The dedicated
+    // server sleeps here until the next tick. ticks is the simulation
+    // time, like in Update (not the wall clock).
+    void            Receive(const uint32_t timeout, const uint32_t ticks);
+
+    // Time between two snapshots in ms (sv_updatetime)
+    void            SetUpdateTime(const uint32_t updatetime) { m_updatetime = updatetime; }
+    uint32_t        GetUpdateTime() const { return m_updatetime; }
 
     // Manage client information
     CClientInfo*    GetClient(int id);
@@ -29,8 +39,23 @@ public:
     CLIENTITER      GetClientBegin() { return m_clientlist.begin(); }
     CLIENTITER      GetClientEnd() { return m_clientlist.end(); }
 
+    // Delta encoding cache: clients with the same baseline get the same
+    // world data, it is serialized only once per snapshot.
+    // Counters since the last ResetEncodeStats() call.
+    uint32_t        GetEncodeHits() const { return m_encodehits; } // world data taken from the cache
+    uint32_t        GetEncodeMisses() const { return m_encodemisses; } // world data serialized
+    void            ResetEncodeStats() { m_encodehits = 0; m_encodemisses = 0; }
+
 protected:
+    void OnEvent(ENetEvent* event, const uint32_t ticks);
     bool SendWorldToClient(CClientInfo* client);
+    bool SendPacketsToClient(CClientInfo* client); // see CPacketScheduler
+    // Queue the events of the world for the clients, that can see them
+    void AddEventsToClients();
+    bool SendEventsToClient(CClientInfo* client); // see CEventChannel
+    // Player data before the world in every world message: the linked object,
+    // the HUD, the last user command and the player movement after it.
+    void WriteClientHeader(CClientInfo* client);
     void OnReceive(CStream* stream, CClientInfo* client);
     void OnReceiveClientCtrl(CStream* stream, CClientInfo* client);
     void OnReceiveChallenge(CStream* stream, CClientInfo* client);
@@ -46,15 +71,54 @@ private:
     std::map<int, CClientInfo*> m_clientlist;
 
     // World History Buffer. Used for Q3 like delta compression.
-    std::map<uint32_t, world_state_t> m_history;
+    // Ring buffer with MAX_WORLD_BACKLOG slots, ordered by worldid.
+    // The slots are reused, unchanged objects share their state
+    // between the snapshots (see world_state_t).
+    std::vector<world_state_t> m_history;
+    int m_historyfirst; // slot of the oldest snapshot
+    int m_historycount; // number of snapshots in the buffer
+    void AddHistory(); // Add the current world state as newest snapshot
+    const world_state_t* GetHistory(uint32_t worldid) const; // NULL if not in the buffer
 
     uint32_t m_lastupdate;
+    uint32_t m_updatetime; // snapshot interval in ms
     CWorld* m_world;
 
     // We make this stream a member variable so that the server can reuse it
     // every frame. Otherwise we would have to new/delete 64k every frame.
     CStream m_stream;
 
+    // Serialized world data for one baseline of the current snapshot
+    struct server_encode_t
+    {
+        uint32_t baseline; // worldid of the baseline, 0 for a full update
+        bool changed; // false, if the world has not changed since the baseline
+        CStream stream;
+    };
+    // Get the world data for this baseline (NULL for a full update)
+    const server_encode_t* GetEncoded(const world_state_t* baseline);
+    std::vector<server_encode_t*> m_encodecache; // the first m_encodecount entries are valid
+    int m_encodecount;
+    uint32_t m_encodeworldid; // the cache belongs to this worldid
+    uint32_t m_encodehits;
+    uint32_t m_encodemisses;
+
+    // Interest management: every client gets only the objects near its
+    // player object (see CInterestSet). The world data is serialized for
+    // every client then, the encode cache is not used.
+    bool m_interest;
+    server_encode_t m_interestencode; // world data of the current client
+
+    // The world updates are sent in packets below the MTU, every
+    // client has its own CPacketScheduler. Otherwise every snapshot
+    // is one large packet (ENet fragments it).
+    bool m_packets;
+    int m_packetsize;
+    int m_packetbudget;
+    float m_interestnear;
+    float m_interestfar;
+    uint32_t m_interestlinger;
+
     // Rule of three
     CServer(const CServer&);
     CServer& operator=(const CServer&);
@@ -0,0 +1,225 @@
+#include <math.h>
+#include <algorithm> // sort, unique
+#include "SpatialHash.h"
+#include "FrameArena.h"
+#include "Obj.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+#define SPATIAL_HASH_KEYBITS        21 // bits per axis in the cell key
+#define SPATIAL_HASH_KEYBIAS        (1 << (SPATIAL_HASH_KEYBITS-1))
+#define SPATIAL_HASH_KEYMASK        ((1 << SPATIAL_HASH_KEYBITS)-1)
+
+CSpatialHash::CSpatialHash(const float cellsize)
+{
+    assert(cellsize > 0.0f);
+    m_cellsize = cellsize;
+    m_invcellsize = 1.0f/cellsize;
+    m_maxradius = 0.0f;
+}
+
+CSpatialHash::~CSpatialHash()
+{
+}
+
+void CSpatialHash::GetCellCoords(const vec3_t& p, int* x, int* y, int* z) const
+{
+    *x = (int)floorf(p.x*m_invcellsize);
+    *y = (int)floorf(p.y*m_invcellsize);
+    *z = (int)floorf(p.z*m_invcellsize);
+}
+
+uint64_t CSpatialHash::GetKey(int x, int y, int z)
+{
+    return ((uint64_t)((x + SPATIAL_HASH_KEYBIAS) & SPATIAL_HASH_KEYMASK)) |
+           ((uint64_t)((y + SPATIAL_HASH_KEYBIAS) & SPATIAL_HASH_KEYMASK) << SPATIAL_HASH_KEYBITS) |
+           ((uint64_t)((z + SPATIAL_HASH_KEYBIAS) & SPATIAL_HASH_KEYMASK) << (2*SPATIAL_HASH_KEYBITS));
+}
+
+uint64_t CSpatialHash::GetKey(const vec3_t& p) const
+{
+    int x, y, z;
+    GetCellCoords(p, &x, &y, &z);
+    return GetKey(x, y, z);
+}
+
+void CSpatialHash::Insert(CObj* obj)
+{
+    assert(!obj->m_ingrid);
+    if(obj->m_ingrid)
+        return;
+
+    obj->m_gridcell = GetKey(obj->GetOrigin());
+    obj->m_ingrid = true;
+    m_cells[obj->m_gridcell].push_back(obj);
+
+    if(obj->GetRadius() > m_maxradius)
+        m_maxradius = obj->GetRadius();
+}
+
+void CSpatialHash::Remove(CObj* obj)
+{
+    if(!obj->m_ingrid)
+        return;
+
+    SPATIAL_HASH_CELLITER celliter = m_cells.find(obj->m_gridcell);
+    assert(celliter != m_cells.end());
+    if(celliter != m_cells.end())
+    {
+        std::vector<CObj*>& cell = (*celliter).second;
+        std::vector<CObj*>::iterator iter = std::find(cell.begin(), cell.end(), obj);
+        assert(iter != cell.end());
+        if(iter != cell.end())
+        {
+            // order inside a cell does not matter
+            *iter = cell.back();
+            cell.pop_back();
+        }
+        // empty cells are kept, so that objects moving back and forth
+        // between two cells don't allocate memory all the time.
+    }
+    obj->m_ingrid = false;
+}
+
+void CSpatialHash::Update(CObj* obj)
+{
+    if(!obj->m_ingrid) // not (yet) part of the world
+        return;
+
+    if(obj->GetRadius() > m_maxradius)
+        m_maxradius = obj->GetRadius();
+
+    const uint64_t key = GetKey(obj->GetOrigin());
+    if(key == obj->m_gridcell)
+        return;
+
+    Remove(obj);
+    obj->m_gridcell = key;
+    obj->m_ingrid = true;
+    m_cells[key].push_back(obj);
+}
+
+void CSpatialHash::Clear()
+{
+    SPATIAL_HASH_CELLITER iter;
+    for(iter = m_cells.begin(); iter != m_cells.end(); ++iter)
+    {
+        std::vector<CObj*>& cell = (*iter).second;
+        for(size_t i=0;i<cell.size();i++)
+            cell[i]->m_ingrid = false;
+    }
+    m_cells.clear();
+    m_maxradius = 0.0f;
+}
+
+template<class A>
+void CSpatialHash::GatherBox(const int min[3], const int max[3], std::vector<CObj*, A>& result) const
+{
+    SPATIAL_HASH_CONSTCELLITER iter;
+    const int64_t boxcells = (int64_t)(max[0]-min[0]+1)*
+                             (int64_t)(max[1]-min[1]+1)*
+                             (int64_t)(max[2]-min[2]+1);
+
+    if(boxcells > (int64_t)m_cells.size())
+    {
+        // The box is larger than the number of occupied cells,
+        // so it is cheaper to visit every cell we have.
+        for(iter = m_cells.begin(); iter != m_cells.end(); ++iter)
+        {
+            const std::vector<CObj*>& cell = (*iter).second;
+            if(cell.size() < 1)
+                continue;
+            const uint64_t key = (*iter).first;
+            const int x = (int)(key & SPATIAL_HASH_KEYMASK) - SPATIAL_HASH_KEYBIAS;
+            const int y = (int)((key >> SPATIAL_HASH_KEYBITS) & SPATIAL_HASH_KEYMASK) - SPATIAL_HASH_KEYBIAS;
+            const int z = (int)((key >> (2*SPATIAL_HASH_KEYBITS)) & SPATIAL_HASH_KEYMASK) - SPATIAL_HASH_KEYBIAS;
+            if(x < min[0] || x > max[0] ||
+               y < min[1] || y > max[1] ||
+               z < min[2] || z > max[2])
+                continue;
+            result.insert(result.end(), cell.begin(), cell.end());
+        }
+        return;
+    }
+
+    int x, y, z;
+    for(x=min[0];x<=max[0];x++)
+    {
+        for(y=min[1];y<=max[1];y++)
+        {
+            for(z=min[2];z<=max[2];z++)
+            {
+                iter = m_cells.find(GetKey(x, y, z));
+                if(iter == m_cells.end())
+                    continue;
+                const std::vector<CObj*>& cell = (*iter).second;
+                result.insert(result.end(), cell.begin(), cell.end());
+            }
+        }
+    }
+}
+
+template<class A>
+void CSpatialHash::QuerySphere(const vec3_t& origin,
+                               const float radius,
+                               std::vector<CObj*, A>& result) const
+{
+    int min[3], max[3];
+    const vec3_t r(radius, radius, radius);
+
+    GetCellCoords(origin - r, &min[0], &min[1], &min[2]);
+    GetCellCoords(origin + r, &max[0], &max[1], &max[2]);
+    GatherBox(min, max, result);
+}
+
+// QuerySphere for the heap and for the frame arena
+template void CSpatialHash::QuerySphere(const vec3_t&, const float, std::vector<CObj*>&) const;
+template void CSpatialHash::QuerySphere(const vec3_t&, const float, std::vector<CObj*, CFrameAllocator<CObj*> >&) const;
+
+void CSpatialHash::QueryRay(const vec3_t& start,
+                            const vec3_t& dir,
+                            const float radius,
+                            std::vector<CObj*>& result) const
+{
+    // Walk along the ray in steps of one cell and collect the
+    // cells touched by the (padded) bounding box of every step.
+    std::vector<uint64_t> keys;
+    const float length = dir.Abs();
+    const int steps = (int)(length*m_invcellsize) + 1;
+    const vec3_t step = dir * (1.0f/(float)steps);
+    const vec3_t r(radius, radius, radius);
+    vec3_t a, b, boxmin, boxmax;
+    int min[3], max[3];
+    int i, x, y, z;
+
+    for(i=0;i<steps;i++)
+    {
+        a = start + step*(float)i;
+        b = a + step;
+        boxmin = vec3_t(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z) - r;
+        boxmax = vec3_t(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z) + r;
+        GetCellCoords(boxmin, &min[0], &min[1], &min[2]);
+        GetCellCoords(boxmax, &max[0], &max[1], &max[2]);
+        for(x=min[0];x<=max[0];x++)
+            for(y=min[1];y<=max[1];y++)
+                for(z=min[2];z<=max[2];z++)
+                    keys.push_back(GetKey(x, y, z));
+    }
+
+    // neighbouring steps share most of their cells
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    SPATIAL_HASH_CONSTCELLITER iter;
+    for(i=0;i<(int)keys.size();i++)
+    {
+        iter = m_cells.find(keys[i]);
+        if(iter == m_cells.end())
+            continue;
+        const std::vector<CObj*>& cell = (*iter).second;
+        result.insert(result.end(), cell.begin(), cell.end());
+    }
+}
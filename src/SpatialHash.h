@@ -0,0 +1,99 @@
+#pragma once
+
+class CObj;
+#include "lynx.h"
+#include "math/vec3.h"
+#include <vector>
+#ifdef __linux  // Linux
+  #include <unordered_map>
+#elif defined(__APPLE__) || defined(__APPLE_CC__) // Apple
+  #include <ext/hash_map>
+#else // the rest (Windows)
+  #include <hash_map>
+#endif
+
+/*
+    CSpatialHash is the broadphase for object queries in CWorld.
+
+    The world is divided into a uniform grid of cubic cells. Only cells
+    that contain objects are stored (in a hash map), so the grid has no
+    fixed bounds. Every object is stored in exactly one cell (the cell
+    of its origin). To find objects that overlap a query volume, the
+    query is padded by the largest object radius in the grid.
+
+    The queries return candidates. The caller has to do the exact
+    distance or intersection test.
+
+    CWorld keeps the grid in sync:
+     - Objects are inserted and removed in AddObj/UpdatePendingObjs.
+     - CObj::SetOrigin (and the network code) notify the world about
+       a new origin and the object is moved to another cell if needed.
+ */
+
+#define SPATIAL_HASH_CELLSIZE       16.0f // default cell size in world units
+
+// For the hash_map on Apple
+#if defined(__APPLE__) || defined(__APPLE_CC__) // Apple
+namespace stdext
+{
+    using namespace __gnu_cxx;
+}
+#endif
+
+#ifdef __linux
+  #define SPATIAL_HASH_CELLMAP      std::unordered_map<uint64_t, std::vector<CObj*> >
+  #define SPATIAL_HASH_CELLITER     std::unordered_map<uint64_t, std::vector<CObj*> >::iterator
+  #define SPATIAL_HASH_CONSTCELLITER std::unordered_map<uint64_t, std::vector<CObj*> >::const_iterator
+#else
+  #define SPATIAL_HASH_CELLMAP      stdext::hash_map<uint64_t, std::vector<CObj*> >
+  #define SPATIAL_HASH_CELLITER     stdext::hash_map<uint64_t, std::vector<CObj*> >::iterator
+  #define SPATIAL_HASH_CONSTCELLITER stdext::hash_map<uint64_t, std::vector<CObj*> >::const_iterator
+#endif
+
+class CSpatialHash
+{
+public:
+    CSpatialHash(const float cellsize=SPATIAL_HASH_CELLSIZE);
+    ~CSpatialHash();
+
+    void        Insert(CObj* obj); // add object to the cell of its origin
+    void        Remove(CObj* obj); // remove object from the grid
+    void        Update(CObj* obj); // object has moved: change cell if necessary
+    void        Clear();
+
+    // Largest radius of all objects that have been in the grid.
+    // Add this to the query radius, if the object radius counts.
+    float       GetMaxRadius() const { return m_maxradius; }
+
+    // Append every object in the cells touching the sphere to result.
+    // result can be a std::vector<CObj*> or a frame arena list
+    // (world_objlist_t, see FrameArena.h).
+    template<class A>
+    void        QuerySphere(const vec3_t& origin,
+                            const float radius,
+                            std::vector<CObj*, A>& result) const;
+
+    // Append every object in the cells touching the path from start
+    // to start+dir. The path is thickened by the radius.
+    void        QueryRay(const vec3_t& start,
+                         const vec3_t& dir,
+                         const float radius,
+                         std::vector<CObj*>& result) const;
+
+    int         GetCellCount() const { return (int)m_cells.size(); }
+
+protected:
+    uint64_t    GetKey(const vec3_t& p) const;
+    void        GetCellCoords(const vec3_t& p, int* x, int* y, int* z) const;
+    static uint64_t GetKey(int x, int y, int z);
+
+    // Append all objects from cells in the box mincell to maxcell
+    template<class A>
+    void        GatherBox(const int min[3], const int max[3], std::vector<CObj*, A>& result) const;
+
+private:
+    SPATIAL_HASH_CELLMAP m_cells;
+    float       m_cellsize;
+    float       m_invcellsize;
+    float       m_maxradius;
+};
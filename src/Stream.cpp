@@ -42,6 +42,10 @@ void CStream::Release()
     m_used = 0;
     m_writeoverflow = false;
     m_readoverflow = false;
+    m_writebitbyte = 0;
+    m_writebitcount = 0;
+    m_readbitbyte = 0;
+    m_readbitcount = 0;
 }
 
 // copy constructor
@@ -60,6 +64,10 @@ CStream::CStream(const CStream& c)
             m_used = c.m_used;
             m_readoverflow = c.m_readoverflow;
             m_writeoverflow = c.m_writeoverflow;
+            m_writebitbyte = c.m_writebitbyte;
+            m_writebitcount = c.m_writebitcount;
+            m_readbitbyte = c.m_readbitbyte;
+            m_readbitcount = c.m_readbitcount;
 
             m_buf = c.m_buf;
             // update the ref counter
@@ -152,6 +160,7 @@ void CStream::ResetWritePosition()
 {
     m_used = 0;
     m_writeoverflow = false;
+    m_writebitcount = 0;
 }
 
 bool CStream::GetReadOverflow() const
@@ -173,6 +182,7 @@ unsigned int CStream::GetBytesWritten() const
 void CStream::ResetReadPosition()
 {
     m_position = 0;
+    m_readbitcount = 0;
 }
 
 unsigned int CStream::GetBytesToRead() const
@@ -493,3 +503,246 @@ void CStream::ReadString(std::string* value)
     ReadAdvance(len);
 }
 
+// BIT FUNCTIONS ----------------------------------------
+
+unsigned int CStream::GetBitsWritten() const
+{
+    if(m_writebitcount > 0 && m_writebitbyte + 1 == m_used) // last byte is not full
+        return (m_used - 1)*8 + m_writebitcount;
+    return m_used*8;
+}
+
+void CStream::RewindWrite(unsigned int bitpos)
+{
+    assert(bitpos <= GetBitsWritten());
+    m_used = (bitpos + 7)/8;
+    m_writebitbyte = bitpos/8;
+    m_writebitcount = bitpos%8; // WriteBits keeps only the used bits of this byte
+    m_writeoverflow = false;
+}
+
+void CStream::WriteBits(uint32_t value, int bits)
+{
+    unsigned int byte; // first byte to write to
+    int shift; // bits already used in this byte
+    uint64_t acc;
+
+    assert(bits > 0 && bits <= 32);
+    if(m_writebitcount > 0 && m_writebitbyte + 1 == m_used) // continue the last byte
+    {
+        byte = m_writebitbyte;
+        shift = m_writebitcount;
+    }
+    else
+    {
+        byte = m_used;
+        shift = 0;
+    }
+
+    const unsigned int newused = byte + (shift + bits + 7)/8;
+    if(newused > m_size)
+    {
+        assert(0);
+        m_writeoverflow = true;
+        return;
+    }
+
+    // Write up to 5 bytes at once, the buffer has 8 bytes extra space
+    // (see SetSize). A foreign buffer gets the bytes one by one.
+    acc = (uint64_t)(m_buf->buffer[byte] & ((1u << shift) - 1)) |
+          ((uint64_t)value & ((1ull << bits) - 1)) << shift;
+    if(m_buf->ref > 0 || byte + sizeof(acc) <= m_size)
+    {
+        memcpy(m_buf->buffer + byte, &acc, sizeof(acc)); // little endian, like the rest of the stream
+    }
+    else
+    {
+        for(unsigned int i=byte;i<newused;i++,acc>>=8)
+            m_buf->buffer[i] = (uint8_t)acc;
+    }
+
+    m_used = newused;
+    m_writebitbyte = newused - 1;
+    m_writebitcount = (shift + bits) & 7;
+}
+
+void CStream::WriteVarBits(uint32_t value, int groupbits)
+{
+    assert(groupbits > 0 && groupbits < 32);
+    for(;;)
+    {
+        WriteBits(value, groupbits);
+        value >>= groupbits;
+        WriteBits(value ? 1 : 0, 1);
+        if(!value)
+            break;
+    }
+}
+
+int32_t CStream::Quantize(float value, int bits, int fracbits)
+{
+    const float maxvalue = (float)((1 << (bits-1)) - 1);
+    float q = floorf(value * (float)(1 << fracbits) + 0.5f);
+
+    assert(bits > 1 && bits <= 31 && fracbits >= 0 && fracbits < bits);
+    if(q > maxvalue)
+        q = maxvalue;
+    else if(q < -maxvalue)
+        q = -maxvalue;
+    return (int32_t)q;
+}
+
+void CStream::WriteFixed(float value, int bits, int fracbits)
+{
+    WriteBits((uint32_t)Quantize(value, bits, fracbits), bits);
+}
+
+// Smallest three: the largest component of a unit quaternion can be
+// computed from the other three. They are in the range +-1/sqrt(2).
+// q and -q are the same rotation, so the largest component is made positive.
+uint64_t CStream::QuantizeQuat(const quaternion_t& value, int bits)
+{
+    const float c[4] = { value.x, value.y, value.z, value.w };
+    const float scale = (float)((1 << bits) - 1);
+    uint64_t result;
+    float sign;
+    int largest = 0;
+    int i;
+
+    assert(bits > 1 && bits <= 16);
+    for(i=1;i<4;i++)
+    {
+        if(fabsf(c[i]) > fabsf(c[largest]))
+            largest = i;
+    }
+    sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+    result = (uint64_t)largest;
+    for(i=0;i<4;i++)
+    {
+        if(i == largest)
+            continue;
+        float v = (sign*c[i]*lynxmath::SQRT_2 + 1.0f)*0.5f; // 0 - 1
+        if(v < 0.0f)
+            v = 0.0f;
+        else if(v > 1.0f)
+            v = 1.0f;
+        result = (result << bits) | (uint64_t)(v*scale + 0.5f);
+    }
+    return result;
+}
+
+void CStream::WriteQuatSmallest3(const quaternion_t& value, int bits)
+{
+    const uint64_t q = QuantizeQuat(value, bits);
+    const int total = 2 + 3*bits;
+
+    if(total > 32)
+    {
+        WriteBits((uint32_t)q, 32);
+        WriteBits((uint32_t)(q >> 32), total - 32);
+    }
+    else
+    {
+        WriteBits((uint32_t)q, total);
+    }
+}
+
+uint32_t CStream::ReadBits(int bits)
+{
+    unsigned int byte; // first byte to read from
+    int shift; // bits already read from this byte
+    uint64_t acc = 0;
+
+    assert(bits > 0 && bits <= 32);
+    if(m_readbitcount > 0 && m_readbitbyte + 1 == m_position) // continue the last byte
+    {
+        byte = m_readbitbyte;
+        shift = m_readbitcount;
+    }
+    else
+    {
+        byte = m_position;
+        shift = 0;
+    }
+
+    const unsigned int newposition = byte + (shift + bits + 7)/8;
+    if(newposition > m_used)
+    {
+        m_readoverflow = true;
+        assert(0);
+        return 0;
+    }
+
+    if(byte + sizeof(acc) <= m_size)
+        memcpy(&acc, m_buf->buffer + byte, sizeof(acc));
+    else
+        memcpy(&acc, m_buf->buffer + byte, newposition - byte); // end of a foreign buffer
+
+    m_position = newposition;
+    m_readbitbyte = newposition - 1;
+    m_readbitcount = (shift + bits) & 7;
+    return (uint32_t)((acc >> shift) & ((1ull << bits) - 1));
+}
+
+uint32_t CStream::ReadVarBits(int groupbits)
+{
+    uint32_t value = 0;
+    int shift = 0;
+
+    assert(groupbits > 0 && groupbits < 32);
+    for(;;)
+    {
+        value |= ReadBits(groupbits) << shift;
+        shift += groupbits;
+        if(!ReadBits(1) || shift >= 32 || m_readoverflow)
+            break;
+    }
+    return value;
+}
+
+float CStream::ReadFixed(int bits, int fracbits)
+{
+    int32_t q = (int32_t)ReadBits(bits);
+
+    q = (int32_t)((uint32_t)q << (32 - bits)) >> (32 - bits); // sign extension
+    return (float)q / (float)(1 << fracbits);
+}
+
+void CStream::ReadQuatSmallest3(quaternion_t* value, int bits)
+{
+    const int total = 2 + 3*bits;
+    const float scale = 1.0f/(float)((1 << bits) - 1);
+    const uint64_t mask = (1u << bits) - 1;
+    float c[4];
+    float sum = 0.0f;
+    uint64_t q;
+    int largest;
+    int i;
+
+    if(total > 32)
+    {
+        q = ReadBits(32);
+        q |= (uint64_t)ReadBits(total - 32) << 32;
+    }
+    else
+    {
+        q = ReadBits(total);
+    }
+
+    largest = (int)(q >> (3*bits));
+    for(i=3;i>=0;i--)
+    {
+        if(i == largest)
+            continue;
+        c[i] = ((float)(q & mask)*scale*2.0f - 1.0f) * lynxmath::SQRT_2_HALF;
+        sum += c[i]*c[i];
+        q >>= bits;
+    }
+    c[largest] = sum < 1.0f ? sqrtf(1.0f - sum) : 0.0f;
+
+    value->x = c[0];
+    value->y = c[1];
+    value->z = c[2];
+    value->w = c[3];
+}
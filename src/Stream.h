@@ -76,6 +76,29 @@ public:
     void ReadBytes(uint8_t* values, int len);
     void ReadString(std::string* value);
 
+    // BIT FUNCTIONS
+    // The bits are packed into bytes, starting with the lowest bit.
+    // Bit and byte functions can be mixed: the next byte function
+    // starts at the next full byte. The same order has to be used for
+    // writing and reading.
+    void WriteBits(uint32_t value, int bits); // the lowest 1-32 bits of value
+    void WriteVarBits(uint32_t value, int groupbits); // groupbits at a time, followed by a "more" bit
+    void WriteFixed(float value, int bits, int fracbits); // signed fixed point number, see Quantize
+    void WriteQuatSmallest3(const quaternion_t& value, int bits); // unit quaternion, 2+3*bits bits
+    // Write position in bits. RewindWrite goes back to such a position
+    // and drops everything written after it.
+    unsigned int GetBitsWritten() const;
+    void RewindWrite(unsigned int bitpos);
+    uint32_t ReadBits(int bits);
+    uint32_t ReadVarBits(int groupbits);
+    float ReadFixed(int bits, int fracbits);
+    void ReadQuatSmallest3(quaternion_t* value, int bits);
+
+    // The number written by WriteFixed: value*2^fracbits, rounded and clamped to bits (with sign).
+    static int32_t Quantize(float value, int bits, int fracbits);
+    // The bits written by WriteQuatSmallest3: index of the largest component and the other three
+    static uint64_t QuantizeQuat(const quaternion_t& value, int bits);
+
 protected:
 
     struct stream_buffer_t
@@ -97,6 +120,10 @@ protected:
     unsigned int m_used;
     bool m_readoverflow; // if you try to read beyond the end of the buffer, this is set to true, until you reset the buffer
     bool m_writeoverflow; // the same for writing
+    unsigned int m_writebitbyte; // WriteBits fills this byte, if it is still the last byte written
+    int m_writebitcount; // bits used in m_writebitbyte, 0 if the byte is full
+    unsigned int m_readbitbyte; // the same for ReadBits
+    int m_readbitcount;
 
 private:
     CStream& operator=(const CStream&); // disable
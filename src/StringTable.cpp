@@ -0,0 +1,195 @@
+#include <assert.h>
+#include <stdio.h>
+#include "StringTable.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+CStringTable::CStringTable()
+{
+    Clear();
+}
+
+CStringTable::~CStringTable()
+{
+}
+
+void CStringTable::Clear()
+{
+    stringtable_entry_t empty;
+    empty.refcount = 0;
+    empty.added = 0;
+    empty.freed = 0;
+
+    m_entries.assign(1, empty); // id 0: ""
+    m_index.clear();
+    m_free.clear();
+    m_added.clear();
+}
+
+int CStringTable::Acquire(const std::string& str, uint32_t worldid, uint32_t leveltime)
+{
+    if(str.size() == 0)
+        return 0;
+
+    std::map<std::string, int>::const_iterator iter = m_index.find(str);
+    if(iter != m_index.end())
+    {
+        // A string without references is not in the full updates. If
+        // it is used again, it is new for the clients that came since.
+        if(m_entries[iter->second].refcount == 0)
+            AddRecord(iter->second, worldid, leveltime);
+        AddRef(iter->second); // might be in m_free, see below
+        return iter->second;
+    }
+
+    int id = 0;
+    while(m_free.size() > 0)
+    {
+        const int freeid = m_free.front();
+        stringtable_entry_t& entry = m_entries[freeid];
+        if(entry.refcount > 0) // used again in the meantime
+        {
+            m_free.pop_front();
+            continue;
+        }
+        if(leveltime - entry.freed < STRINGTABLE_REUSE_DELAY)
+            break;
+        m_free.pop_front();
+        m_index.erase(entry.str);
+        id = freeid;
+        break;
+    }
+    if(id == 0)
+    {
+        if((int)m_entries.size() > STRINGTABLE_MAX_ID)
+        {
+            fprintf(stderr, "String table full: %s\n", str.c_str());
+            assert(0);
+            return 0;
+        }
+        id = (int)m_entries.size();
+        m_entries.push_back(m_entries[0]);
+    }
+
+    stringtable_entry_t& entry = m_entries[id];
+    entry.str = str;
+    entry.refcount = 1;
+    entry.freed = 0;
+    m_index[str] = id;
+    AddRecord(id, worldid, leveltime);
+    return id;
+}
+
+void CStringTable::AddRecord(int id, uint32_t worldid, uint32_t leveltime)
+{
+    m_entries[id].added = worldid;
+
+    stringtable_added_t added;
+    added.worldid = worldid;
+    added.leveltime = leveltime;
+    added.id = id;
+    m_added.push_back(added);
+    while(leveltime - m_added.front().leveltime > STRINGTABLE_REUSE_DELAY)
+        m_added.pop_front();
+}
+
+void CStringTable::AddRef(int id)
+{
+    if(id <= 0 || id >= (int)m_entries.size())
+        return;
+    m_entries[id].refcount++;
+}
+
+void CStringTable::Release(int id, uint32_t leveltime)
+{
+    // the client table has no references
+    if(id <= 0 || id >= (int)m_entries.size() || m_entries[id].refcount == 0)
+        return;
+    if(--m_entries[id].refcount == 0)
+    {
+        m_entries[id].freed = leveltime;
+        m_free.push_back(id);
+    }
+}
+
+const std::string& CStringTable::Get(int id) const
+{
+    if(id <= 0 || id >= (int)m_entries.size())
+        return m_entries[0].str;
+    return m_entries[id].str;
+}
+
+uint32_t CStringTable::GetAdded(int id) const
+{
+    if(id <= 0 || id >= (int)m_entries.size())
+        return 0;
+    return m_entries[id].added;
+}
+
+void CStringTable::Write(CStream* stream, const std::vector<int>& ids) const
+{
+    for(size_t i=0;i<ids.size();i++)
+    {
+        stream->WriteBits(1, 1);
+        stream->WriteBits((uint32_t)ids[i], 16);
+        stream->WriteString(Get(ids[i]));
+    }
+    stream->WriteBits(0, 1);
+}
+
+bool CStringTable::Serialize(bool write, CStream* stream, uint32_t baselineid)
+{
+    bool changes = false;
+    int id;
+
+    // Every entry starts with a 1 bit, a 0 bit ends the list
+    if(write && baselineid == 0) // full update: every used entry
+    {
+        for(id=1;id<(int)m_entries.size();id++)
+        {
+            if(m_entries[id].refcount == 0)
+                continue;
+            stream->WriteBits(1, 1);
+            stream->WriteBits((uint32_t)id, 16);
+            stream->WriteString(m_entries[id].str);
+            changes = true;
+        }
+        stream->WriteBits(0, 1);
+    }
+    else if(write)
+    {
+        std::deque<stringtable_added_t>::const_reverse_iterator iter;
+        for(iter=m_added.rbegin();iter!=m_added.rend() && iter->worldid > baselineid;++iter)
+        {
+            const stringtable_entry_t& entry = m_entries[iter->id];
+            if(entry.refcount == 0 || entry.added != iter->worldid) // gone or reused
+                continue;
+            stream->WriteBits(1, 1);
+            stream->WriteBits((uint32_t)iter->id, 16);
+            stream->WriteString(entry.str);
+            changes = true;
+        }
+        stream->WriteBits(0, 1);
+    }
+    else
+    {
+        while(stream->ReadBits(1) && !stream->GetReadOverflow())
+        {
+            id = (int)stream->ReadBits(16);
+            if(id == 0)
+            {
+                assert(0);
+                return false;
+            }
+            if(id >= (int)m_entries.size())
+                m_entries.resize(id+1, m_entries[0]);
+            stream->ReadString(&m_entries[id].str);
+            changes = true;
+        }
+    }
+
+    return changes;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "lynx.h"
+#include "Stream.h"
+#include "ServerClient.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+
+/*
+    CStringTable holds the strings of the object state (resource and
+    particle system). obj_state_t only stores the string id, so the
+    snapshots compare and copy integers.
+
+    The server interns the strings and counts the references of the
+    objects. The table is sent to the clients with the world state,
+    but only the entries that are new since the baseline. The client
+    table is a copy, without reference counts.
+
+    An id without references is free again, but it is not reused for
+    STRINGTABLE_REUSE_DELAY ms: a baseline of a client could still
+    have an object with the old string under this id.
+
+    Id 0 is always the empty string.
+ */
+
+#define STRINGTABLE_MAX_ID          USHRT_MAX // ids are sent with 16 bits
+#define STRINGTABLE_REUSE_DELAY     (2*SERVER_MAX_WORLD_AGE) // ms, has to be longer than the server keeps snapshots
+
+class CStringTable
+{
+public:
+    CStringTable();
+    ~CStringTable();
+
+    // Server: Get the id of str and add a reference. New strings, and
+    // strings without references, are added with worldid (the first
+    // snapshot that can contain them).
+    int         Acquire(const std::string& str, uint32_t worldid, uint32_t leveltime);
+    void        AddRef(int id);
+    // Remove a reference. Ignored for unknown ids and on the client.
+    void        Release(int id, uint32_t leveltime);
+
+    const std::string& Get(int id) const; // "" for unknown ids
+    int         GetCount() const { return (int)m_entries.size(); } // highest id + 1
+    // worldid, when the string of id was added (0 for unknown ids). An id
+    // that is reused or used again gets a new value.
+    uint32_t    GetAdded(int id) const;
+
+    // Write the used entries that are newer than baselineid (0 = all),
+    // or read them into this table. Returns true if there was an entry.
+    bool        Serialize(bool write, CStream* stream, uint32_t baselineid);
+    // Write only these entries, Serialize can read them
+    void        Write(CStream* stream, const std::vector<int>& ids) const;
+
+    void        Clear(); // Forget everything
+
+private:
+    struct stringtable_entry_t
+    {
+        std::string str;
+        int         refcount;
+        uint32_t    added; // worldid of the first snapshot with this string
+        uint32_t    freed; // leveltime, when refcount dropped to 0
+    };
+
+    std::vector<stringtable_entry_t> m_entries; // index = id
+    std::map<std::string, int> m_index; // string to id
+    std::deque<int> m_free; // ids without references, oldest first
+
+    // New entries in the order of their worldid, so a delta only walks
+    // back to the baseline. Entries older than STRINGTABLE_REUSE_DELAY
+    // are dropped (no baseline is that old).
+    struct stringtable_added_t
+    {
+        uint32_t    worldid;
+        uint32_t    leveltime;
+        int         id;
+    };
+    std::deque<stringtable_added_t> m_added;
+    void        AddRecord(int id, uint32_t worldid, uint32_t leveltime); // set added of id
+};
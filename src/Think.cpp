@@ -1,10 +1,27 @@
 #include "Think.h"
+#include "JobSystem.h"
+#include "lynxsys.h"
 
 #ifdef _DEBUG
 #include <crtdbg.h>
 #define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
 #endif
 
+OBJPOOL_DEFINE(CThinkFunc)
+
+void CThinkFunc::SetThinktime(uint32_t newtime)
+{
+    thinktime = newtime;
+    if(m_heapindex >= 0)
+        m_owner->m_scheduler->Reschedule(this);
+}
+
+CThink::CThink(CThinkScheduler* scheduler)
+{
+    m_scheduler = scheduler;
+    m_first = NULL;
+}
+
 CThink::~CThink()
 {
     RemoveAll();
@@ -12,41 +29,280 @@ CThink::~CThink()
 
 void CThink::AddFunc(CThinkFunc* func)
 {
-    m_think.push_back(func);
+    assert(func && func->m_owner == NULL);
+    func->m_owner = this;
+    func->m_prev = NULL;
+    func->m_next = m_first;
+    if(m_first)
+        m_first->m_prev = func;
+    m_first = func;
+    m_scheduler->Insert(func);
 }
 
 void CThink::RemoveAll()
 {
-    std::list<CThinkFunc*>::iterator iter;
-    for(iter = m_think.begin(); iter != m_think.end(); iter++)
-        delete (*iter);
-    m_think.clear();
+    CThinkFunc* func;
+    while(m_first)
+    {
+        func = m_first;
+        Unlink(func);
+        m_scheduler->Release(func);
+    }
+}
+
+void CThink::Unlink(CThinkFunc* func)
+{
+    assert(func->m_owner == this);
+    if(func->m_prev)
+        func->m_prev->m_next = func->m_next;
+    else
+        m_first = func->m_next;
+    if(func->m_next)
+        func->m_next->m_prev = func->m_prev;
+    func->m_prev = NULL;
+    func->m_next = NULL;
+    func->m_owner = NULL;
+}
+
+CThinkScheduler::CThinkScheduler()
+{
+    m_seq = 0;
+    m_running = NULL;
+    m_runningremoved = false;
+    m_runcount = 0;
+    m_defercount = 0;
+}
+
+CThinkScheduler::~CThinkScheduler()
+{
+    assert(m_heap.size() == 0); // every object should be deleted by now
+}
+
+// Phase 1 of CThinkScheduler::Run
+class CThinkCalcJob : public CJob
+{
+public:
+    CThinkCalcJob(CThinkFunc* const* funcs, uint32_t leveltime) :
+        m_funcs(funcs), m_leveltime(leveltime) {}
+
+    virtual void Run(int begin, int end)
+    {
+        for(int i=begin;i<end;i++)
+            m_funcs[i]->Calc(m_leveltime);
+    }
+
+private:
+    CThinkFunc* const* m_funcs;
+    const uint32_t m_leveltime;
+};
+
+#define THINK_CALC_JOBSIZE       16 // thinkfuncs per job system batch
+
+void CThinkScheduler::Run(uint32_t leveltime, uint32_t budget, CJobSystem* jobsystem)
+{
+    const uint32_t startseq = m_seq;
+    const uint64_t starttime = budget > 0 ? CLynxSys::GetMicroseconds() : 0;
+    int count;
+
+    m_runcount = 0;
+    m_defercount = 0;
+    for(;;)
+    {
+        if(budget > 0 && m_runcount > 0 &&
+           CLynxSys::GetMicroseconds() - starttime >= budget)
+        {
+            m_defercount = CountDue(0, leveltime, startseq);
+            break;
+        }
+
+        count = FillBatch(leveltime, startseq);
+        if(count < 1)
+            break;
+
+        // The world does not change, while the thinkfuncs are calculated
+        CThinkCalcJob job(&m_batch[0], leveltime);
+        if(jobsystem && count > THINK_CALC_JOBSIZE)
+            jobsystem->ParallelFor(&job, count, THINK_CALC_JOBSIZE);
+        else
+            job.Run(0, count);
+
+        RunBatch(leveltime);
+    }
+
+    for(size_t i=0;i<m_parked.size();i++)
+    {
+        if(m_parked[i] == NULL) // removed by its owner
+            continue;
+        m_parked[i]->m_parkedindex = -1;
+        Push(m_parked[i]);
+    }
+    m_parked.clear();
+}
+
+int CThinkScheduler::FillBatch(uint32_t leveltime, uint32_t startseq)
+{
+    CThinkFunc* func;
+
+    m_batch.clear();
+    while(m_batch.size() < THINK_BATCHSIZE &&
+          m_heap.size() > 0 && m_heap[0]->GetThinktime() <= leveltime)
+    {
+        func = m_heap[0];
+        Remove(func);
+        if((int32_t)(func->m_seq - startseq) >= 0) // scheduled in this call: next call
+        {
+            func->m_parkedindex = (int)m_parked.size();
+            m_parked.push_back(func);
+            continue;
+        }
+        func->m_batchindex = (int)m_batch.size();
+        m_batch.push_back(func);
+    }
+    return (int)m_batch.size();
 }
 
-void CThink::DoThink(uint32_t leveltime)
+void CThinkScheduler::RunBatch(uint32_t leveltime)
 {
     CThinkFunc* func;
-    std::list<CThinkFunc*>::iterator iter;
-    for(iter = m_think.begin(); iter != m_think.end();)
+    bool done;
+
+    for(size_t i=0;i<m_batch.size();i++)
     {
-        func = (*m_think.begin());
-        if(func->GetThinktime() <= leveltime)
+        func = m_batch[i];
+        if(func == NULL) // removed by its owner during this batch
+            continue;
+        func->m_batchindex = -1;
+        m_runcount++;
+
+        m_running = func;
+        m_runningremoved = false;
+        done = func->DoThink(leveltime);
+        m_running = NULL;
+
+        if(m_runningremoved) // owner called RemoveAll
         {
-            if(func->DoThink(leveltime))
-            {
-                iter = m_think.erase(iter);
-                delete func;
-                func = NULL;
-            }
-            else
-            {
-                iter++;
-                assert(func->GetThinktime() >= leveltime); // next thinktime should not be in the past
-            }
+            delete func;
+        }
+        else if(done)
+        {
+            func->m_owner->Unlink(func);
+            delete func;
         }
         else
         {
-            iter++;
+            assert(func->GetThinktime() >= leveltime); // next thinktime should not be in the past
+            Insert(func);
         }
     }
+    m_batch.clear();
+}
+
+void CThinkScheduler::Insert(CThinkFunc* func)
+{
+    func->m_seq = m_seq++;
+    Push(func);
+}
+
+void CThinkScheduler::Push(CThinkFunc* func)
+{
+    assert(func->m_heapindex < 0);
+    m_heap.push_back(func);
+    Place(func, (int)m_heap.size()-1);
+    SiftUp(func->m_heapindex);
+}
+
+void CThinkScheduler::Remove(CThinkFunc* func)
+{
+    const int i = func->m_heapindex;
+    CThinkFunc* last;
+
+    assert(i >= 0 && i < (int)m_heap.size() && m_heap[i] == func);
+    last = m_heap.back();
+    m_heap.pop_back();
+    func->m_heapindex = -1;
+    if(last == func)
+        return;
+
+    Place(last, i);
+    SiftUp(i);
+    SiftDown(last->m_heapindex);
+}
+
+void CThinkScheduler::Release(CThinkFunc* func)
+{
+    if(func->m_heapindex >= 0)
+        Remove(func);
+    if(func->m_batchindex >= 0) // not executed yet
+    {
+        m_batch[func->m_batchindex] = NULL;
+        func->m_batchindex = -1;
+    }
+    if(func->m_parkedindex >= 0)
+    {
+        m_parked[func->m_parkedindex] = NULL;
+        func->m_parkedindex = -1;
+    }
+    if(func == m_running) // Run deletes it after DoThink
+        m_runningremoved = true;
+    else
+        delete func;
+}
+
+void CThinkScheduler::Reschedule(CThinkFunc* func)
+{
+    SiftUp(func->m_heapindex);
+    SiftDown(func->m_heapindex);
+}
+
+int CThinkScheduler::CountDue(int i, uint32_t leveltime, uint32_t startseq) const
+{
+    // the children of a heap node are never due before the node
+    if(i >= (int)m_heap.size() || m_heap[i]->GetThinktime() > leveltime)
+        return 0;
+    return ((int32_t)(m_heap[i]->m_seq - startseq) < 0 ? 1 : 0) +
+           CountDue(2*i+1, leveltime, startseq) + CountDue(2*i+2, leveltime, startseq);
+}
+
+bool CThinkScheduler::Less(const CThinkFunc* a, const CThinkFunc* b) const
+{
+    if(a->GetThinktime() != b->GetThinktime())
+        return a->GetThinktime() < b->GetThinktime();
+    return (int32_t)(a->m_seq - b->m_seq) < 0;
+}
+
+void CThinkScheduler::SiftUp(int i)
+{
+    CThinkFunc* func = m_heap[i];
+    int parent;
+
+    while(i > 0)
+    {
+        parent = (i-1)/2;
+        if(!Less(func, m_heap[parent]))
+            break;
+        Place(m_heap[parent], i);
+        i = parent;
+    }
+    Place(func, i);
+}
+
+void CThinkScheduler::SiftDown(int i)
+{
+    const int count = (int)m_heap.size();
+    CThinkFunc* func = m_heap[i];
+    int child;
+
+    for(;;)
+    {
+        child = 2*i+1;
+        if(child >= count)
+            break;
+        if(child+1 < count && Less(m_heap[child+1], m_heap[child]))
+            child++;
+        if(!Less(m_heap[child], func))
+            break;
+        Place(m_heap[child], i);
+        i = child;
+    }
+    Place(func, i);
 }
@@ -1,6 +1,14 @@
 #pragma once
 
-#include "Obj.h"
+#include "lynx.h"
+#include "ObjPool.h"
+#include <vector>
+
+class CWorld;
+class CJobSystem;
+class CObj;
+class CThink;
+class CThinkScheduler;
 
 /*
  * The idea of the think functions (thinkfunc) is that an
@@ -18,43 +26,144 @@
  *  The custom think function object "CThinkFuncRespawnZombie" is added
  *  to the list of think functions and will be executed in 9000 ms.
  *
+ * Every thinkfunc of the world is stored in one CThinkScheduler
+ * (CWorld::GetThinkScheduler()), sorted by thinktime. The game calls
+ * CThinkScheduler::Run every frame, only thinkfuncs that are due are
+ * touched. The thinkfunc objects come from a memory pool (ObjPool.h).
+ *
+ * Run works in two phases on a batch of due thinkfuncs:
+ *  1) Calc: runs for every thinkfunc of the batch at the same time on
+ *     the job system. Calc may read the world (it does not change
+ *     during this phase), but must only write members of its own
+ *     thinkfunc. No rand(), no new objects.
+ *  2) DoThink: runs on the calling thread in thinktime order and
+ *     applies the result of Calc to the object.
+ * Thinkfuncs without a Calc function do all their work in DoThink.
+ * The result does not depend on the number of threads.
+ *
  * */
 
 #define THINK_INTERVAL           50  // ms
+#define THINK_BATCHSIZE          256 // thinkfuncs per Calc phase
 
 class CThinkFunc
 {
+    OBJPOOL_DECLARE(CThinkFunc) // subclasses without extra members fit into a pool block
 public:
     CThinkFunc(uint32_t time, CWorld* world, CObj* obj)
     {
         thinktime = time;
         m_world = world;
         m_obj = obj;
+        m_owner = NULL;
+        m_prev = NULL;
+        m_next = NULL;
+        m_heapindex = -1;
+        m_batchindex = -1;
+        m_parkedindex = -1;
+        m_seq = 0;
     }
-    uint32_t GetThinktime() { return thinktime; }
-    void SetThinktime(uint32_t newtime) { thinktime = newtime; }
+    virtual ~CThinkFunc() {}
+    uint32_t GetThinktime() const { return thinktime; }
+    void SetThinktime(uint32_t newtime);
+    virtual void Calc(uint32_t leveltime) {} // phase 1, on a worker thread: read only
     virtual bool DoThink(uint32_t leveltime) = 0; // bei rckgabe von true wird diese thinkfunc entfernt
 
 protected:
     CWorld* GetWorld() { return m_world; }
     CObj* GetObj() { return m_obj; }
+    const CWorld* GetWorld() const { return m_world; }
+    const CObj* GetObj() const { return m_obj; }
 private:
     uint32_t thinktime;
     CWorld* m_world;
     CObj* m_obj;
+
+    // Managed by CThink and CThinkScheduler
+    CThink* m_owner;
+    CThinkFunc* m_prev; // list of the thinkfuncs of the owner
+    CThinkFunc* m_next;
+    int m_heapindex; // position in the scheduler heap, -1 if not in the heap
+    int m_batchindex; // position in the batch of CThinkScheduler::Run, -1 if not in the batch
+    int m_parkedindex; // position in CThinkScheduler::m_parked, -1 if not parked
+    uint32_t m_seq; // thinkfuncs with the same thinktime run in the order they were scheduled
+
+    friend class CThink;
+    friend class CThinkScheduler;
+
+    // Rule of three
+    CThinkFunc(const CThinkFunc&);
+    CThinkFunc& operator=(const CThinkFunc&);
 };
 
+// Every game object has a CThink object with its thinkfuncs
 class CThink
 {
 public:
+    CThink(CThinkScheduler* scheduler);
     ~CThink();
     void AddFunc(CThinkFunc* func); // neue thinkfunc hinzufgen
     void RemoveAll(); // alle thinkfuncs lschen
-    void DoThink(uint32_t leveltime); // alle thinkfuncs ausfhren
 private:
-    std::list<CThinkFunc*> m_think;
+    CThinkScheduler* m_scheduler;
+    CThinkFunc* m_first; // thinkfuncs of this object
+
+    void Unlink(CThinkFunc* func);
+
+    friend class CThinkFunc;
+    friend class CThinkScheduler;
 
     // Rule of three
+    CThink(const CThink&);
     CThink& operator=(const CThink&);
 };
 
+// Min-heap of every thinkfunc in the world, sorted by thinktime
+class CThinkScheduler
+{
+public:
+    CThinkScheduler();
+    ~CThinkScheduler();
+
+    // Execute every thinkfunc with thinktime <= leveltime. A thinkfunc,
+    // that is scheduled during this call, runs at the next call at the earliest.
+    // If budget (in us) is > 0, Run stops when the time is up. The due
+    // thinkfuncs that are left are the first ones in the next call.
+    // The budget is checked after every batch of THINK_BATCHSIZE thinkfuncs.
+    // The Calc phase runs on the jobsystem (or on this thread, if jobsystem is NULL).
+    void Run(uint32_t leveltime, uint32_t budget=0, CJobSystem* jobsystem=NULL);
+
+    int GetCount() const { return (int)m_heap.size(); } // pending thinkfuncs
+    int GetLastRunCount() const { return m_runcount; } // executed in the last Run call
+    int GetLastDeferCount() const { return m_defercount; } // due before the call, but left for the next call (budget)
+
+private:
+    std::vector<CThinkFunc*> m_heap;
+    std::vector<CThinkFunc*> m_batch; // due thinkfuncs of the current Calc phase, NULL if removed
+    std::vector<CThinkFunc*> m_parked; // scheduled during Run and already due, back to the heap after Run. NULL if removed
+    uint32_t m_seq; // incremented for every Insert
+    CThinkFunc* m_running; // thinkfunc in DoThink at the moment
+    bool m_runningremoved; // m_running was removed by its owner during DoThink
+    int m_runcount;
+    int m_defercount;
+
+    void Insert(CThinkFunc* func);
+    void Push(CThinkFunc* func); // Insert without a new m_seq
+    void Remove(CThinkFunc* func);
+    void Release(CThinkFunc* func); // remove from heap and delete func
+    void Reschedule(CThinkFunc* func); // thinktime has changed
+    bool Less(const CThinkFunc* a, const CThinkFunc* b) const;
+    int CountDue(int i, uint32_t leveltime, uint32_t startseq) const; // due thinkfuncs in the subtree of heap index i, scheduled before startseq
+    int FillBatch(uint32_t leveltime, uint32_t startseq); // move due thinkfuncs from the heap to m_batch
+    void RunBatch(uint32_t leveltime); // DoThink for every thinkfunc in m_batch
+    void SiftUp(int i);
+    void SiftDown(int i);
+    void Place(CThinkFunc* func, int i) { m_heap[i] = func; func->m_heapindex = i; }
+
+    friend class CThink;
+    friend class CThinkFunc;
+
+    // Rule of three
+    CThinkScheduler(const CThinkScheduler&);
+    CThinkScheduler& operator=(const CThinkScheduler&);
+};
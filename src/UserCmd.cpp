@@ -0,0 +1,168 @@
+#include <assert.h>
+#include <math.h>
+#include <algorithm> // min
+#include "UserCmd.h"
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK,__FILE__, __LINE__)
+#endif
+
+static uint32_t AngleToBits(float angle)
+{
+    return (uint32_t)(int)floorf(angle*(65536/360.0f) + 0.5f) & 65535;
+}
+
+static float BitsToAngle(uint32_t bits, bool wrap) // wrap: 0 to 360, otherwise -180 to 180
+{
+    if(wrap)
+        return (360.0f/65536) * (float)bits;
+    return (360.0f/65536) * (float)(int16_t)bits;
+}
+
+CUserCmdList::CUserCmdList()
+{
+    Clear();
+}
+
+CUserCmdList::~CUserCmdList()
+{
+}
+
+void CUserCmdList::Clear()
+{
+    for(int i=0;i<USERCMD_HISTORY;i++)
+    {
+        m_cmds[i].seq = 0;
+        m_cmds[i].buttons = 0;
+        m_cmds[i].lat = 0.0f;
+        m_cmds[i].lon = 0.0f;
+        m_cmds[i].msec = 0;
+        m_cmds[i].viewtime = 0;
+    }
+    m_pending.clear();
+    m_seq = 0;
+    m_lost = 0;
+}
+
+void CUserCmdList::Add(const usercmd_t& cmd)
+{
+    usercmd_t& newcmd = m_cmds[++m_seq % USERCMD_HISTORY];
+    newcmd = cmd;
+    newcmd.seq = m_seq;
+    newcmd.msec = std::min<uint32_t>(cmd.msec, USERCMD_MAX_MSEC);
+}
+
+const usercmd_t* CUserCmdList::GetCmd(uint32_t seq) const
+{
+    const usercmd_t& cmd = m_cmds[seq % USERCMD_HISTORY];
+    return (seq > 0 && cmd.seq == seq) ? &cmd : NULL;
+}
+
+void CUserCmdList::Serialize(bool write, CStream* stream)
+{
+    uint32_t count, i;
+
+    // The newest command first, the older ones only have the
+    // buttons and the angles, if they are different from the
+    // command after them. The time is in every command, the older
+    // view times are the difference to the command after them.
+    if(write)
+    {
+        count = std::min<uint32_t>(m_seq, USERCMD_BACKUP);
+        stream->WriteBits(count, USERCMD_COUNTBITS);
+        if(count == 0)
+            return;
+        stream->WriteBits(m_seq, 32);
+        const usercmd_t* next = NULL;
+        for(i=0;i<count;i++)
+        {
+            const usercmd_t& cmd = m_cmds[(m_seq - i) % USERCMD_HISTORY];
+            const uint32_t lat = AngleToBits(cmd.lat);
+            const uint32_t lon = AngleToBits(cmd.lon);
+            stream->WriteBits(cmd.msec, USERCMD_MSECBITS);
+            if(next)
+            {
+                const bool viewdelta = cmd.viewtime <= next->viewtime;
+                stream->WriteBits(viewdelta ? 1 : 0, 1);
+                if(viewdelta)
+                    stream->WriteVarBits(next->viewtime - cmd.viewtime, USERCMD_VIEWTIMEBITS);
+                else
+                    stream->WriteBits(cmd.viewtime, 32);
+                const bool samebuttons = cmd.buttons == next->buttons;
+                const bool sameangles = lat == AngleToBits(next->lat) && lon == AngleToBits(next->lon);
+                stream->WriteBits(samebuttons ? 1 : 0, 1);
+                if(!samebuttons)
+                    stream->WriteBits(cmd.buttons, USERCMD_BUTTONBITS);
+                stream->WriteBits(sameangles ? 1 : 0, 1);
+                if(sameangles)
+                {
+                    next = &cmd;
+                    continue;
+                }
+            }
+            else
+            {
+                stream->WriteBits(cmd.viewtime, 32);
+                stream->WriteBits(cmd.buttons, USERCMD_BUTTONBITS);
+            }
+            stream->WriteBits(lat, USERCMD_ANGLEBITS);
+            stream->WriteBits(lon, USERCMD_ANGLEBITS);
+            next = &cmd;
+        }
+    }
+    else
+    {
+        count = stream->ReadBits(USERCMD_COUNTBITS);
+        if(count == 0)
+            return;
+        if(count > USERCMD_BACKUP)
+        {
+            assert(0);
+            return;
+        }
+        const uint32_t seq = stream->ReadBits(32);
+        if(seq <= m_seq) // old or duplicate packet
+            return;
+        for(i=0;i<count;i++)
+        {
+            usercmd_t& cmd = m_cmds[i]; // newest first
+            cmd.seq = seq - i;
+            if(cmd.seq <= m_seq) // we have the rest, the list ends the message
+            {
+                count = i;
+                break;
+            }
+            cmd.msec = std::min<uint32_t>(stream->ReadBits(USERCMD_MSECBITS), USERCMD_MAX_MSEC);
+            if(i == 0 || !stream->ReadBits(1))
+                cmd.viewtime = stream->ReadBits(32);
+            else
+                cmd.viewtime = m_cmds[i-1].viewtime - stream->ReadVarBits(USERCMD_VIEWTIMEBITS);
+            if(i > 0 && stream->ReadBits(1))
+                cmd.buttons = m_cmds[i-1].buttons;
+            else
+                cmd.buttons = stream->ReadBits(USERCMD_BUTTONBITS);
+            if(i > 0 && stream->ReadBits(1))
+            {
+                cmd.lat = m_cmds[i-1].lat;
+                cmd.lon = m_cmds[i-1].lon;
+            }
+            else
+            {
+                cmd.lat = BitsToAngle(stream->ReadBits(USERCMD_ANGLEBITS), false);
+                cmd.lon = BitsToAngle(stream->ReadBits(USERCMD_ANGLEBITS), true);
+            }
+        }
+        if(stream->GetReadOverflow())
+            return;
+
+        // oldest first
+        if(m_seq > 0 && seq - m_seq > count)
+            m_lost += (int)(seq - m_seq - count);
+        for(i=count;i>0;i--)
+            m_pending.push_back(m_cmds[i-1]);
+        m_seq = seq;
+        if(m_pending.size() > USERCMD_MAX_PENDING)
+            m_pending.erase(m_pending.begin(), m_pending.end() - USERCMD_MAX_PENDING);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "lynx.h"
+#include "Stream.h"
+#include <vector>
+
+/*
+    CUserCmdList: the player input, that the client sends to the server
+    (see CClient::SendClientState and CServer::OnReceiveClientCtrl).
+
+    A user command has the buttons as bit mask and the view angles with
+    16 bits (the same steps as CLynx::AngleMod). Every command gets a
+    sequence number, the time the player moves with it (msec) and the
+    leveltime of the world the player has seen (viewtime, for the lag
+    compensation, see CLagCompensation). Every
+    client packet has the new command and the USERCMD_BACKUP-1 commands
+    before it, so a lost packet does not lose a button press: the server
+    takes the commands it has not seen yet from the next packet.
+
+    Client: Add() a command for every packet, then Serialize(true, ...).
+            The last USERCMD_HISTORY commands stay in GetCmd() for the
+            prediction (see CClient::Predict).
+    Server: Serialize(false, ...) for every packet, the new commands are
+            in GetPending() until ClearPending().
+ */
+
+#define USERCMD_FORWARD         (1 << 0)
+#define USERCMD_BACKWARD        (1 << 1)
+#define USERCMD_LEFT            (1 << 2)
+#define USERCMD_RIGHT           (1 << 3)
+#define USERCMD_JUMP            (1 << 4)
+#define USERCMD_FIRE            (1 << 5)
+#define USERCMD_ROCKET          (1 << 6) // select rocket launcher
+#define USERCMD_GUN             (1 << 7) // select gun
+#define USERCMD_BUTTONBITS      8
+
+#define USERCMD_ANGLEBITS       16
+#define USERCMD_MSECBITS        8
+#define USERCMD_VIEWTIMEBITS    4 // viewtime difference to the next command, groups of 4 bits
+#define USERCMD_MAX_MSEC        250 // longer commands are cut
+#define USERCMD_BACKUP          4 // commands in every client packet
+#define USERCMD_COUNTBITS       3 // for 0 to USERCMD_BACKUP commands
+#define USERCMD_MAX_PENDING     32 // the server drops older commands
+#define USERCMD_HISTORY         64 // client: commands kept for the prediction
+#define USERCMD_MAX_MOVETIME    0.5f // server: the commands can be this much ahead of the server time
+
+struct usercmd_t
+{
+    uint32_t    seq; // command number, the first command is 1
+    uint32_t    buttons; // USERCMD_* bits
+    float       lat; // view angles in degrees
+    float       lon;
+    uint32_t    msec; // movement time
+    uint32_t    viewtime; // leveltime of the rendered world, 0: unknown
+};
+
+class CUserCmdList
+{
+public:
+    CUserCmdList();
+    ~CUserCmdList();
+
+    void        Clear();
+
+    // Client: new command, cmd.seq is set to the next sequence number
+    void        Add(const usercmd_t& cmd);
+    // Client: command seq, NULL if it is not in the history
+    const usercmd_t* GetCmd(uint32_t seq) const;
+
+    // write: the newest commands, read: keep the new commands in the pending list.
+    // The reader stops at the first known command, so this has to be
+    // the last thing in the message.
+    void        Serialize(bool write, CStream* stream);
+
+    // Server: new commands since the last ClearPending(), oldest first
+    const std::vector<usercmd_t>& GetPending() const { return m_pending; }
+    void        ClearPending() { m_pending.clear(); }
+
+    uint32_t    GetSeq() const { return m_seq; } // newest command
+    int         GetLostCount() const { return m_lost; } // server: commands missing in every packet
+
+private:
+    usercmd_t   m_cmds[USERCMD_HISTORY]; // client: index seq % USERCMD_HISTORY, server: scratch for reading
+    std::vector<usercmd_t> m_pending;
+    uint32_t    m_seq;
+    int         m_lost;
+};
@@ -4,6 +4,7 @@
 #include "World.h"
 #include <math.h>
 #include <list>
+#include <algorithm> // sort, adjacent_find, binary_search
 #include "lynxsys.h"
 
 #ifdef _DEBUG
@@ -17,6 +18,11 @@ CWorld::CWorld() : m_resman(this)
     state.worldid = 0;
     m_leveltimestart = CLynxSys::GetTicks();
     state.leveltime = 0;
+    state.quant.originfrac = WORLD_QUANT_ORIGIN_FRAC;
+    state.quant.velfrac = WORLD_QUANT_VEL_FRAC;
+    state.quant.rotbits = WORLD_QUANT_ROT_BITS;
+    m_objawake = 0;
+    m_objsleeping = 0;
 }
 
 CWorld::~CWorld()
@@ -27,7 +33,7 @@ CWorld::~CWorld()
 void CWorld::Shutdown()
 {
     DeleteAllObjs();
-    assert(m_objlist.size()==0);
+    assert(GetObjCount()==0);
     assert(m_addobj.size()==0);
     assert(m_removeobj.size()==0);
 }
@@ -38,8 +44,16 @@ void CWorld::AddObj(CObj* obj, bool inthisframe)
     if(!obj)
         return;
 
+    assert(obj->GetWorld() == this); // see CObj::MarkChanged
+    if(obj->m_id == 0) // new object, not from the server
+        obj->m_id = m_objlist.Alloc();
+    obj->MarkChanged(OBJ_STATE_FULLUPDATE); // not in any older snapshot
+
     if(inthisframe)
-        m_objlist[obj->GetID()] = obj;
+    {
+        m_objlist.Insert(obj);
+        m_objgrid.Insert(obj);
+    }
     else
         m_addobj.push_back(obj);
 }
@@ -51,59 +65,80 @@ void CWorld::DelObj(int objid)
         m_removeobj.push_back(objid);
 }
 
-CObj* CWorld::GetObj(int objid)
-{
-    OBJITER iter;
-    iter = m_objlist.find(objid);
-    if(iter == m_objlist.end())
-        return NULL;
-    return (*iter).second;
-}
-
 void CWorld::DeleteAllObjs()
 {
-    OBJITER iter;
+    int i;
 
     UpdatePendingObjs(); // clear pending queues
-    for(iter = ObjBegin();iter!=ObjEnd();iter++)
-        delete (*iter).second;
-    m_objlist.clear();
+    m_objgrid.Clear();
+    for(i=0;i<GetObjCount();i++)
+        delete GetObjByIndex(i);
+    m_objlist.Clear();
+    m_lagcomp.Clear();
+    m_events.clear();
 }
 
 const std::vector<CObj*> CWorld::GetNearObj(const vec3_t& origin, const float radius, const int exclude, const int type) const
 {
-    // FIXME this function should use some sort of binary space partitioning
-    // naive implementation:
-    std::vector<CObj*> objlist;
+    world_objlist_t objlist(GetFrameArena());
+    GetNearObj(origin, radius, exclude, type, &objlist);
+    return std::vector<CObj*>(objlist.begin(), objlist.end());
+}
+
+const std::vector<CObj*> CWorld::GetNearObjByTypeList(const vec3_t& origin,
+                                                      const float radius,
+                                                      const int exclude,
+                                                      const std::vector<int>& objtypes) const
+{
+    world_objlist_t objlist(GetFrameArena());
+    if(objtypes.size() > 0)
+        GetNearObjByTypeList(origin, radius, exclude, &objtypes[0], (int)objtypes.size(), &objlist);
+    return std::vector<CObj*>(objlist.begin(), objlist.end());
+}
+
+void CWorld::GetNearObj(const vec3_t& origin,
+                        const float radius,
+                        const int exclude,
+                        const int type,
+                        world_objlist_t* result) const
+{
+    world_objlist_t candidates(GetFrameArena());
     const float radius2 = radius * radius;
     CObj* obj;
-    OBJITERCONST iter;
-    for(iter = m_objlist.begin();iter!=m_objlist.end();iter++)
+
+    m_objgrid.QuerySphere(origin, radius, candidates);
+    for(size_t i=0;i<candidates.size();i++)
     {
-        obj = (*iter).second;
+        obj = candidates[i];
         if(obj->GetFlags() & OBJ_FLAGS_GHOST)
             continue;
 
         if(obj->GetID() != exclude && (obj->GetOrigin() - origin).AbsSquared() < radius2 &&
             ((obj->GetType() == type) || type < 0 ))
-            objlist.push_back(obj);
+            result->push_back(obj);
     }
-    return objlist;
 }
 
 // Returns objects within radius, where the obj type is in objtypes array
-const std::vector<CObj*> CWorld::GetNearObjByTypeList(const vec3_t& origin,
-                                                      const float radius,
-                                                      const int exclude,
-                                                      const std::vector<int>& objtypes) const
+void CWorld::GetNearObjByTypeList(const vec3_t& origin,
+                                  const float radius,
+                                  const int exclude,
+                                  const int* objtypes,
+                                  const int objtypecount,
+                                  world_objlist_t* result) const
 {
-    // FIXME this function also should use some sort of binary space partitioning
-    // naive implementation:
-    std::vector<CObj*> objlist;
-    OBJITERCONST iter;
-    for(iter = m_objlist.begin(); iter != m_objlist.end(); iter++)
+    world_objlist_t candidates(GetFrameArena());
+    int k;
+
+    // The object radius counts here, so we have to look into cells
+    // up to the largest object radius away. AbsFast is an approximation,
+    // so we add a few percent to the search radius.
+    m_objgrid.QuerySphere(origin,
+                          (radius + m_objgrid.GetMaxRadius())*1.05f,
+                          candidates);
+    for(size_t i=0;i<candidates.size();i++)
     {
-        CObj* obj = (*iter).second;
+        CObj* obj = candidates[i];
         if(obj->GetFlags() & OBJ_FLAGS_GHOST) // ignore ghosts always
             continue;
 
@@ -113,29 +148,37 @@ const std::vector<CObj*> CWorld::GetNearObjByTypeList(const vec3_t& origin,
             continue;
         }
 
-        // STL really sometimes creates an unreadable mess.
-        // Check the objtypes vector, if the type is in the list.
+        // Check the objtypes array, if the type is in the list.
         // If yes, the caller wants this obj in the return list.
-        for(std::vector<int>::const_iterator typeiter = objtypes.begin();
-            typeiter != objtypes.end(); typeiter++)
+        for(k=0;k<objtypecount;k++)
         {
-            if(obj->GetType() == (*typeiter))
-                objlist.push_back(obj);
+            if(obj->GetType() == objtypes[k])
+                result->push_back(obj);
         }
     }
-    return objlist;
+}
+
+void CWorld::GetNearObjCandidates(const vec3_t& origin,
+                                  const float radius,
+                                  std::vector<CObj*>& result) const
+{
+    m_objgrid.QuerySphere(origin, radius + m_objgrid.GetMaxRadius(), result);
 }
 
 void CWorld::Update(const float dt, const uint32_t ticks)
 {
     if(!IsClient())
     {
+        m_lagcomp.Record(this); // the positions at the end of the last frame
         state.leveltime = ticks - m_leveltimestart;
         state.worldid++;
     }
 
     UpdatePendingObjs();
 
+    // End of the frame: the temporary data is not needed anymore
+    m_framearena.Reset();
+
     if(!m_bsptree.IsLoaded())
         return;
 }
@@ -172,22 +215,150 @@ const static vec3_t gravity(0, -GRAVITY, 0);
 
 void CWorld::ObjMove(CObj* obj, const float dt) const
 {
+    world_objmove_t move;
+
     if(obj->GetFlags() & OBJ_FLAGS_GHOST)
         return;
 
+    ObjMoveCalc(obj, dt, &move);
+    if(move.wallhit)
+        obj->OnHitWall(move.wallpos, move.wallnormal);
+    else if(move.objhit && GetObj(move.hitobj))
+        obj->OnHitObject(move.pos, GetObj(move.hitobj));
+    ObjMoveApply(obj, move);
+}
+
+// Runs ObjMoveCalc for a range of objects, used by ObjMoveAll
+class CObjMoveJob : public CJob
+{
+public:
+    CObjMoveJob(const CWorld* world, const float dt, world_objmove_t* moves) :
+        m_world(world), m_dt(dt), m_moves(moves) {}
+
+    virtual void Run(int begin, int end)
+    {
+        const CObjStore* store = m_world->GetObjStore();
+        const std::vector<vec3_t>& origins = store->GetOriginArray();
+        const std::vector<vec3_t>& vels = store->GetVelArray();
+        const std::vector<float>& radii = store->GetRadiusArray();
+        const std::vector<uint8_t>& flags = store->GetFlagsArray();
+
+        for(int i=begin;i<end;i++)
+        {
+            if(flags[i] & OBJ_FLAGS_GHOST)
+            {
+                m_moves[i].skip = true;
+                continue;
+            }
+            const CObj* obj = m_world->GetObjByIndex(i);
+            if(obj->locGetIsSleeping() || obj->locGetIsControlled())
+                m_moves[i].skip = true;
+            else
+                m_world->ObjMoveCalc(obj, origins[i], vels[i], radii[i], flags[i], m_dt, &m_moves[i]);
+        }
+    }
+
+private:
+    const CWorld* m_world;
+    const float m_dt;
+    world_objmove_t* m_moves;
+};
+
+#define OBJMOVE_BATCHSIZE      16 // objects per job system batch
+
+void CWorld::ObjMoveAll(const float dt, CJobSystem* jobsystem)
+{
+    const int objcount = GetObjCount();
+    int i;
+
+    m_objmoves.resize(objcount);
+    for(i=0;i<objcount;i++)
+        m_objmoves[i].skip = false;
+    if(objcount < 1)
+        return;
+
+    // 1) Collision detection, this is read-only for the world
+    CObjMoveJob job(this, dt, &m_objmoves[0]);
+    if(jobsystem)
+        jobsystem->ParallelFor(&job, objcount, OBJMOVE_BATCHSIZE);
+    else
+        job.Run(0, objcount);
+
+    // 2) Apply the new positions in object order
+    m_objawake = 0;
+    m_objsleeping = 0;
+    for(i=0;i<objcount;i++)
+    {
+        CObj* obj = GetObjByIndex(i);
+        if(!m_objmoves[i].skip)
+        {
+            ObjMoveApply(obj, m_objmoves[i]);
+            m_objawake++;
+        }
+        else if(obj->locGetIsSleeping())
+        {
+            m_objsleeping++;
+        }
+    }
+
+    // 3) Wall and object hit notifications, in object order.
+    // The callbacks can add and remove objects, but
+    // objcount and the order stay the same until UpdatePendingObjs.
+    for(i=0;i<objcount;i++)
+    {
+        const world_objmove_t& move = m_objmoves[i];
+        if(move.skip)
+            continue;
+        if(move.wallhit)
+            GetObjByIndex(i)->OnHitWall(move.wallpos, move.wallnormal);
+        else if(move.objhit && GetObj(move.hitobj))
+            GetObjByIndex(i)->OnHitObject(move.pos, GetObj(move.hitobj));
+    }
+}
+
+void CWorld::ObjMoveApply(CObj* obj, const world_objmove_t& move) const
+{
+    if(move.stuck)
+    {
+        if(move.unstuck)
+            fprintf(stderr, "Object successfully unstuck\n");
+        else
+            fprintf(stderr, "Failed to unstuck object\n");
+    }
+
+    obj->m_locIsOnGround = move.groundhit;
+    obj->SetOrigin(move.pos);
+    obj->SetVel(move.vel);
+
+    // Standing still on the ground: no need to move the
+    // object again, until someone changes its velocity.
+    // An object without gravity stays where it is anyway.
+    obj->m_locIsSleeping = move.vel == vec3_t::origin && !move.stuck &&
+                           (move.groundhit || (obj->GetFlags() & OBJ_FLAGS_NOGRAVITY));
+}
+
+void CWorld::ObjMoveCalc(const CObj* obj, const float dt, world_objmove_t* move) const
+{
+    ObjMoveCalc(obj, obj->GetOrigin(), obj->GetVel(), obj->GetRadius(), obj->GetFlags(), dt, move);
+}
+
+void CWorld::ObjMoveCalc(const CObj* obj, const vec3_t& origin, const vec3_t& velocity,
+                         const float radius, const uint8_t flags,
+                         const float dt, world_objmove_t* move) const
+{
     bool groundhit = false; // obj on ground?
     bool wallhit = false; // contact with level geometry
     plane_t wallplane;
 
     bsp_sphere_trace_t trace;
-    trace.radius = obj->GetRadius();
+    trace.radius = radius;
 
     // quake style movement clipping
-    vec3_t vel = obj->GetVel();
+    vec3_t vel = velocity;
     vel.MaxLength(MAX_VELOCITY); // the velocity is too damn high
 
     vec3_t planes[MAX_CLIP_PLANES];
-    vec3_t pos = obj->GetOrigin();
+    vec3_t pos = origin;
     vec3_t dir;
     float d;
     int numbumps = 4; // bump up to 4 times
@@ -310,12 +481,20 @@ void CWorld::ObjMove(CObj* obj, const float dt) const
         vel = vec3_t::origin;
     }
 
+    // Did we hit an object on the way? Then
+    // we stop there, before we reach the wall.
+    move->objhit = false;
+    if(obj->locGetHitsObjs() && ObjHitCalc(obj, origin, pos, move, &pos))
+        wallhit = false;
+
+    move->wallhit = wallhit;
     if(wallhit)
     {
-        obj->OnHitWall(pos, wallplane.m_n);
+        move->wallpos = pos;
+        move->wallnormal = wallplane.m_n;
     }
 
-    if(!(obj->GetFlags() & OBJ_FLAGS_NOGRAVITY)) // Objekt reagiert auf Gravity
+    if(!(flags & OBJ_FLAGS_NOGRAVITY)) // Objekt reagiert auf Gravity
     {
         if(groundhit)
         {
@@ -328,28 +507,94 @@ void CWorld::ObjMove(CObj* obj, const float dt) const
         }
     }
 
-    if(GetBSP()->IsSphereStuck(pos, obj->GetRadius()))
+    move->stuck = GetBSP()->IsSphereStuck(pos, radius);
+    move->unstuck = false;
+    if(move->stuck)
+    {
+        // OK something went wrong with our movement.
+        // pos is either the original position or some position from FindUnstuckPos()
+        move->unstuck = FindUnstuckPos(pos, radius, &pos);
+    }
+
+    move->skip = false;
+    move->groundhit = groundhit;
+    move->pos = pos;
+    move->vel = vel;
+}
+
+bool CWorld::ObjHitCalc(const CObj* obj, const vec3_t& start, const vec3_t& end,
+                        world_objmove_t* move, vec3_t* hitpos) const
+{
+    const vec3_t dir = end - start;
+    const float a = dir*dir;
+    float tmin = 2.0f; // path fraction of the first contact
+    float t, b, c, r, disc;
+    vec3_t m;
+    size_t i;
+
+    move->objhit = false;
+    move->hitobj = 0;
+    move->objcandidates.clear();
+    GetNearObjCandidates(start + dir*0.5f,
+                         dir.Abs()*0.5f + obj->GetRadius(),
+                         move->objcandidates);
+    for(i=0;i<move->objcandidates.size();i++)
     {
-        // OK something went wrong with our movement
-        obj->SetOrigin(pos);
-        if(TryUnstuck(obj))
+        const CObj* other = move->objcandidates[i];
+        if(other == obj ||
+           (other->GetFlags() & OBJ_FLAGS_GHOST) ||
+           !obj->CanHitObj(other))
+            continue;
+
+        // Find the smallest t in [0, 1] with
+        // |start + t*dir - other origin| = radius sum
+        m = start - other->GetOrigin();
+        r = obj->GetRadius() + other->GetRadius();
+        c = m*m - r*r;
+        if(c <= 0.0f) // touching already
         {
-            fprintf(stderr, "Object successfully unstuck\n");
+            t = 0.0f;
         }
         else
         {
-            fprintf(stderr, "Failed to unstuck object\n");
-            //assert(0); // uh oh, should not happen
+            b = m*dir;
+            if(b >= 0.0f) // not moving towards the other object
+                continue;
+            disc = b*b - a*c;
+            if(disc < 0.0f) // passing by
+                continue;
+            t = (-b - sqrtf(disc))/a;
+            if(t > 1.0f)
+                continue;
+        }
+
+        // same t: the lower id wins, the result must not
+        // depend on the order in the grid
+        if(t < tmin || (t == tmin && other->GetID() < move->hitobj))
+        {
+            tmin = t;
+            move->hitobj = other->GetID();
         }
-        pos = obj->GetOrigin(); // this is either the original position or some position from TryUnstuck()
     }
+    if(move->hitobj == 0)
+        return false;
 
-    obj->m_locIsOnGround = groundhit;
-    obj->SetOrigin(pos);
-    obj->SetVel(vel);
+    move->objhit = true;
+    *hitpos = start + dir*tmin;
+    return true;
 }
 
 bool CWorld::TryUnstuck(CObj* obj) const
+{
+    vec3_t pos;
+
+    if(!FindUnstuckPos(obj->GetOrigin(), obj->GetRadius(), &pos))
+        return false;
+    obj->SetOrigin(pos);
+    return true;
+}
+
+bool CWorld::FindUnstuckPos(const vec3_t& origin, const float radius, vec3_t* pos) const
 {
     static const vec3_t offset_table[] =
     {
@@ -363,7 +608,6 @@ bool CWorld::TryUnstuck(CObj* obj) const
         vec3_t( -1, -1,  1)
     };
     static const float offset_table_size = sizeof(offset_table)/sizeof(offset_table[0]);
-    const float radius = obj->GetRadius();
     const float radius_scale = radius * 0.1f;
     int i, j;
 
@@ -371,10 +615,10 @@ bool CWorld::TryUnstuck(CObj* obj) const
     {
         for(i=0;i<offset_table_size;i++)
         {
-            const vec3_t try_pos = obj->GetOrigin() + j * radius_scale * offset_table[i];
+            const vec3_t try_pos = origin + j * radius_scale * offset_table[i];
             if(!GetBSP()->IsSphereStuck(try_pos, radius))
             {
-                obj->SetOrigin(try_pos);
+                *pos = try_pos;
                 return true;
             }
         }
@@ -387,28 +631,40 @@ bool CWorld::TryUnstuck(CObj* obj) const
 // maxdist: max distance in world units.
 bool CWorld::TraceObj(world_obj_trace_t* trace, const float maxdist)
 {
-    OBJITER iter;
     float minf = MAX_TRACE_DIST;
     float cf;
     CObj* obj;
     CObj* pobjhit = NULL;
-
-    // baaaad method. this code tests every (!) object in the world.
-    // FIXME: use some space partitioning method to speed things up.
-    for(iter = ObjBegin(); iter != ObjEnd(); iter++)
+    vec3_t hitorigin;
+    std::vector<CObj*> candidates;
+
+    // Lag compensation: the objects are tested at their position at
+    // rewindtime. They can be up to MAX_VELOCITY*rewind away from there.
+    const bool rewind = trace->rewindtime > 0 && trace->rewindtime < GetLeveltime();
+    float queryradius = m_objgrid.GetMaxRadius();
+    if(rewind)
+        queryradius += MAX_VELOCITY*(float)(GetLeveltime() - trace->rewindtime)*0.001f;
+
+    // only test the objects in the grid cells along the ray
+    m_objgrid.QueryRay(trace->start,
+                       trace->dir.Normalized() * maxdist,
+                       queryradius,
+                       candidates);
+    for(size_t i=0;i<candidates.size();i++)
     {
-        obj = (*iter).second;
+        obj = candidates[i];
 
         if(obj->GetID() == trace->excludeobj_id ||  // normally the player that shoots
            obj->GetFlags() & OBJ_FLAGS_GHOST ||     // ghost objects are not traceable
            obj->GetRadius() == 0.0f)                // 0 radius objects too
             continue;
 
-        if((obj->GetOrigin() - trace->start).AbsFast() > maxdist) // object is too far away
+        const vec3_t origin = rewind ? m_lagcomp.GetOrigin(obj, trace->rewindtime) : obj->GetOrigin();
+        if((origin - trace->start).AbsFast() > maxdist) // object is too far away
             continue;
 
         if(!vec3_t::RaySphereIntersect(trace->start, trace->dir,
-                                   obj->GetOrigin(), obj->GetRadius(),
+                                   origin, obj->GetRadius(),
                                    &cf))
         {
             continue;
@@ -417,6 +673,7 @@ bool CWorld::TraceObj(world_obj_trace_t* trace, const float maxdist)
         if(cf >= 0.0f && cf < minf)
         {
             pobjhit = obj;
+            hitorigin = origin;
             minf = cf;
         }
     }
@@ -428,7 +685,7 @@ bool CWorld::TraceObj(world_obj_trace_t* trace, const float maxdist)
     else // we have hit an object
     {
         trace->hitpoint = trace->start + minf*trace->dir;
-        trace->hitnormal = (trace->hitpoint - pobjhit->GetOrigin()).Normalized();
+        trace->hitnormal = (trace->hitpoint - hitorigin).Normalized();
         trace->hitobj = pobjhit;
     }
 
@@ -462,19 +719,29 @@ bool CWorld::TraceObj(world_obj_trace_t* trace, const float maxdist)
     }
 }
 
+bool CWorld::IsLineOfSight(const vec3_t& start, const vec3_t& end) const
+{
+    if(!m_bsptree.IsLoaded())
+        return true;
+    return !m_bsptree.IsLineBlocked(start, end);
+}
+
 void CWorld::UpdatePendingObjs()
 {
     if(m_removeobj.size() > 0)
     {
         // remove objects from queue
         std::list<int>::iterator remiter;
-        OBJITER iter;
+        CObj* obj;
         for(remiter=m_removeobj.begin();remiter!=m_removeobj.end();remiter++)
         {
-            iter = m_objlist.find((*remiter));
-            assert(iter != m_objlist.end());
-            delete (*iter).second;
-            m_objlist.erase(iter);
+            obj = GetObj(*remiter);
+            assert(obj);
+            if(!obj)
+                continue;
+            m_objgrid.Remove(obj);
+            m_objlist.Remove(*remiter);
+            delete obj;
         }
         m_removeobj.clear();
     }
@@ -486,7 +753,8 @@ void CWorld::UpdatePendingObjs()
         for(additer=m_addobj.begin();additer!=m_addobj.end();additer++)
         {
             assert(GetObj((*additer)->GetID()) == NULL);
-            m_objlist[(*additer)->GetID()] = (*additer);
+            m_objlist.Insert(*additer);
+            m_objgrid.Insert(*additer);
         }
         m_addobj.clear();
     }
@@ -500,70 +768,148 @@ bool CWorld::LoadLevel(const std::string path)
     return success;
 }
 
+void CWorld::SetQuant(const world_quant_t& quant)
+{
+    // CStream::Quantize works with up to 31 bits,
+    // CStream::QuantizeQuat with up to 16 bits per component.
+    state.quant.originfrac = (uint8_t)std::min((int)quant.originfrac, 16);
+    state.quant.velfrac = (uint8_t)std::min((int)quant.velfrac, 16);
+    state.quant.rotbits = (uint8_t)std::max(4, std::min((int)quant.rotbits, 16));
+}
+
 // DELTA COMPRESSION CODE ------------------------------------
 
 #define WORLD_STATE_WORLDID         (1 <<  0)
 #define WORLD_STATE_LEVELTIME       (1 <<  1)
 #define WORLD_STATE_LEVEL           (1 <<  2)
+#define WORLD_STATE_QUANT           (1 <<  3)
 
 #define WORLD_STATE_NO_REAL_CHANGE  (WORLD_STATE_WORLDID|WORLD_STATE_LEVELTIME) // worldid und leveltime ändern sich sowieso immer
-#define WORLD_STATE_FULLUPDATE      ((1 <<  3)-1)
+#define WORLD_STATE_FULLUPDATE      ((1 <<  4)-1)
+
+void CWorld::SerializeHeader(CStream* stream, const world_state_t* oldstate, int* changes)
+{
+    uint32_t updateflags = 0;
+    CStream tempstream = stream->GetShallowCopy(); // save this position, so we can write here the updateflags a few lines later
+    stream->WriteAdvance(sizeof(uint32_t));
+
+    // Write to tempstream to check for updateflags
+    DeltaDiffDWORD(&state.worldid   , oldstate ? &oldstate->worldid : NULL   , WORLD_STATE_WORLDID   , &updateflags , stream);
+    DeltaDiffDWORD(&state.leveltime , oldstate ? &oldstate->leveltime : NULL , WORLD_STATE_LEVELTIME , &updateflags , stream);
+    DeltaDiffString(&state.level    , oldstate ? &oldstate->level : NULL     , WORLD_STATE_LEVEL     , &updateflags , stream);
+    DeltaDiffBytes((const uint8_t*)&state.quant, oldstate ? (const uint8_t*)&oldstate->quant : NULL, WORLD_STATE_QUANT, &updateflags, stream, sizeof(world_quant_t));
+    // [NEW ATTRIBUTES HERE]
+
+    if(updateflags > WORLD_STATE_NO_REAL_CHANGE)
+        (*changes)++;
+
+    assert(oldstate ? 1 : (updateflags == WORLD_STATE_FULLUPDATE)); // this has to be enforced
+    tempstream.WriteDWORD(updateflags); // Now we know the updateflags and can write them to the saved position
+}
 
-bool CWorld::Serialize(bool write, CStream* stream, const world_state_t* oldstate)
+bool CWorld::SerializePartial(CStream* stream, const std::vector<int>& strings, const CStream& objlists)
+{
+    int changes = 0;
+    SerializeHeader(stream, NULL, &changes);
+    GetStringTable()->Write(stream, strings);
+    stream->WriteDWORD(WORLD_PARTIAL_UPDATE);
+    stream->WriteStream(objlists); // starts at a full byte, like the lists after the DWORD
+    return !stream->GetWriteOverflow();
+}
+
+bool CWorld::Serialize(bool write, CStream* stream, const world_state_t* oldstate,
+                       const CInterestSet* interest)
 {
     assert(stream);
     CObj* obj;
-    OBJITER iter;
+    int i;
     int changes = 0;
     if(!stream)
         return false;
 
     if(write)
     {
-        uint32_t updateflags = 0;
-        CStream tempstream = stream->GetShallowCopy(); // save this position, so we can write here the updateflags a few lines later
-        stream->WriteAdvance(sizeof(uint32_t));
-
-        // Write to tempstream to check for updateflags
-        DeltaDiffDWORD(&state.worldid   , oldstate ? &oldstate->worldid : NULL   , WORLD_STATE_WORLDID   , &updateflags , stream);
-        DeltaDiffDWORD(&state.leveltime , oldstate ? &oldstate->leveltime : NULL , WORLD_STATE_LEVELTIME , &updateflags , stream);
-        DeltaDiffString(&state.level    , oldstate ? &oldstate->level : NULL     , WORLD_STATE_LEVEL     , &updateflags , stream);
-        // [NEW ATTRIBUTES HERE]
+        SerializeHeader(stream, oldstate, &changes);
 
-        if(updateflags > WORLD_STATE_NO_REAL_CHANGE)
+        // String table entries for the objects, that are new since the baseline
+        if(GetStringTable()->Serialize(true, stream, oldstate ? oldstate->worldid : 0))
             changes++;
 
-        assert(oldstate ? 1 : (updateflags == WORLD_STATE_FULLUPDATE)); // this has to be enforced
-        tempstream.WriteDWORD(updateflags); // Now we know the updateflags and can write them to the saved position
-
-        // Write all objects
-        stream->WriteDWORD((uint32_t)GetObjCount());
+        // Objects: three lists relative to the baseline, every entry
+        // starts with a 1 bit, a 0 bit ends the list.
+        //  - removed: ids of baseline objects that are gone
+        //  - created: objects not in the baseline, full state
+        //  - changed: baseline objects with a new state, delta only
+        // Unchanged objects cost nothing. The client applies the
+        // snapshot to its newest world, not to the baseline, so it
+        // needs the baseline worldid to drop objects it got after the
+        // baseline that are gone now (0 = full update).
+        stream->WriteDWORD(oldstate ? oldstate->worldid : 0);
+
+        if(interest)
+        {
+            SerializeInterest(stream, oldstate, interest, &changes);
+            return (changes > 0) && !stream->GetWriteOverflow();
+        }
 
-        obj_state_t obj_oldstate;
-        obj_state_t* p_obj_oldstate;
-        for(iter = m_objlist.begin();iter!=m_objlist.end();iter++)
+        if(oldstate)
         {
-            obj = (*iter).second;
-            p_obj_oldstate = NULL;
-            if(oldstate) // Delta Compression
+            WORLD_STATE_CONSTOBJITER iter;
+            for(iter=oldstate->ObjBegin();iter!=oldstate->ObjEnd();++iter)
             {
-                if(oldstate->ObjStateExists(obj->GetID()))
-                {
-                    oldstate->GetObjState(obj->GetID(), obj_oldstate);
-                    p_obj_oldstate = &obj_oldstate;
-                }
+                if(GetObj(iter->first))
+                    continue;
+                stream->WriteBits(1, 1);
+                stream->WriteBits((uint32_t)iter->first, 32);
+                changes++;
             }
-            stream->WriteDWORD(obj->GetID());
-            if(obj->Serialize(true, stream, obj->GetID(), p_obj_oldstate))
+        }
+        stream->WriteBits(0, 1);
+
+        // The filters only read the hot field arrays, an unchanged
+        // object is not touched at all.
+        const std::vector<int>& ids = m_objlist.GetIDArray();
+        const std::vector<uint32_t>& changed = m_objlist.GetChangedArray();
+
+        for(i=0;i<GetObjCount();i++)
+        {
+            // untouched since the baseline: in the baseline (see AddObj)
+            if(oldstate && (changed[i] <= oldstate->worldid ||
+                            oldstate->ObjStateExists(ids[i])))
+                continue;
+            obj = GetObjByIndex(i);
+            stream->WriteBits(1, 1);
+            stream->WriteBits((uint32_t)obj->GetID(), 32);
+            obj->Serialize(true, stream, obj->GetID());
+            changes++;
+        }
+        stream->WriteBits(0, 1);
+
+        if(oldstate)
+        {
+            const obj_state_t* p_obj_oldstate;
+            for(i=0;i<GetObjCount();i++)
+            {
+                if(changed[i] <= oldstate->worldid)
+                    continue;
+                p_obj_oldstate = oldstate->FindObjState(ids[i]);
+                if(!p_obj_oldstate) // in the created list
+                    continue;
+                obj = GetObjByIndex(i);
+                stream->WriteBits(1, 1);
+                stream->WriteBits((uint32_t)obj->GetID(), 32);
+                obj->Serialize(true, stream, obj->GetID(), p_obj_oldstate, oldstate->worldid, oldstate->leveltime);
                 changes++;
+            }
         }
+        stream->WriteBits(0, 1);
     }
     else
     {
         uint32_t updateflags;
         uint32_t worldid;
         std::string level;
-        uint32_t objcount;
+        uint32_t baseline;
         uint32_t objid;
 
         stream->ReadDWORD(&updateflags);
@@ -595,84 +941,218 @@ bool CWorld::Serialize(bool write, CStream* stream, const world_state_t* oldstat
                 }
             }
         }
+        if(updateflags & WORLD_STATE_QUANT)
+            stream->ReadBytes((uint8_t*)&state.quant, sizeof(world_quant_t));
         // new attributes here
         if(updateflags > WORLD_STATE_NO_REAL_CHANGE)
             changes++;
 
-        stream->ReadDWORD(&objcount);
-        // objread contains all read objects. every object that is not here, has
-        // to be deleted
-        std::map<int,int> objread;
-        for(unsigned int i=0;i<objcount;i++)
+        if(GetStringTable()->Serialize(false, stream, 0))
+            changes++;
+
+        stream->ReadDWORD(&baseline);
+        assert(baseline < worldid || baseline == WORLD_PARTIAL_UPDATE);
+
+        std::vector<int, CFrameAllocator<int> > removed(GetFrameArena());
+        while(stream->ReadBits(1) && !stream->GetReadOverflow()) // removed
         {
-            stream->ReadDWORD(&objid);
-            obj = GetObj(objid);
-            if(!obj)
+            objid = stream->ReadBits(32);
+            if(GetObj(objid)) // might be gone already, if we are ahead of the baseline
             {
-                obj = new CObj(this);
-                changes += obj->Serialize(false, stream, objid) ? 1 : 0;
-                AddObj(obj);
+                DelObj(objid);
+                removed.push_back(objid);
+            }
+            changes++;
+        }
+
+        // created contains all objects that are not in the baseline.
+        std::vector<int, CFrameAllocator<int> > created(GetFrameArena());
+        for(int list=0;list<2;list++) // created, changed
+        {
+            while(stream->ReadBits(1) && !stream->GetReadOverflow())
+            {
+                objid = stream->ReadBits(32);
+                obj = GetObj(objid);
+                if(!obj)
+                {
+                    obj = new CObj(this);
+                    obj->m_firstworldid = worldid;
+                    changes += obj->Serialize(false, stream, objid) ? 1 : 0;
+                    AddObj(obj);
+                }
+                else
+                    changes += obj->Serialize(false, stream, objid) ? 1 : 0;
+                if(list == 0)
+                    created.push_back(objid);
+                obj->AddNetBase(worldid, state.leveltime); // base for predicted origins
             }
-            else
-                changes += obj->Serialize(false, stream, objid) ? 1 : 0;
-            assert(objread.find(objid) == objread.end()); // is not supposed to be already in stream
-            objread[obj->GetID()] = obj->GetID();
         }
-        // Delete all objects that are not in the latest state
-        for(iter=m_objlist.begin();iter!=m_objlist.end();iter++)
+
+        // Objects we got after the baseline, that are not in the
+        // created list, have been removed in the meantime.
+        // A partial update has no baseline: the objects that are
+        // not in the lists stay.
+        if(baseline == WORLD_PARTIAL_UPDATE)
+            created.clear();
+        std::sort(created.begin(), created.end());
+        assert(std::adjacent_find(created.begin(), created.end()) == created.end()); // is not supposed to be already in stream
+        std::sort(removed.begin(), removed.end());
+        for(i=0;i<GetObjCount() && baseline != WORLD_PARTIAL_UPDATE;i++)
         {
-            obj = (*iter).second;
-            if(objread.find(obj->GetID()) != objread.end())
+            obj = GetObjByIndex(i);
+            if(obj->m_firstworldid <= baseline ||
+               std::binary_search(created.begin(), created.end(), obj->GetID()) ||
+               std::binary_search(removed.begin(), removed.end(), obj->GetID())) // DelObj only once
                 continue;
             DelObj(obj->GetID());
+            changes++;
         }
 
+        // After a complete update, every object has the state of the
+        // server and the server can use it as base.
+        for(i=0;i<GetObjCount() && baseline != WORLD_PARTIAL_UPDATE;i++)
+            GetObjByIndex(i)->AddNetBase(worldid, state.leveltime);
+
         UpdatePendingObjs();
     }
 
     return (changes > 0) && !stream->GetWriteOverflow() && !stream->GetReadOverflow();
 }
 
-world_state_t CWorld::GetWorldState()
+void CWorld::SerializeInterest(CStream* stream, const world_state_t* oldstate,
+                               const CInterestSet* interest, int* changes)
 {
-    world_state_t worldstate = state;
+    const uint32_t baseline = oldstate ? oldstate->worldid : 0;
+    const std::vector<interest_obj_t>& objs = interest->GetObjs();
+    const std::vector<interest_left_t>& left = interest->GetLeft();
+    const obj_state_t* p_obj_oldstate;
+    CObj* obj;
+    size_t i;
 
-    assert(worldstate.GetObjCount() == 0);
+    // removed: in the set at the baseline, but not anymore
+    for(i=0;i<left.size() && oldstate;i++)
+    {
+        if(left[i].left <= baseline)
+            continue;
+        // The client drops objects it got after the baseline by itself,
+        // but the snapshot has to be sent.
+        (*changes)++;
+        if(left[i].entered > baseline || interest->GetEntered(left[i].id) > 0)
+            continue;
+        stream->WriteBits(1, 1);
+        stream->WriteBits((uint32_t)left[i].id, 32);
+    }
+    stream->WriteBits(0, 1);
 
-    OBJITER iter;
-    for(iter = m_objlist.begin();iter!=m_objlist.end();iter++)
+    // created: entered the set after the baseline. The client might
+    // still know the object from an earlier visit, the full state
+    // overwrites it.
+    for(i=0;i<objs.size();i++)
     {
-        CObj* obj = (*iter).second;
-        worldstate.AddObjState(obj->GetObjState(), obj->GetID());
+        if(oldstate && objs[i].entered <= baseline)
+            continue;
+        obj = GetObj(objs[i].id);
+        if(!obj)
+            continue;
+        stream->WriteBits(1, 1);
+        stream->WriteBits((uint32_t)obj->GetID(), 32);
+        obj->Serialize(true, stream, obj->GetID());
+        (*changes)++;
     }
+    stream->WriteBits(0, 1);
 
+    // changed: in the set at the baseline
+    for(i=0;i<objs.size() && oldstate;i++)
+    {
+        if(objs[i].entered > baseline)
+            continue;
+        obj = GetObj(objs[i].id);
+        if(!obj || obj->m_changed <= baseline)
+            continue;
+        p_obj_oldstate = oldstate->FindObjState(obj->GetID());
+        stream->WriteBits(1, 1);
+        stream->WriteBits((uint32_t)obj->GetID(), 32);
+        if(p_obj_oldstate)
+            obj->Serialize(true, stream, obj->GetID(), p_obj_oldstate, baseline, oldstate->leveltime);
+        else
+            obj->Serialize(true, stream, obj->GetID());
+        (*changes)++;
+    }
+    stream->WriteBits(0, 1);
+}
+
+world_state_t CWorld::GetWorldState()
+{
+    world_state_t worldstate;
+    GetWorldState(&worldstate);
     return worldstate;
 }
 
+static bool WorldObjStateLess(const world_objstate_t& a, const world_objstate_t& b)
+{
+    return a.first < b.first;
+}
+
+void CWorld::GetWorldState(world_state_t* worldstate)
+{
+    worldstate->leveltime = state.leveltime;
+    worldstate->worldid = state.worldid;
+    worldstate->level = state.level;
+    worldstate->quant = state.quant;
+
+    // Unchanged objects share their state with the last snapshot
+    const std::vector<int>& ids = m_objlist.GetIDArray();
+    worldstate->objstates.resize(GetObjCount());
+    for(int i=0;i<GetObjCount();i++)
+    {
+        CObj* obj = GetObjByIndex(i);
+        worldstate->objstates[i].first = ids[i];
+        worldstate->objstates[i].second = obj->GetSharedState();
+    }
+    std::sort(worldstate->objstates.begin(), worldstate->objstates.end(), WorldObjStateLess);
+}
+
 // world_state_t struct methods for managed and secure access
 
 void world_state_t::AddObjState(obj_state_t objstate, const int id)
 {
     assert(!ObjStateExists(id));
-    objstates.push_back(objstate);
-    objindex[id] = (int)objstates.size()-1;
+    world_objstate_t entry(id, std::make_shared<obj_state_t>(objstate));
+    objstates.insert(std::lower_bound(objstates.begin(), objstates.end(), entry, WorldObjStateLess), entry);
 }
 
 bool world_state_t::ObjStateExists(const int id) const
 {
-    WORLD_STATE_CONSTOBJITER indexiter = objindex.find(id);
-    return indexiter != objindex.end();
+    return FindObjState(id) != NULL;
 }
 
 bool world_state_t::GetObjState(const int id, obj_state_t& objstate) const
 {
-    WORLD_STATE_CONSTOBJITER indexiter = objindex.find(id);
-    if(indexiter == objindex.end())
+    const obj_state_t* found = FindObjState(id);
+    if(!found)
         return false;
-    objstate = objstates[indexiter->second];
+    objstate = *found;
     return true;
 }
 
+const obj_state_t* world_state_t::FindObjState(const int id) const
+{
+    // binary search, objstates is sorted by id
+    int lo = 0;
+    int hi = (int)objstates.size();
+    while(lo < hi)
+    {
+        const int mid = (lo + hi) / 2;
+        if(objstates[mid].first < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if(lo < (int)objstates.size() && objstates[lo].first == id)
+        return objstates[lo].second.get();
+    return NULL;
+}
+
 // --------------------------------------------------
 // CPlayerInfo
 // --------------------------------------------------
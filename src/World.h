@@ -2,17 +2,19 @@
 
 class CWorld;
 #include <map>
-#ifdef __linux  // Linux
-  #include <unordered_map>
-#elif defined(__APPLE__) || defined(__APPLE_CC__) // Apple
-  #include <ext/hash_map>
-#else // the rest (Windows)
-  #include <hash_map>
-#endif
 #include <list>
+#include <memory>
 #include "Obj.h"
 #include "BSPLevel.h"
 #include "ResourceManager.h"
+#include "SpatialHash.h"
+#include "ObjStore.h"
+#include "JobSystem.h"
+#include "Think.h"
+#include "FrameArena.h"
+#include "StringTable.h"
+#include "Interest.h"
+#include "LagCompensation.h"
 
 /*
     CWorld is the core of the Lynx engine.
@@ -44,31 +46,13 @@ class CWorld;
     - Serialize
  */
 
-// For the hash_map on Apple
-#if defined(__APPLE__) || defined(__APPLE_CC__) // Apple
-namespace stdext
-{
-    using namespace __gnu_cxx;
-}
-#endif
-
-#ifdef __linux
-  #define WORLD_STATE_OBJMAPTYPE    std::unordered_map<int, int>
-  #define WORLD_STATE_OBJITER       std::unordered_map<int, int>::iterator
-  #define WORLD_STATE_CONSTOBJITER  std::unordered_map<int, int>::const_iterator
-  // STL types for our object storage
-  #define OBJMAPTYPE                std::unordered_map<int, CObj*>
-  #define OBJITER                   std::unordered_map<int, CObj*>::iterator
-  #define OBJITERCONST              std::unordered_map<int, CObj*>::const_iterator
-#else
-  #define WORLD_STATE_OBJMAPTYPE    stdext::hash_map<int, int>
-  #define WORLD_STATE_OBJITER       stdext::hash_map<int, int>::iterator
-  #define WORLD_STATE_CONSTOBJITER  stdext::hash_map<int, int>::const_iterator
-  // STL types for our object storage
-  #define OBJMAPTYPE                stdext::hash_map<int, CObj*>
-  #define OBJITER                   stdext::hash_map<int, CObj*>::iterator
-  #define OBJITERCONST              stdext::hash_map<int, CObj*>::const_iterator
-#endif
+// Baseline worldid of a partial update (see CWorld::SerializePartial)
+#define WORLD_PARTIAL_UPDATE      0xffffffff
+
+// Object list of a world_state_t: (obj id, state) pairs, sorted by id
+typedef std::pair<int, std::shared_ptr<const obj_state_t> > world_objstate_t;
+#define WORLD_STATE_OBJITER       std::vector<world_objstate_t>::iterator
+#define WORLD_STATE_CONSTOBJITER  std::vector<world_objstate_t>::const_iterator
 
 // CPlayerInfo and world_player_t (name, score, ping, team etc.):
 // These data structures are used as a property of a world.
@@ -122,46 +106,74 @@ namespace stdext
  *};
  */
 
+// Precision of the object state in a snapshot (see CObj::Serialize).
+// origin and velocity are sent as signed fixed point numbers, the
+// rotation as the three smallest components of the quaternion.
+// The server sends this with the world state, the client needs it
+// to read the objects.
+#define WORLD_QUANT_ORIGIN_INTBITS  12 // range +-2048 units
+#define WORLD_QUANT_VEL_INTBITS     9  // range +-256 units/s
+#define WORLD_QUANT_ORIGIN_FRAC     6  // default precision 1/64 unit
+#define WORLD_QUANT_VEL_FRAC        5  // default precision 1/32 unit/s
+#define WORLD_QUANT_ROT_BITS        10 // default bits per quaternion component
+
+struct world_quant_t
+{
+    uint8_t     originfrac; // fraction bits of origin
+    uint8_t     velfrac; // fraction bits of vel
+    uint8_t     rotbits; // bits per quaternion component
+
+    int         GetOriginBits() const { return WORLD_QUANT_ORIGIN_INTBITS + originfrac; }
+    int         GetVelBits() const { return WORLD_QUANT_VEL_INTBITS + velfrac; }
+};
+
 // Essential game engine struct: world_state_t
 // This struct holds one complete snapshot of the game.
 //
 // Everything to describe the current state of the game
 // is stored in this struct.
-// The objstates vector contains all the objects.
-// The objindex is a map to the objstates vector
-// indices.
-// E.g. you have the OBJID of an object,
-// then you can access the obj_state_t in this way:
-//
-//  objstates[objindex[OBJID]]
+// The objstates vector contains all the objects, sorted
+// by the object id (binary search for FindObjState).
+// The obj_state_t itself is immutable and shared: an object
+// that has not changed since the last snapshot points to the
+// same obj_state_t in both snapshots (see CObj::GetSharedState).
 
 struct world_state_t
 {
     uint32_t    leveltime;  // time in [ms]
     uint32_t    worldid;    // worldid increments every frame, unique identifier
     std::string level;      // path to .lbsp level file
+    world_quant_t quant;    // precision of the objects in a snapshot
     //CPlayerInfo playerinfo; // current active players (name, score, ping)
 
     void        AddObjState(obj_state_t objstate, const int id);
     bool        ObjStateExists(const int id) const;
     bool        GetObjState(const int id, obj_state_t& objstate) const;
-    WORLD_STATE_OBJITER ObjBegin() { return objindex.begin(); }
-    WORLD_STATE_OBJITER ObjEnd() { return objindex.end(); }
+    const obj_state_t* FindObjState(const int id) const; // NULL if not found, no copy
+    void        ClearObjStates() { objstates.clear(); } // keeps the capacity
+    WORLD_STATE_OBJITER ObjBegin() { return objstates.begin(); }
+    WORLD_STATE_OBJITER ObjEnd() { return objstates.end(); }
+    WORLD_STATE_CONSTOBJITER ObjBegin() const { return objstates.begin(); }
+    WORLD_STATE_CONSTOBJITER ObjEnd() const { return objstates.end(); }
     int         GetObjCount() const { return (int)objstates.size(); }
 
 protected:
-    std::vector<obj_state_t> objstates; // List with all objects
-    WORLD_STATE_OBJMAPTYPE objindex; // ID to objstates index table. Key = obj id, value = index in objstates table
+    std::vector<world_objstate_t> objstates; // List with all objects, sorted by id
+
+    friend class CWorld;
 };
 
 // world_obj_trace_t:
 // Search for objects hit by a ray, used by the CWorld::TraceObj function
 struct world_obj_trace_t
 {
+    world_obj_trace_t() : rewindtime(0), hitobj(NULL) { }
+
     // Input
     vec3_t  start; // start point
     vec3_t  dir; // end point = start + dir
     int     excludeobj_id; // Which object id should be ignored
+    uint32_t rewindtime; // test the objects at this leveltime (lag compensation), 0: current positions
 
     // Output
     vec3_t  hitpoint;
@@ -169,6 +181,43 @@ struct world_obj_trace_t
     CObj*   hitobj; // NULL, if no object was hit
 };
 
+// world_event_t:
+// One-shot sound or particle effect of the server. The effects are not
+// objects in the snapshots, they are sent to every client with its
+// CEventChannel.
+#define WORLD_EVENT_SOUND         0 // name: path of the .ogg file
+#define WORLD_EVENT_PARTICLES     1 // name: particle system (see CParticleSystem::CreateSystem), dir and size
+struct world_event_t
+{
+    int         type; // WORLD_EVENT_*
+    std::string name;
+    vec3_t      origin;
+    vec3_t      dir;
+    float       size;
+    uint32_t    lifetime; // ms, the client removes the effect after this time
+};
+
+// world_objmove_t:
+// Result of the collision detection for one object (CWorld::ObjMoveCalc)
+struct world_objmove_t
+{
+    vec3_t  pos; // new origin
+    vec3_t  vel; // new velocity
+    bool    groundhit; // object is on the ground
+    bool    wallhit; // OnHitWall(wallpos, wallnormal) has to be called
+    vec3_t  wallpos;
+    vec3_t  wallnormal;
+    bool    stuck; // object was stuck in the level geometry
+    bool    unstuck; // and we found a free position
+    bool    skip; // object was not moved (ghost or sleeping)
+    bool    objhit; // OnHitObject(pos, hitobj) has to be called
+    int     hitobj;
+    std::vector<CObj*> objcandidates; // broadphase result, the memory is reused every frame
+};
+
+// List of objects in the frame arena, only valid until the end of CWorld::Update
+typedef std::vector<CObj*, CFrameAllocator<CObj*> > world_objlist_t;
+
 class CWorld
 {
 public:
@@ -182,15 +231,26 @@ public:
 
     virtual void    Update(const float dt, const uint32_t ticks); // Calculate a new frame.
 
-    void            AddObj(CObj* obj, bool inthisframe=false); // Add object to world. World will free the memory of CObj*.
+    // Add object to world. World will free the memory of CObj*.
+    // A new object gets its id here (if it has no id from the server).
+    void            AddObj(CObj* obj, bool inthisframe=false);
     void            DelObj(int objid); // Remove object from the world. Get deleted at the end of the frame.
 
-    CObj*           GetObj(int objid); // Search for object with this id.
+    CObj*           GetObj(int objid) const { return m_objlist.Get(objid); } // Search for object with this id.
+
+    // Called by CObj, if the origin or radius has changed.
+    // Keeps the broadphase (m_objgrid) up to date.
+    void            OnObjMoved(CObj* obj) { m_objgrid.Update(obj); }
+    // Called by CObj::MarkChanged. Keeps the hot fields in m_objlist up to date.
+    void            OnObjChanged(const CObj* obj) { m_objlist.UpdateHot(obj); }
+    // Read access to the hot field arrays, see ObjStore.h
+    const CObjStore* GetObjStore() const { return &m_objlist; }
 
     // Number of currently active objects. Including ghost objects.
-    int             GetObjCount() const { return (int)m_objlist.size(); }
-    OBJITER         ObjBegin() { return m_objlist.begin(); } // Begin Iterator
-    OBJITER         ObjEnd() { return m_objlist.end(); } // End Iterator
+    // Objects are stored without holes, loop with an index from 0 to GetObjCount()-1.
+    // Objects added with AddObj(obj, true) are appended to the end.
+    int             GetObjCount() const { return m_objlist.GetCount(); }
+    CObj*           GetObjByIndex(int i) const { return m_objlist.GetByIndex(i); }
 
     // Get objects within radius and the specific type, or every object if type is < 0
     const std::vector<CObj*> GetNearObj(const vec3_t& origin,
@@ -204,44 +264,146 @@ public:
                                                   const int exclude,
                                                   const std::vector<int>& objtypes) const;
 
+    // Same as above, but the result is appended to a list in the frame
+    // arena (no heap allocation): world_objlist_t list(GetFrameArena());
+    void            GetNearObj(const vec3_t& origin,
+                               const float radius,
+                               const int exclude,
+                               const int type,
+                               world_objlist_t* result) const;
+    void            GetNearObjByTypeList(const vec3_t& origin,
+                                         const float radius,
+                                         const int exclude,
+                                         const int* objtypes,
+                                         const int objtypecount,
+                                         world_objlist_t* result) const;
+
+    // Memory for temporary data of this frame. Reset at the end of Update().
+    CFrameArena*    GetFrameArena() const { return &m_framearena; }
+
+    // Appends every object that could touch the sphere at origin to result.
+    // The object radius counts, the caller has to do the exact test.
+    // Does not allocate, if result has enough capacity.
+    void            GetNearObjCandidates(const vec3_t& origin,
+                                         const float radius,
+                                         std::vector<CObj*>& result) const;
+
     // Serialize the world state to a byte stream.
     // Returns true if the world has changed compared to the oldstate.
-    virtual bool    Serialize(bool write, CStream* stream, const world_state_t* oldstate=NULL);
+    // With an interest set, only the objects in the set are written
+    // (server only, see CInterestSet).
+    virtual bool    Serialize(bool write, CStream* stream, const world_state_t* oldstate=NULL,
+                              const CInterestSet* interest=NULL);
+    // Partial update for the packet scheduler: the world header, the
+    // string table entries strings and objlists (the removed, created
+    // and changed lists of Serialize, written by CPacketScheduler).
+    // The client reads it with Serialize and keeps every object that
+    // is not in the lists.
+    bool            SerializePartial(CStream* stream, const std::vector<int>& strings, const CStream& objlists);
 
     bool            LoadLevel(const std::string path); // Load the level from a .lbsp file
     const virtual CBSPLevel* GetBSP() const { return &m_bsptree; }
     uint32_t        GetLeveltime() const { return state.leveltime; } // Leveltime in ms. Starts at 0 ms.
     uint32_t        GetWorldID() const { return state.worldid; } // WorldID get incremented by 1 for each Update() call
 
+    // Precision of the object state in a snapshot, only the server
+    // should change it. The client gets it with the world state.
+    const world_quant_t& GetQuant() const { return state.quant; }
+    void            SetQuant(const world_quant_t& quant);
+
     virtual CResourceManager* GetResourceManager() { return &m_resman; }
+    // Resource and particle system strings of the objects
+    virtual CStringTable* GetStringTable() { return &m_strings; }
+
+    // Think functions of every game object, see Think.h
+    CThinkScheduler* GetThinkScheduler() { return &m_thinks; }
+    // Server: object positions of the last frames, see world_obj_trace_t::rewindtime
+    const CLagCompensation* GetLagCompensation() const { return &m_lagcomp; }
+
+    // Server: one-shot events since the last snapshot, the server
+    // sends them to the clients (see CServer::Update) and clears the list.
+    void            AddEvent(const world_event_t& event) { m_events.push_back(event); }
+    const std::vector<world_event_t>& GetEvents() const { return m_events; }
+    void            ClearEvents() { m_events.clear(); }
 
     // Move object and perform collision detection with level geometry
+    // (and with other objects, see CObj::locGetHitsObjs)
     void            ObjMove(CObj* obj, const float dt) const;
     bool            TryUnstuck(CObj* obj) const; // find a position that is not in the world geometry
 
+    // Move every object. The collision detection runs on the job system
+    // (or on this thread, if jobsystem is NULL), the new positions are
+    // applied in object order. OnHitWall and OnHitObject are called after
+    // every object has moved, again in object order. The result does not depend on
+    // the number of threads.
+    void            ObjMoveAll(const float dt, CJobSystem* jobsystem);
+
+    // Result of the last ObjMoveAll call: objects that were moved and
+    // objects that were skipped, because they rest on the ground.
+    // Ghost objects and objects moved by a client are not counted.
+    int             GetAwakeObjCount() const { return m_objawake; }
+    int             GetSleepingObjCount() const { return m_objsleeping; }
+
+    // The two halves of ObjMove. ObjMoveCalc does not change anything and
+    // can run on many threads at once, ObjMoveApply writes the result back.
+    // ObjMoveAll passes origin, vel, radius and flags from the hot field
+    // arrays of the object store, the short version reads them from obj.
+    void            ObjMoveCalc(const CObj* obj, const float dt, world_objmove_t* move) const;
+    void            ObjMoveCalc(const CObj* obj, const vec3_t& origin, const vec3_t& velocity,
+                                const float radius, const uint8_t flags, // OBJFLAGTYPE
+                                const float dt, world_objmove_t* move) const;
+    void            ObjMoveApply(CObj* obj, const world_objmove_t& move) const;
+
     // TraceObj is a core engine function to check if an object can travel along
     // a vector or if it hits the level geometry.
     // The level geometry is stored as a KD tree, so this call scales pretty
     // well even if there are many triangles in the scene.
+    // With trace->rewindtime, the objects are tested where they were
+    // at that time (see CLagCompensation), the level is the same.
     //
     // returns true if something is hit.
     bool            TraceObj(world_obj_trace_t* trace, const float maxdist);
+    // true if the line from start to end does not hit the level geometry
+    bool            IsLineOfSight(const vec3_t& start, const vec3_t& end) const;
 
     world_state_t   GetWorldState();
+    // Same as above, but fills an existing world_state_t and reuses
+    // its memory (e.g. a slot in the server history).
+    void            GetWorldState(world_state_t* worldstate);
 
 protected:
     CResourceManager m_resman;
+    CStringTable    m_strings;
     world_state_t   state;
     uint32_t        m_leveltimestart;
     CBSPLevel       m_bsptree;
 
-    OBJMAPTYPE      m_objlist;
+    CObjStore       m_objlist; // All objects, see ObjStore.h
+    CSpatialHash    m_objgrid; // Broadphase for GetNearObj, GetNearObjByTypeList and TraceObj
     void            UpdatePendingObjs(); // Deletes objects and adds new objects (from m_addobj and m_removeobj list)
     void            DeleteAllObjs(); // Delete everything
+    void            SerializeHeader(CStream* stream, const world_state_t* oldstate, int* changes);
+    // The object lists of Serialize for the objects in the interest set
+    void            SerializeInterest(CStream* stream, const world_state_t* oldstate,
+                                      const CInterestSet* interest, int* changes);
+
+    bool            FindUnstuckPos(const vec3_t& origin, const float radius, vec3_t* pos) const;
+    // Swept sphere test of obj from start to end against other objects
+    // Sets move->objhit and move->hitobj, hitpos is the position of obj at the first contact.
+    bool            ObjHitCalc(const CObj* obj, const vec3_t& start, const vec3_t& end,
+                               world_objmove_t* move, vec3_t* hitpos) const;
+    std::vector<world_objmove_t> m_objmoves; // ObjMoveAll results, one per object
+    int             m_objawake;
+    int             m_objsleeping;
 
     std::list<CObj*> m_addobj; // Objects that will be added by UpdatePendingObjs
     std::list<int>  m_removeobj; // Objects that will be deleted by UpdatePendingObjs
 
+    CThinkScheduler m_thinks;
+    CLagCompensation m_lagcomp;
+    std::vector<world_event_t> m_events;
+    mutable CFrameArena m_framearena; // the const queries need memory too
+
 private:
     // Rule of three
     CWorld(const CWorld&);
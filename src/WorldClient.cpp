@@ -16,6 +16,7 @@ CWorldClient::CWorldClient(void) : m_ghostobj(this)
 
     m_interpworld.m_pbsp = &m_bsptree; // FIXME is this save at a level change?
     m_interpworld.m_presman = &m_resman;
+    m_interpworld.m_pstrings = &m_strings;
     m_interpworld.state1.localtime = 0;
     m_interpworld.state2.localtime = 0;
 }
@@ -41,13 +42,9 @@ void CWorldClient::SetLocalObj(int id)
     {
         obj = GetObj(id);
         assert(obj);
-        if(m_localobj->GetID() != id)
+        if(m_localobj->GetID() != id) // the position is set by the prediction (CClient::Predict)
         {
             m_ghostobj.CopyObjStateFrom(obj);
-        }else if((m_ghostobj.GetOrigin()-m_localobj->GetOrigin()).AbsSquared() >= MAX_SV_CL_POS_DIFF)
-        {
-            fprintf(stderr, "CL: Reset position\n");
-            m_ghostobj.SetOrigin(m_localobj->GetOrigin());
         }
         if(obj)
             m_localobj = obj;
@@ -58,17 +55,50 @@ void CWorldClient::Update(const float dt, const uint32_t ticks)
 {
     CWorld::Update(dt, ticks);
 
-    CObj* controller = GetLocalController();
-    ObjMove(controller, dt);
-
     if(m_interpworld.f >= 1.0f)
         CreateClientInterp();
     m_interpworld.Update(dt, ticks);
+
+    size_t count = 0;
+    for(size_t i=0;i<m_effects.size();i++)
+    {
+        if((int32_t)(m_effects[i].endtime - ticks) > 0)
+            m_effects[count++] = m_effects[i];
+    }
+    m_effects.resize(count);
 }
 
-bool CWorldClient::Serialize(bool write, CStream* stream, const world_state_t* oldstate)
+void CWorldClient::AddEffect(const world_event_t& event)
 {
-    bool changed = CWorld::Serialize(write, stream, oldstate);
+    client_effect_t effect;
+    effect.endtime = CLynxSys::GetTicks() + event.lifetime;
+    effect.origin = event.origin;
+    effect.sound = NULL;
+    if(event.type == WORLD_EVENT_SOUND)
+    {
+        effect.sound = GetResourceManager()->GetSound(event.name);
+        effect.soundstate.soundpath = event.name;
+    }
+    else if(event.type == WORLD_EVENT_PARTICLES)
+    {
+        PROPERTYMAP properties;
+        properties["dx"] = event.dir.x;
+        properties["dy"] = event.dir.y;
+        properties["dz"] = event.dir.z;
+        properties["size"] = event.size;
+        effect.particles = std::shared_ptr<CParticleSystem>(
+                                CParticleSystem::CreateSystem(event.name,
+                                                              properties,
+                                                              GetResourceManager(),
+                                                              event.origin));
+    }
+    m_effects.push_back(effect);
+}
+
+bool CWorldClient::Serialize(bool write, CStream* stream, const world_state_t* oldstate,
+                             const CInterestSet* interest)
+{
+    bool changed = CWorld::Serialize(write, stream, oldstate, interest);
     if(changed && !write)
         AddWorldToHistory();
 
@@ -77,6 +107,13 @@ bool CWorldClient::Serialize(bool write, CStream* stream, const world_state_t* o
 
 void CWorldClient::AddWorldToHistory()
 {
+    // More packets of the same snapshot (see CPacketScheduler)
+    if(m_history.size() > 0 && m_history.front().state.worldid == GetWorldID())
+    {
+        GetWorldState(&m_history.front().state);
+        return;
+    }
+
     worldclient_state_t clstate;
     clstate.state = GetWorldState();
     clstate.localtime = CLynxSys::GetTicks();
@@ -179,10 +216,9 @@ void CWorldClient::CreateClientInterp()
         }
     }
     // Objekte lschen, die es jetzt nicht mehr gibt
-    OBJITER deliter;
-    for(deliter = m_interpworld.ObjBegin();deliter != m_interpworld.ObjEnd(); deliter++)
+    for(int i=0;i<m_interpworld.GetObjCount();i++)
     {
-        obj = (*deliter).second;
+        obj = m_interpworld.GetObjByIndex(i);
         if(!w1.state.ObjStateExists(obj->GetID()) ||
            !w2.state.ObjStateExists(obj->GetID()))
             m_interpworld.DelObj(obj->GetID());
@@ -191,6 +227,16 @@ void CWorldClient::CreateClientInterp()
     m_interpworld.UpdatePendingObjs();
 }
 
+uint32_t CWorldInterp::GetLerpLeveltime() const
+{
+    if(state1.localtime == 0 || state2.localtime == 0)
+        return 0;
+    const uint32_t t1 = state1.state.leveltime;
+    const uint32_t t2 = state2.state.leveltime;
+    const float lerp = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+    return t1 + (uint32_t)((float)(t2 - t1)*lerp + 0.5f);
+}
+
 void CWorldInterp::Update(const float dt, const uint32_t ticks) // Interpoliert zwischen versch. world_state_t
 {
     const uint32_t rendertime = ticks - RENDER_DELAY; // Zeitpunkt fr den interpoliert werden soll
@@ -207,14 +253,13 @@ void CWorldInterp::Update(const float dt, const uint32_t ticks) // Interpoliert
         return;
     }
 
-    std::map<int, int>::iterator iter1, iter2;
-    OBJITER iter;
     CObj* obj;
+    int i;
     vec3_t origin1, origin2, origin, vel1, vel2;
     obj_state_t obj1, obj2;
-    for(iter = ObjBegin();iter != ObjEnd(); iter++)
+    for(i=0;i<GetObjCount();i++)
     {
-        obj = (*iter).second;
+        obj = GetObjByIndex(i);
         assert(state1.state.ObjStateExists(obj->GetID()));
         assert(state2.state.ObjStateExists(obj->GetID())); // wenn das schief geht, muss geprft werden, ob das objekt richtig in die interp world eingefgt wurde
         state1.state.GetObjState(obj->GetID(), obj1);
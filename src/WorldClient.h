@@ -19,6 +19,17 @@ struct worldclient_state_t
     uint32_t   localtime; // in ms
 };
 
+// A one-shot sound or particle effect from the server (see CEventChannel),
+// it is not an object of the world.
+struct client_effect_t
+{
+    uint32_t   endtime; // local time in ms, when the effect is removed
+    vec3_t     origin;
+    const CSound* sound; // NULL: no sound
+    sound_state_t soundstate;
+    std::shared_ptr<CParticleSystem> particles; // NULL: no particles
+};
+
 // Interpolierte Welt fr Renderer
 
 class CWorldClient;
@@ -32,13 +43,17 @@ public:
 
     const virtual CBSPLevel*    GetBSP() const { return m_pbsp; }
     virtual CResourceManager*   GetResourceManager() { return m_presman; }
+    virtual CStringTable*       GetStringTable() { return m_pstrings; }
 
     // Lerp this world snapshot
     void                        Update(const float dt, const uint32_t ticks);
+    // Leveltime between the two snapshots, 0 if there is no lerped snapshot yet
+    uint32_t                    GetLerpLeveltime() const;
 
 protected:
     CBSPLevel*                  m_pbsp;
     CResourceManager*           m_presman;
+    CStringTable*               m_pstrings;
     worldclient_state_t         state1;
     worldclient_state_t         state2;
     float                       f; // Current lerp factor (0..1)
@@ -60,19 +75,26 @@ public:
     void            SetLocalObj(int id);
     // This is a client side only object, that the player directly controls
     // with the keyboard and the mouse. The server does not know about this
-    // object.
+    // object. CClient::Predict moves it.
     CObj*           GetLocalController() { return &m_ghostobj; }
 
     // The Update function takes care of:
-    //  - Collision detection for the LocalController object
     //  - Updating the lerped world snapshot
     void            Update(const float dt, const uint32_t ticks);
 
     // When a new snapshot from the server arrives, it is processed here
-    virtual bool    Serialize(bool write, CStream* stream, const world_state_t* oldstate=NULL);
+    virtual bool    Serialize(bool write, CStream* stream, const world_state_t* oldstate=NULL,
+                              const CInterestSet* interest=NULL);
 
     CWorld*         GetInterpWorld() { return &m_interpworld; } // Get lerped snapshot
 
+    // Sounds and particle effects, the mixer and the renderer play them,
+    // Update removes them after their lifetime.
+    void            AddEffect(const world_event_t& event);
+    std::vector<client_effect_t>& GetEffects() { return m_effects; }
+    // The leveltime the player sees (the lerped snapshot)
+    uint32_t        GetRenderLeveltime() const { return m_interpworld.GetLerpLeveltime(); }
+
     CClientHUD      m_hud;
 
 protected:
@@ -83,6 +105,7 @@ protected:
 
     std::list<worldclient_state_t> m_history; // world snapshot history buffer
     CWorldInterp m_interpworld; // Lerped snapshot
+    std::vector<client_effect_t> m_effects;
 
 private:
     // Pointer to the object that the server linked us to (the player object).
@@ -1,6 +1,12 @@
 #include "lynx.h"
 #include "lynxsys.h"
 #include <SDL/SDL.h>
+#ifdef _WIN32
+#include <windows.h> // GetSystemInfo, QueryPerformanceCounter
+#else
+#include <unistd.h> // sysconf
+#include <time.h> // clock_gettime
+#endif
 
 #ifdef _DEBUG
 #include <crtdbg.h>
@@ -20,6 +26,36 @@ uint32_t CLynxSys::GetTicks()
     return (SDL_GetTicks() - base);
 }
 
+uint64_t CLynxSys::GetMicroseconds()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+
+    if(freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / freq.QuadPart) * 1000000 +
+           (uint64_t)(counter.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+int CLynxSys::GetCPUCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+    const int count = (int)sysinfo.dwNumberOfProcessors;
+#else
+    const int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}
+
 void CLynxSys::GetMouseDelta(int* dx, int* dy)
 {
     SDL_GetRelativeMouseState(dx, dy);
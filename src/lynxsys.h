@@ -4,6 +4,8 @@ class CLynxSys
 {
 public:
     static uint32_t GetTicks();
+    static uint64_t GetMicroseconds(); // high resolution timer, for profiling
+    static int GetCPUCount(); // number of CPU cores (at least 1)
     static void GetMouseDelta(int* dx, int* dy);
     static bool MouseLeftDown();
     static bool MouseRightDown();
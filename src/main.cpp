@@ -10,6 +10,7 @@
 #include "Renderer.h"
 #include "Mixer.h"
 #include "Server.h"
+#include "ServerClient.h"
 #include "Client.h"
 #include "WorldClient.h"
 #include "Menu.h"
@@ -29,6 +30,7 @@
 #define FULLSCREEN          (CLynx::cfg.GetVarAsInt("fullscreen", 0, true)) // 0 = no fullscreen, 1 = fullscreen
 #define SV_PORT             (CLynx::cfg.GetVarAsInt("port", 9999, true))
 #define DEFAULT_LEVEL       (CLynx::cfg.GetVarAsStr("level", "testlvl/level1.lbsp", true))
+#define SV_UPDATETIME       (CLynx::cfg.GetVarAsInt("sv_updatetime", SERVER_UPDATETIME, true)) // ms between two snapshots
 //#define DEFAULT_LEVEL       "sponza/sponza.lbsp"
 
 bool restartserver(CWorld** worldsv,
@@ -323,6 +325,7 @@ bool restartserver(CWorld** worldsv,
     *worldsv = new CWorld;
     *server = new CServer(*worldsv);
     *game = new CGameZombie(*worldsv, *server);
+    (*server)->SetUpdateTime(SV_UPDATETIME);
 
     ((CSubject<EventNewClientConnected>*)*server)->AddObserver(*game);
     ((CSubject<EventClientDisconnected>*)*server)->AddObserver(*game);
@@ -3,7 +3,11 @@
 #include "lynxsys.h"
 #include <time.h>
 #include "Server.h"
+#include "ServerClient.h"
 #include "GameZombie.h"
+#include "ObjPool.h"
+#include <vector>
+#include <algorithm> // nth_element
 #include <SDL/SDL.h>
 
 // <memory leak detection>
@@ -14,6 +18,48 @@
 // </memory leak detection>
 
 #define DEFAULT_LEVEL       "bath/bath.lbsp"
+#define SV_TICKTIME         (CLynx::cfg.GetVarAsInt("sv_ticktime", 50, true)) // ms per simulation tick
+#define SV_UPDATETIME       (CLynx::cfg.GetVarAsInt("sv_updatetime", SERVER_UPDATETIME, true)) // ms between two snapshots
+#define SV_MAX_TICK_LAG     5 // if we are more than x ticks behind, we skip them
+#define STATS_INTERVAL      10000 // print tick, object and object pool counters every x ms
+
+// Tick duration statistics, to see if the server keeps up with the tick rate
+struct tickstats_t
+{
+    std::vector<uint32_t> duration; // in us, one entry per tick
+    uint32_t overruns; // ticks that took longer than the tick time
+    uint32_t skipped; // ticks not simulated, because we were too far behind
+};
+
+static void PrintTickStats(tickstats_t* stats, const uint32_t ticktime)
+{
+    const size_t count = stats->duration.size();
+    uint64_t sum = 0;
+    uint32_t p99, max;
+
+    if(count < 1)
+        return;
+    for(size_t i=0;i<count;i++)
+        sum += stats->duration[i];
+    max = *std::max_element(stats->duration.begin(), stats->duration.end());
+    std::nth_element(stats->duration.begin(),
+                     stats->duration.begin() + count*99/100,
+                     stats->duration.end());
+    p99 = stats->duration[count*99/100];
+
+    fprintf(stderr, "Tick: %u ticks, avg %.2f ms, p99 %.2f ms, max %.2f ms, budget %u ms, %u overruns, %u skipped\n",
+            (uint32_t)count,
+            0.001f*(float)(sum/count),
+            0.001f*(float)p99,
+            0.001f*(float)max,
+            ticktime,
+            stats->overruns,
+            stats->skipped);
+
+    stats->duration.clear();
+    stats->overruns = 0;
+    stats->skipped = 0;
+}
 
 int main(int argc, char** argv)
 {
@@ -31,11 +77,25 @@ int main(int argc, char** argv)
     fprintf(stderr, "Level: %s\n", level);
     srand((unsigned int)time(NULL));
 
+    // Load config file
+    if(!CLynx::cfg.AddFile( "game.cfg" ))
+        fprintf(stderr, "Failed to open config file.\n"); // bad, but not critical
+
     { // for dumpmemleak
     int run;
-    float dt;
-    uint32_t time, oldtime;
-    uint32_t fpstimer, fpscounter=0;
+    uint32_t time, now;
+    uint64_t tickstart;
+    uint32_t ticktime = SV_TICKTIME;
+    uint32_t statstimer, statstickcounter=0;
+    objpool_stats_t poolstats;
+    tickstats_t tickstats;
+
+    if(ticktime < 1)
+        ticktime = 1;
+    const float dt = 0.001f * (float)ticktime; // fixed time step
+    tickstats.duration.reserve(STATS_INTERVAL/ticktime + 1);
+    tickstats.overruns = 0;
+    tickstats.skipped = 0;
 
     // Game Modules
     CWorld worldsv; // Model
@@ -51,34 +111,69 @@ int main(int argc, char** argv)
         fprintf(stderr, "Failed to create server on port: %i\n", svport);
         return -1;
     }
+    server.SetUpdateTime(SV_UPDATETIME);
     svgame.InitGame(level);
-    fprintf(stderr, "Server running\n");
+    fprintf(stderr, "Server running (tick %u ms, snapshot %u ms)\n",
+            ticktime, server.GetUpdateTime());
 
     run = 1;
-    oldtime = fpstimer = CLynxSys::GetTicks();
+    time = statstimer = CLynxSys::GetTicks();
     while(run)
     {
-        time = CLynxSys::GetTicks();
-        dt = 0.001f * (float)(time-oldtime);
-        oldtime = time;
-        fpscounter++;
-        if(time - fpstimer > 1000.0f)
-        {
-            fpscounter = 0;
-            fpstimer = time;
-        }
-
         // Update Game Classes
+        // time is the simulation time of this tick, it
+        // advances exactly ticktime ms per tick.
+        tickstart = CLynxSys::GetMicroseconds();
         svgame.Update(dt, time);
         worldsv.Update(dt, time);
         server.Update(dt, time);
+        tickstats.duration.push_back((uint32_t)(CLynxSys::GetMicroseconds() - tickstart));
+        if(tickstats.duration.back() > ticktime*1000)
+            tickstats.overruns++;
+        statstickcounter++;
+
+        if(time - statstimer >= STATS_INTERVAL)
+        {
+            PrintTickStats(&tickstats, ticktime);
+            fprintf(stderr, "Objects: %i moved, %i sleeping, %i thinks pending, %i deferred\n",
+                    worldsv.GetAwakeObjCount(), worldsv.GetSleepingObjCount(),
+                    worldsv.GetThinkScheduler()->GetCount(),
+                    worldsv.GetThinkScheduler()->GetLastDeferCount());
+            CObjPool::GetStats(&poolstats);
+            CObjPool::ResetStats();
+            if(poolstats.allocs > 0)
+                fprintf(stderr, "Pool: %.1f allocs/tick, %.1f heap allocs avoided/tick, %u objects alive\n",
+                        (float)poolstats.allocs/statstickcounter,
+                        (float)(poolstats.allocs - poolstats.heapallocs)/statstickcounter,
+                        poolstats.inuse);
+            if(server.GetEncodeHits() + server.GetEncodeMisses() > 0)
+                fprintf(stderr, "Snapshots: %u world encodes, %u reused (%.0f%%)\n",
+                        server.GetEncodeMisses(), server.GetEncodeHits(),
+                        100.0f*server.GetEncodeHits()/(server.GetEncodeHits() + server.GetEncodeMisses()));
+            server.ResetEncodeStats();
+            statstickcounter = 0;
+            statstimer = time;
+        }
 
-        // Limit to 20 fps
-        // so my notebook fan is quiet :-)
-        float dtrest = 1.0f/20.0f - dt;
-        if(dtrest > 0.0f)
-            dtrest = 0.0f;
-        SDL_Delay((uint32_t)(dtrest * 1000.0f));
+        time += ticktime; // next tick
+        now = CLynxSys::GetTicks();
+        if((int32_t)(now - time) > SV_MAX_TICK_LAG*(int32_t)ticktime)
+        {
+            // we can't catch up, don't try to run
+            // the missed ticks back to back.
+            tickstats.skipped += (now - time)/ticktime;
+            time = now;
+        }
+
+        // Sleep in the network layer until the next tick is due.
+        // Client messages are processed as soon as they arrive, with
+        // the time of the next tick: the wall clock can be ahead of
+        // the simulation (e.g. the connect time of a new client).
+        while((int32_t)(time - now) > 0)
+        {
+            server.Receive(time - now, time);
+            now = CLynxSys::GetTicks();
+        }
     }
     }
 #ifdef _WIN32
@@ -1,5 +1,6 @@
 #pragma once
 #include <math.h>
+#include <stdint.h>
 
 #if defined(WIN32) || defined(_WIN32)
 #define LYNX_INLINE    __forceinline
@@ -26,7 +27,7 @@ namespace lynxmath
     {
         // the magic inv square root
         const float xhalf = 0.5f * x;
-        long i = *(long*)&x;       // store floating-point bits in integer
+        int32_t i = *(int32_t*)&x; // store floating-point bits in integer (long is 64 bit on LP64)
         i = 0x5f3759d5 - (i >> 1); // initial guess for Newton's method
         x = *(float*)&i;           // convert new bits into float
         x = x*(1.5f - xhalf*x*x);  // One round of Newton's method
@@ -38,7 +39,7 @@ namespace lynxmath
         // this time with better comments (from quake 3)
         const float original_x = x;
         const float xhalf = 0.5f * x;
-        long i = *(long*)&x;           // evil floating point bit level hacking
+        int32_t i = *(int32_t*)&x;     // evil floating point bit level hacking (not long, 64 bit on LP64)
         i = 0x5f3759d5 - (i >> 1);     // what the fuck?
         x = *(float*)&i;
         x = x*(1.5f - xhalf*x*x);
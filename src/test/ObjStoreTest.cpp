@@ -0,0 +1,109 @@
+#include "Test.h"
+#include "../World.h"
+#include "../ServerClient.h"
+
+#define TEST_LEVEL      "bath/bath.lbsp" // ctest runs in the game directory
+
+// Do the hot field arrays of the store match the objects?
+static bool HotFieldsMatch(const CWorld* world)
+{
+    const CObjStore* store = world->GetObjStore();
+    const int count = world->GetObjCount();
+
+    if((int)store->GetIDArray().size() != count ||
+       (int)store->GetOriginArray().size() != count ||
+       (int)store->GetVelArray().size() != count ||
+       (int)store->GetRotArray().size() != count ||
+       (int)store->GetRadiusArray().size() != count ||
+       (int)store->GetFlagsArray().size() != count ||
+       (int)store->GetChangedArray().size() != count)
+        return false;
+
+    for(int i=0;i<count;i++)
+    {
+        const CObj* obj = world->GetObjByIndex(i);
+        if(store->GetIDArray()[i] != obj->GetID() ||
+           store->GetOriginArray()[i] != obj->GetOrigin() ||
+           store->GetVelArray()[i] != obj->GetVel() ||
+           store->GetRotArray()[i] != obj->GetRot() ||
+           store->GetRadiusArray()[i] != obj->GetRadius() ||
+           store->GetFlagsArray()[i] != obj->GetFlags())
+            return false;
+    }
+    return true;
+}
+
+// Full update from world to client
+static void Transfer(CWorld* world, CWorld* client)
+{
+    CStream stream;
+    stream.SetSize(MAX_SV_PACKETLEN);
+    TEST_CHECK(world->Serialize(true, &stream));
+    stream.ResetReadPosition();
+    TEST_CHECK(client->Serialize(false, &stream));
+    TEST_CHECK(!stream.GetWriteOverflow() && !stream.GetReadOverflow());
+}
+
+// The arrays follow the setters, the movement, removed objects
+// (the last object fills the gap) and the snapshots on the client.
+static void TestHotFields()
+{
+    CWorld world, client;
+    CJobSystem jobs(4);
+    uint32_t leveltime = 1000;
+    int i;
+
+    TEST_CHECK(world.LoadLevel(CLynx::GetBaseDirLevel() + TEST_LEVEL));
+    TEST_CHECK(client.LoadLevel(CLynx::GetBaseDirLevel() + TEST_LEVEL));
+
+    bspbin_spawn_t spawn = world.GetBSP()->GetRandomSpawnPoint();
+    for(i=0;i<40;i++)
+    {
+        CObj* obj = new CObj(&world);
+        obj->SetOrigin(spawn.point + vec3_t((float)(i % 8), 2.0f + (float)(i / 8), 0.0f));
+        obj->SetVel(vec3_t(0.0f, 0.0f, (float)i));
+        obj->SetRadius(0.2f);
+        if(i % 10 == 0)
+            obj->SetFlags(OBJ_FLAGS_GHOST);
+        world.AddObj(obj, i % 2 == 0);
+    }
+    TEST_CHECK(world.GetObjCount() == 20);
+    TEST_CHECK(HotFieldsMatch(&world));
+    world.Update(0.05f, leveltime);
+    TEST_CHECK(world.GetObjCount() == 40);
+    TEST_CHECK(HotFieldsMatch(&world));
+
+    const vec3_t start = world.GetObjByIndex(1)->GetOrigin();
+    for(i=0;i<10;i++)
+    {
+        leveltime += 50;
+        world.Update(0.05f, leveltime);
+        world.ObjMoveAll(0.05f, i % 2 ? &jobs : NULL); // ObjMoveCalc reads the arrays
+    }
+    TEST_CHECK(world.GetObjByIndex(1)->GetOrigin() != start); // gravity
+    TEST_CHECK(HotFieldsMatch(&world));
+
+    world.GetObjByIndex(3)->SetRot(quaternion_t(vec3_t(0.0f, 1.0f, 0.0f), 1.0f));
+    world.GetObjByIndex(4)->SetRadius(0.5f);
+    world.GetObjByIndex(5)->AddFlags(OBJ_FLAGS_NOGRAVITY);
+    world.GetObjByIndex(6)->SetVel(vec3_t(1.0f, 0.0f, 0.0f));
+    TEST_CHECK(HotFieldsMatch(&world));
+
+    for(i=0;i<world.GetObjCount();i+=3)
+        world.DelObj(world.GetObjByIndex(i)->GetID());
+    leveltime += 50;
+    world.Update(0.05f, leveltime);
+    TEST_CHECK(world.GetObjCount() == 26);
+    TEST_CHECK(HotFieldsMatch(&world));
+
+    Transfer(&world, &client);
+    client.Update(0.0f, leveltime);
+    TEST_CHECK(client.GetObjCount() == world.GetObjCount());
+    TEST_CHECK(HotFieldsMatch(&client));
+}
+
+int main(int argc, char** argv)
+{
+    TestHotFields();
+    return TEST_RESULT();
+}
@@ -0,0 +1,107 @@
+#include "Test.h"
+#include "../World.h"
+#include "../PacketScheduler.h"
+#include "../ServerClient.h"
+
+#define TEST_LEVEL      "bath/bath.lbsp" // ctest runs in the game directory
+
+// One snapshot: deliver every packet to the client and acknowledge them
+static void SendSnapshot(CWorld* world, CPacketScheduler* packets, CWorld* client,
+                         unsigned int* maxbytes, int* packetcount)
+{
+    CStream stream;
+    uint32_t seq = 0;
+    int count = 0;
+
+    stream.SetSize(MAX_SV_PACKETLEN);
+    packets->Update(world, NULL, NULL);
+    while(true)
+    {
+        stream.ResetWritePosition();
+        if(!packets->WritePacket(world, &stream))
+            break;
+        if(stream.GetBytesWritten() > *maxbytes)
+            *maxbytes = stream.GetBytesWritten();
+        stream.ResetReadPosition();
+        stream.ReadDWORD(&seq);
+        client->Serialize(false, &stream);
+        count++;
+    }
+    if(count > 0)
+        packets->Ack(seq, count > PACKET_ACK_BITS ? 0xffffffff : (1u << (count-1)) - 1);
+    *packetcount += count;
+}
+
+// Does the client have every object of world?
+static bool ClientComplete(CWorld* world, CWorld* client)
+{
+    if(client->GetObjCount() != world->GetObjCount())
+        return false;
+    for(int i=0;i<world->GetObjCount();i++)
+    {
+        const CObj* obj = world->GetObjByIndex(i);
+        const CObj* clobj = client->GetObj(obj->GetID());
+        if(!clobj || clobj->GetParticleSystemName() != obj->GetParticleSystemName())
+            return false;
+    }
+    return true;
+}
+
+// An object larger than sv_packetsize goes first in the queue. It must
+// not block the other objects.
+static void TestLargeObject(int packetsize, int budget, int maxsnapshots)
+{
+    CWorld world, client;
+    CPacketScheduler packets;
+    uint32_t leveltime = 1000;
+    unsigned int maxbytes = 0;
+    int packetcount = 0;
+    int snapshots;
+    int i;
+
+    TEST_CHECK(world.LoadLevel(CLynx::GetBaseDirLevel() + TEST_LEVEL));
+    packets.SetLimits(packetsize, budget);
+
+    CObj* large = new CObj(&world); // lowest id: first in the queue
+    large->SetParticleSystem("blood|" + std::string(3*PACKET_SIZE, 'x'));
+    world.AddObj(large);
+    for(i=0;i<30;i++)
+    {
+        CObj* obj = new CObj(&world);
+        obj->SetOrigin(vec3_t((float)i, 0.0f, 0.0f));
+        obj->SetParticleSystem("dust");
+        world.AddObj(obj);
+    }
+    world.Update(0.05f, leveltime); // the new objects are in the world after an update
+    TEST_CHECK(world.GetObjCount() == 31);
+
+    for(snapshots=0;snapshots<10 && !ClientComplete(&world, &client);snapshots++)
+    {
+        leveltime += 50;
+        world.Update(0.05f, leveltime);
+        SendSnapshot(&world, &packets, &client, &maxbytes, &packetcount);
+    }
+    TEST_CHECK(ClientComplete(&world, &client));
+    TEST_CHECK(snapshots <= maxsnapshots);
+    TEST_CHECK(maxbytes > (unsigned int)packetsize); // the large object in its own packet
+    TEST_CHECK(packets.GetPendingCount() == 0);
+
+    // the large object does not change: only small packets from now on
+    maxbytes = 0;
+    for(i=0;i<5;i++)
+    {
+        world.GetObjByIndex(1 + i)->SetOrigin(vec3_t(0.0f, (float)i, 0.0f));
+        leveltime += 50;
+        world.Update(0.05f, leveltime);
+        SendSnapshot(&world, &packets, &client, &maxbytes, &packetcount);
+    }
+    TEST_CHECK(ClientComplete(&world, &client));
+    TEST_CHECK(maxbytes <= (unsigned int)packetsize);
+}
+
+int main(int argc, char** argv)
+{
+    TestLargeObject(PACKET_SIZE, PACKET_BUDGET, 1);
+    TestLargeObject(PACKET_SIZE, 500, 5); // budget below the packet size
+    return TEST_RESULT();
+}
@@ -0,0 +1,71 @@
+#include "Test.h"
+#include "../StringTable.h"
+
+// Send the table from server to client, like the world state does.
+// Returns true if there was an entry.
+static bool Transfer(CStringTable* server, CStringTable* client, uint32_t baselineid)
+{
+    CStream stream;
+    stream.SetSize(4096);
+    server->Serialize(true, &stream, baselineid);
+    stream.ResetReadPosition();
+    const bool changes = client->Serialize(false, &stream, 0);
+    TEST_CHECK(!stream.GetWriteOverflow() && !stream.GetReadOverflow());
+    return changes;
+}
+
+// A client connects while a string has no references. The string is
+// used again later: the client needs it with the next delta.
+static void TestReacquire()
+{
+    CStringTable server, early, late;
+    uint32_t leveltime = 1000;
+
+    const int id = server.Acquire("rocket", 2, leveltime);
+    TEST_CHECK(id > 0);
+    TEST_CHECK(Transfer(&server, &early, 0)); // full update, world 2
+    TEST_CHECK(early.Get(id) == "rocket");
+
+    leveltime += 100;
+    server.Release(id, leveltime); // world 5: no rocket left
+
+    leveltime += 100;
+    Transfer(&server, &late, 0); // world 6: full update for the new client
+    TEST_CHECK(late.Get(id) == "");
+
+    leveltime += 100;
+    TEST_CHECK(server.Acquire("rocket", 8, leveltime) == id); // before STRINGTABLE_REUSE_DELAY: same id
+    TEST_CHECK(server.GetAdded(id) == 8);
+
+    TEST_CHECK(Transfer(&server, &late, 6)); // delta from the full update
+    TEST_CHECK(late.Get(id) == "rocket");
+    TEST_CHECK(Transfer(&server, &early, 2)); // the old client gets it again, that is fine
+    TEST_CHECK(early.Get(id) == "rocket");
+
+    // nothing new since world 8
+    CStringTable other;
+    TEST_CHECK(!Transfer(&server, &other, 8));
+}
+
+// An id without references is reused after STRINGTABLE_REUSE_DELAY
+static void TestReuse()
+{
+    CStringTable server, client;
+    uint32_t leveltime = 1000;
+
+    const int id = server.Acquire("gun", 2, leveltime);
+    TEST_CHECK(Transfer(&server, &client, 0));
+    server.Release(id, leveltime);
+
+    leveltime += STRINGTABLE_REUSE_DELAY + 1;
+    TEST_CHECK(server.Acquire("zombie", 10, leveltime) == id);
+    TEST_CHECK(Transfer(&server, &client, 2));
+    TEST_CHECK(client.Get(id) == "zombie");
+}
+
+int main(int argc, char** argv)
+{
+    TestReacquire();
+    TestReuse();
+    return TEST_RESULT();
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdio.h>
+
+/*
+    Minimal checks for the tests in this directory. Every test is an
+    executable (see CMakeLists.txt, ctest runs them) and returns the
+    number of failed checks.
+ */
+
+static int g_test_failed = 0;
+
+#define TEST_CHECK(cond) \
+    do { if(!(cond)) { fprintf(stderr, "%s:%i: check failed: %s\n", __FILE__, __LINE__, #cond); g_test_failed++; } } while(0)
+
+#define TEST_RESULT() \
+    (fprintf(stderr, "%s: %s\n", __FILE__, g_test_failed ? "FAILED" : "ok"), g_test_failed)
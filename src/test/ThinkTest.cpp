@@ -0,0 +1,63 @@
+#include "Test.h"
+#include "../Think.h"
+
+class CThinkFuncOnce : public CThinkFunc
+{
+public:
+    CThinkFuncOnce(uint32_t time, int* count) : CThinkFunc(time, NULL, NULL), m_count(count) {}
+    virtual bool DoThink(uint32_t leveltime)
+    {
+        (*m_count)++;
+        return true;
+    }
+private:
+    int* m_count;
+};
+
+// Adds a thinkfunc, that is due at once (e.g. a respawn in the past)
+class CThinkFuncSpawn : public CThinkFunc
+{
+public:
+    CThinkFuncSpawn(uint32_t time, CThink* think, int* count) :
+        CThinkFunc(time, NULL, NULL), m_think(think), m_count(count) {}
+    virtual bool DoThink(uint32_t leveltime)
+    {
+        m_think->AddFunc(new CThinkFuncOnce(GetThinktime() - 100, m_count));
+        return true;
+    }
+private:
+    CThink* m_think;
+    int* m_count;
+};
+
+// A thinkfunc scheduled during Run sorts before due thinkfuncs, that
+// are still in the heap. It waits for the next call, the others must
+// still run.
+static void TestScheduledDuringRun()
+{
+    CThinkScheduler scheduler;
+    CThink think(&scheduler);
+    int spawned = 0, once = 0;
+    int i;
+
+    think.AddFunc(new CThinkFuncSpawn(500, &think, &spawned));
+    for(i=0;i<2*THINK_BATCHSIZE;i++)
+        think.AddFunc(new CThinkFuncOnce(500 + i/2, &once));
+
+    scheduler.Run(1000);
+    TEST_CHECK(once == 2*THINK_BATCHSIZE);
+    TEST_CHECK(spawned == 0); // next call
+    TEST_CHECK(scheduler.GetLastDeferCount() == 0);
+    TEST_CHECK(scheduler.GetCount() == 1);
+
+    scheduler.Run(1000);
+    TEST_CHECK(spawned == 1);
+    TEST_CHECK(scheduler.GetLastRunCount() == 1);
+    TEST_CHECK(scheduler.GetCount() == 0);
+}
+
+int main(int argc, char** argv)
+{
+    TestScheduledDuringRun();
+    return TEST_RESULT();
+}